@@ -16,28 +16,61 @@
 
 #include "codegen.h"
 
+#include <android-base/file.h>
 #include <expresscatalog-utils.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
 
 namespace android {
 namespace express {
 
+namespace {
+
+// Replaces the file with content unless it already has it, so that unchanged outputs keep their
+// timestamp. The content goes to a file next to it first, so that the rename is atomic.
+bool writeFileIfChanged(const std::string& filePath, const std::string& content) {
+    std::string existingContent;
+    if (android::base::ReadFileToString(filePath, &existingContent) &&
+        existingContent == content) {
+        LOGD("File unchanged: %s\n", filePath.c_str());
+        return true;
+    }
+
+    const std::string tempFilePath = filePath + ".tmp";
+    if (!android::base::WriteStringToFile(content, tempFilePath) ||
+        rename(tempFilePath.c_str(), filePath.c_str()) != 0) {
+        LOGE("Unable to write file %s\n", filePath.c_str());
+        remove(tempFilePath.c_str());
+        return false;
+    }
+    LOGD("File written: %s\n", filePath.c_str());
+    return true;
+}
+
+}  // namespace
+
 bool CodeGenerator::generateCode(const MetricInfoMap& metricsIds) const {
     bool result = true;
     if (mFilePath.size()) {
-        FILE* fdOut = fopen(mFilePath.c_str(), "we");
+        // The code is rendered in memory and only written if it changed.
+        char* data = nullptr;
+        size_t size = 0;
+        FILE* fdOut = open_memstream(&data, &size);
         if (fdOut == nullptr) {
             LOGE("Unable to open file for write %s\n", mFilePath.c_str());
             return false;
         }
 
         result = generateCodeImpl(fdOut, metricsIds);
+        result = fclose(fdOut) == 0 && result;
         if (result) {
-            LOGD("File written: %s\n", mFilePath.c_str());
+            result = writeFileIfChanged(mFilePath, std::string(data, size));
         } else {
             LOGE("Failed to generate code for %s\n", mFilePath.c_str());
         }
-        fclose(fdOut);
+        free(data);
     }
     return result;
 }
@@ -136,12 +136,21 @@ static java_type_t java_type(const FieldDescriptor& field) {
 }
 
 /**
- * Gather the enums info.
+ * Gather the enums info. The values of each enum type are collated once and shared by all the
+ * fields of that type.
  */
-void collate_enums(const EnumDescriptor& enumDescriptor, AtomField& atomField) {
-    for (int i = 0; i < enumDescriptor.value_count(); i++) {
-        atomField.enumValues[enumDescriptor.value(i)->number()] = enumDescriptor.value(i)->name();
+void collate_enums(const EnumDescriptor& enumDescriptor, AtomField& atomField,
+                   EnumValuesByType& enumValuesByType) {
+    shared_ptr<const map<int, string>>& enumValues = enumValuesByType[&enumDescriptor];
+    if (enumValues == nullptr) {
+        auto values = make_shared<map<int, string>>();
+        for (int i = 0; i < enumDescriptor.value_count(); i++) {
+            (*values)[enumDescriptor.value(i)->number()] = enumDescriptor.value(i)->name();
+        }
+        enumValues = values;
     }
+    atomField.enumValues = enumValues;
+    atomField.enumFullTypeName = enumDescriptor.full_name();
 }
 
 static void addAnnotationToAtomDecl(AtomDecl& atomDecl, const int fieldNumber,
@@ -359,6 +368,12 @@ static int collate_field_annotations(AtomDecl& atomDecl, const FieldDescriptor&
  * Gather the info about an atom proto.
  */
 int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>& signature) {
+    EnumValuesByType enumValuesByType;
+    return collate_atom(atom, atomDecl, signature, enumValuesByType);
+}
+
+int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>& signature,
+                 EnumValuesByType& enumValuesByType) {
     int errorCount = 0;
 
     // Build a sorted list of the fields. Descriptor has them in source file
@@ -461,7 +476,7 @@ int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>
         if (javaType == JAVA_TYPE_ENUM || javaType == JAVA_TYPE_ENUM_ARRAY) {
             atField.enumTypeName = field.enum_type()->name();
             // All enums are treated as ints when it comes to function signatures.
-            collate_enums(*field.enum_type(), atField);
+            collate_enums(*field.enum_type(), atField, enumValuesByType);
         }
 
         // Generate signature for atom.
@@ -487,7 +502,7 @@ int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>
 // This function flattens the fields of the AttributionNode proto in an Atom
 // proto and generates the corresponding atom decl and signature.
 bool get_non_chained_node(const Descriptor& atom, AtomDecl& atomDecl,
-                          vector<java_type_t>& signature) {
+                          vector<java_type_t>& signature, EnumValuesByType& enumValuesByType) {
     // Build a sorted list of the fields. Descriptor has them in source file
     // order.
     map<int, const FieldDescriptor*> fields;
@@ -519,7 +534,7 @@ bool get_non_chained_node(const Descriptor& atom, AtomDecl& atomDecl,
             if (javaType == JAVA_TYPE_ENUM) {
                 // All enums are treated as ints when it comes to function signatures.
                 signature.push_back(JAVA_TYPE_INT);
-                collate_enums(*field.enum_type(), atField);
+                collate_enums(*field.enum_type(), atField, enumValuesByType);
             } else {
                 signature.push_back(javaType);
             }
@@ -548,28 +563,39 @@ static AtomType getAtomType(const FieldDescriptor& atomField) {
     }
 }
 
-static int collate_from_field_descriptor(const FieldDescriptor& atomField, const string& moduleName,
-                                         Atoms& atoms) {
+static bool is_atom_in_module(const FieldDescriptor& atomField, const string& moduleName) {
+    if (moduleName == DEFAULT_MODULE_NAME) {
+        return true;
+    }
+    const int moduleCount = atomField.options().ExtensionSize(os::statsd::module);
+    for (int j = 0; j < moduleCount; ++j) {
+        const string atomModuleName = atomField.options().GetExtension(os::statsd::module, j);
+        if (atomModuleName == moduleName) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Collates the atom once and adds it to the Atoms of each of the modules that it belongs to.
+static int collate_from_field_descriptor(const FieldDescriptor& atomField,
+                                         const map<string, Atoms*>& moduleAtoms,
+                                         EnumValuesByType& enumValuesByType) {
     int errorCount = 0;
 
-    if (moduleName != DEFAULT_MODULE_NAME) {
-        const int moduleCount = atomField.options().ExtensionSize(os::statsd::module);
-        bool moduleFound = false;
-        for (int j = 0; j < moduleCount; ++j) {
-            const string atomModuleName = atomField.options().GetExtension(os::statsd::module, j);
-            if (atomModuleName == moduleName) {
-                moduleFound = true;
-                break;
-            }
+    vector<Atoms*> targetAtoms;
+    for (const auto& [moduleName, atoms] : moduleAtoms) {
+        if (is_atom_in_module(atomField, moduleName)) {
+            targetAtoms.push_back(atoms);
         }
+    }
 
-        // This atom is not in the module we're interested in; skip it.
-        if (!moduleFound) {
-            if (dbg) {
-                printf("   Skipping %s (%d)\n", atomField.name().c_str(), atomField.number());
-            }
-            return errorCount;
+    // This atom is not in the modules we're interested in; skip it.
+    if (targetAtoms.empty()) {
+        if (dbg) {
+            printf("   Skipping %s (%d)\n", atomField.name().c_str(), atomField.number());
         }
+        return errorCount;
     }
 
     if (dbg) {
@@ -616,7 +642,7 @@ static int collate_from_field_descriptor(const FieldDescriptor& atomField, const
     }
 
     vector<java_type_t> signature;
-    errorCount += collate_atom(atom, *atomDecl, signature);
+    errorCount += collate_atom(atom, *atomDecl, signature, enumValuesByType);
     if (!atomDecl->primaryFields.empty() && atomDecl->exclusiveField == 0) {
         print_error(atomField, "Cannot have a primary field without an exclusive field: %s\n",
                     atomField.name().c_str());
@@ -624,22 +650,29 @@ static int collate_from_field_descriptor(const FieldDescriptor& atomField, const
         return errorCount;
     }
 
-    FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet =
-            atomType == ATOM_TYPE_PUSHED ? atoms.signatureInfoMap[signature]
-                                         : atoms.pulledAtomsSignatureInfoMap[signature];
-    populateFieldNumberToAtomDeclSet(atomDecl, fieldNumberToAtomDeclSet);
-
-    atoms.decls.insert(atomDecl);
-
     shared_ptr<AtomDecl> nonChainedAtomDecl =
             make_shared<AtomDecl>(atomField.number(), atomField.name(), atom.name(), atomType);
     vector<java_type_t> nonChainedSignature;
-    if (get_non_chained_node(atom, *nonChainedAtomDecl, nonChainedSignature)) {
-        FieldNumberToAtomDeclSet& nonChainedFieldNumberToAtomDeclSet =
-                atoms.nonChainedSignatureInfoMap[nonChainedSignature];
-        populateFieldNumberToAtomDeclSet(nonChainedAtomDecl, nonChainedFieldNumberToAtomDeclSet);
+    const bool hasNonChainedNode =
+            get_non_chained_node(atom, *nonChainedAtomDecl, nonChainedSignature, enumValuesByType);
+
+    // The modules share the declarations of the atom.
+    for (Atoms* atoms : targetAtoms) {
+        FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet =
+                atomType == ATOM_TYPE_PUSHED ? atoms->signatureInfoMap[signature]
+                                             : atoms->pulledAtomsSignatureInfoMap[signature];
+        populateFieldNumberToAtomDeclSet(atomDecl, fieldNumberToAtomDeclSet);
 
-        atoms.non_chained_decls.insert(nonChainedAtomDecl);
+        atoms->decls.insert(atomDecl);
+
+        if (hasNonChainedNode) {
+            FieldNumberToAtomDeclSet& nonChainedFieldNumberToAtomDeclSet =
+                    atoms->nonChainedSignatureInfoMap[nonChainedSignature];
+            populateFieldNumberToAtomDeclSet(nonChainedAtomDecl,
+                                             nonChainedFieldNumberToAtomDeclSet);
+
+            atoms->non_chained_decls.insert(nonChainedAtomDecl);
+        }
     }
 
     if (atomField.options().HasExtension(os::statsd::field_restriction_option)) {
@@ -652,23 +685,43 @@ static int collate_from_field_descriptor(const FieldDescriptor& atomField, const
 }
 
 /**
- * Gather the info about the atoms.
+ * Gather the info about the atoms of each module in one pass.
  */
-int collate_atoms(const Descriptor& descriptor, const string& moduleName, Atoms& atoms) {
+static int collate_module_atoms(const Descriptor& descriptor,
+                                const map<string, Atoms*>& moduleAtoms) {
     int errorCount = 0;
+    EnumValuesByType enumValuesByType;
 
     // Regular field atoms in Atom
     for (int i = 0; i < descriptor.field_count(); i++) {
         const FieldDescriptor* atomField = descriptor.field(i);
-        errorCount += collate_from_field_descriptor(*atomField, moduleName, atoms);
+        errorCount += collate_from_field_descriptor(*atomField, moduleAtoms, enumValuesByType);
     }
 
     // Extension field atoms in Atom.
     vector<const FieldDescriptor*> extensions;
     descriptor.file()->pool()->FindAllExtensions(&descriptor, &extensions);
     for (const FieldDescriptor* atomField : extensions) {
-        errorCount += collate_from_field_descriptor(*atomField, moduleName, atoms);
+        errorCount += collate_from_field_descriptor(*atomField, moduleAtoms, enumValuesByType);
+    }
+
+    return errorCount;
+}
+
+int collate_atoms(const Descriptor& descriptor, const set<string>& moduleNames,
+                  map<string, Atoms>& moduleAtoms) {
+    map<string, Atoms*> targetAtoms;
+    for (const string& moduleName : moduleNames) {
+        targetAtoms[moduleName] = &moduleAtoms[moduleName];
     }
+    return collate_module_atoms(descriptor, targetAtoms);
+}
+
+/**
+ * Gather the info about the atoms.
+ */
+int collate_atoms(const Descriptor& descriptor, const string& moduleName, Atoms& atoms) {
+    const int errorCount = collate_module_atoms(descriptor, {{moduleName, &atoms}});
 
     if (dbg) {
         // Signatures for pushed atoms.
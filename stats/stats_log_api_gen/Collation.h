@@ -30,6 +30,7 @@ namespace android {
 namespace stats_log_api_gen {
 
 using google::protobuf::Descriptor;
+using google::protobuf::EnumDescriptor;
 using google::protobuf::FieldDescriptor;
 using google::protobuf::OneofDescriptor;
 using std::map;
@@ -156,10 +157,13 @@ struct AtomField {
     java_type_t javaType;
 
     // If the field is of type enum, the following map contains the list of enum
-    // values.
-    map<int /* numeric value */, string /* value name */> enumValues;
+    // values. It is shared by all the fields of the same enum type.
+    shared_ptr<const map<int /* numeric value */, string /* value name */>> enumValues;
     // If the field is of type enum, the following field contains enum type name
     string enumTypeName;
+    // If the field is of type enum, the following field contains the full name of the enum
+    // type, such as "android.app.ProcessStateEnum"
+    string enumFullTypeName;
 
     inline AtomField() : name(), javaType(JAVA_TYPE_UNKNOWN_OR_INVALID) {
     }
@@ -167,7 +171,8 @@ struct AtomField {
         : name(that.name),
           javaType(that.javaType),
           enumValues(that.enumValues),
-          enumTypeName(that.enumTypeName) {
+          enumTypeName(that.enumTypeName),
+          enumFullTypeName(that.enumFullTypeName) {
     }
 
     inline AtomField(string n, java_type_t jt) : name(n), javaType(jt) {
@@ -229,6 +234,21 @@ struct Atoms {
 int collate_atoms(const Descriptor& descriptor, const string& moduleName, Atoms& atoms);
 int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>& signature);
 
+/**
+ * The values of the enum types collated so far, shared by all the fields of each type.
+ */
+using EnumValuesByType = map<const EnumDescriptor*, shared_ptr<const map<int, string>>>;
+
+int collate_atom(const Descriptor& atom, AtomDecl& atomDecl, vector<java_type_t>& signature,
+                 EnumValuesByType& enumValuesByType);
+
+/**
+ * Gather the information about the atoms of each of the modules, collating each atom once.
+ * Returns the number of errors.
+ */
+int collate_atoms(const Descriptor& descriptor, const set<string>& moduleNames,
+                  map<string, Atoms>& moduleAtoms);
+
 }  // namespace stats_log_api_gen
 }  // namespace android
 
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <test_buffer_atoms.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+namespace android {
+namespace api_gen_benchmarks {
+
+using namespace android::BufferAtoms;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// The events that reached the consumer, and the value of the last one.
+std::atomic<int64_t> sReadCount(0);
+std::atomic<int32_t> sLastValue(-1);
+std::atomic<bool> sOutOfOrder(false);
+
+// Records the last field of the event, which the benchmarks write as an int32.
+int count_event(const uint8_t* buffer, size_t size, uint32_t) {
+    int32_t value;
+    memcpy(&value, buffer + size - sizeof(value), sizeof(value));
+    if (value != sLastValue.load(std::memory_order_relaxed) + 1) {
+        sOutOfOrder.store(true, std::memory_order_relaxed);
+    }
+    sLastValue.store(value, std::memory_order_relaxed);
+    sReadCount.fetch_add(1, std::memory_order_release);
+    return size;
+}
+
+void reset_count() {
+    sReadCount.store(0, std::memory_order_relaxed);
+    sLastValue.store(-1, std::memory_order_relaxed);
+    sOutOfOrder.store(false, std::memory_order_relaxed);
+}
+
+// Binds a unix datagram socket at path.
+int bind_socket(const fs::path& path) {
+    fs::remove(path);
+    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Writes the events until the consumer has read all of them. The writer retries while the
+// transport is full, so that every event is delivered.
+void write_events(benchmark::State& state) {
+    int32_t value = 0;
+    for (auto _ : state) {
+        while (stats_write(SCREEN_BRIGHTNESS_CHANGED, value) < 0) {
+            std::this_thread::yield();
+        }
+        value++;
+    }
+    while (sReadCount.load(std::memory_order_acquire) < value) {
+        std::this_thread::yield();
+    }
+    state.SetItemsProcessed(value);
+    if (sOutOfOrder.load(std::memory_order_relaxed)) {
+        state.SkipWithError("events arrived out of order");
+    }
+}
+
+// The datagram socket that the socket sink sends to.
+int sSocketSinkFd = -1;
+
+int send_event(const uint8_t* buffer, size_t size, uint32_t) {
+    const ssize_t ret = send(sSocketSinkFd, buffer, size, MSG_DONTWAIT);
+    return ret < 0 ? -errno : ret;
+}
+
+}  // namespace
+
+/**
+ * Measures the writes through the shared memory ring, read by a StatsEventRingReader on another
+ * thread.
+ */
+void BM_RingTransport(benchmark::State& state) {
+    const fs::path path = fs::temp_directory_path() / "benchmark_ring_transport";
+    const int socketFd = bind_socket(path);
+    if (socketFd < 0) {
+        state.SkipWithError("cannot bind the socket");
+        return;
+    }
+    StatsEventRingReader reader;
+    if (useStatsEventRing(path.c_str()) != 0 || reader.receive(socketFd) != 0) {
+        state.SkipWithError("cannot set up the ring");
+        close(socketFd);
+        return;
+    }
+    reset_count();
+    std::atomic<bool> done(false);
+    std::thread consumer([&reader, &done] {
+        while (!done.load(std::memory_order_acquire)) {
+            if (reader.wait(10)) {
+                reader.read(&count_event);
+            }
+        }
+    });
+
+    write_events(state);
+
+    done.store(true, std::memory_order_release);
+    consumer.join();
+    close(socketFd);
+    fs::remove(path);
+}
+BENCHMARK(BM_RingTransport);
+
+/**
+ * Measures the writes of one datagram per event through a unix socket, read on another thread,
+ * which stands in for the socket of statsd.
+ */
+void BM_DatagramTransport(benchmark::State& state) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        state.SkipWithError("cannot create the sockets");
+        return;
+    }
+    sSocketSinkFd = fds[0];
+    setStatsEventSink(&send_event);
+    reset_count();
+    std::atomic<bool> done(false);
+    const int readFd = fds[1];
+    std::thread consumer([readFd, &done] {
+        uint8_t buffer[4096];
+        while (!done.load(std::memory_order_acquire)) {
+            const ssize_t size = recv(readFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (size > 0) {
+                count_event(buffer, size, 0);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    write_events(state);
+
+    done.store(true, std::memory_order_release);
+    consumer.join();
+    close(fds[0]);
+    close(fds[1]);
+}
+BENCHMARK(BM_DatagramTransport);
+
+}  // namespace api_gen_benchmarks
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decoder_writer.h"
+
+#include <set>
+
+#include "Collation.h"
+#include "utils.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+// Returns the type of the struct member that holds a decoded field, or nullptr if the field type
+// cannot be decoded.
+static const char* get_decoder_member_type(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_ATTRIBUTION_CHAIN:
+            return "StatsEventAttributionChainView";
+        case JAVA_TYPE_BOOLEAN:
+            return "bool";
+        case JAVA_TYPE_INT:
+        case JAVA_TYPE_ENUM:
+            return "int32_t";
+        case JAVA_TYPE_LONG:
+            return "int64_t";
+        case JAVA_TYPE_FLOAT:
+            return "float";
+        case JAVA_TYPE_STRING:
+            return "std::string_view";
+        case JAVA_TYPE_BYTE_ARRAY:
+            return "StatsEventArrayView<uint8_t>";
+        case JAVA_TYPE_BOOLEAN_ARRAY:
+            return "StatsEventArrayView<bool>";
+        case JAVA_TYPE_INT_ARRAY:
+        case JAVA_TYPE_ENUM_ARRAY:
+            return "StatsEventArrayView<int32_t>";
+        case JAVA_TYPE_LONG_ARRAY:
+            return "StatsEventArrayView<int64_t>";
+        case JAVA_TYPE_FLOAT_ARRAY:
+            return "StatsEventArrayView<float>";
+        case JAVA_TYPE_STRING_ARRAY:
+            return "StatsEventStringArrayView";
+        default:
+            return nullptr;
+    }
+}
+
+static const char* get_decoder_read_method(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_ATTRIBUTION_CHAIN:
+            return "readAttributionChain";
+        case JAVA_TYPE_BOOLEAN:
+            return "readBool";
+        case JAVA_TYPE_INT:
+        case JAVA_TYPE_ENUM:
+            return "readInt32";
+        case JAVA_TYPE_LONG:
+            return "readInt64";
+        case JAVA_TYPE_FLOAT:
+            return "readFloat";
+        case JAVA_TYPE_STRING:
+            return "readString";
+        case JAVA_TYPE_BYTE_ARRAY:
+            return "readByteArray";
+        case JAVA_TYPE_STRING_ARRAY:
+            return "readStringArray";
+        default:
+            return "readArray";
+    }
+}
+
+// Field names that are C++ keywords get a trailing underscore.
+static string get_decoder_member_name(const string& fieldName) {
+    static const std::set<string> keywords = {
+            "alignas",  "alignof",  "and",       "asm",      "auto",      "bool",
+            "break",    "case",     "catch",     "char",     "class",     "const",
+            "continue", "default",  "delete",    "do",       "double",    "else",
+            "enum",     "explicit", "export",    "extern",   "false",     "float",
+            "for",      "friend",   "goto",      "if",       "inline",    "int",
+            "long",     "mutable",  "namespace", "new",      "not",       "operator",
+            "or",       "private",  "protected", "public",   "register",  "return",
+            "short",    "signed",   "sizeof",    "static",   "struct",    "switch",
+            "template", "this",     "throw",     "true",     "try",       "typedef",
+            "typename", "union",    "unsigned",  "using",    "virtual",   "void",
+            "volatile", "while",    "xor"};
+    return keywords.count(fieldName) ? fieldName + "_" : fieldName;
+}
+
+static void write_decoder_views(FILE* out) {
+    fprintf(out, "/**\n");
+    fprintf(out,
+            " * A view of the fixed width elements of a repeated field, or of the bytes of a byte "
+            "array field,\n");
+    fprintf(out, " * pointing into the decoded event.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "template <typename T>\n");
+    fprintf(out, "struct StatsEventArrayView {\n");
+    fprintf(out, "    const uint8_t* data = nullptr;\n");
+    fprintf(out, "    size_t size = 0;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    T operator[](size_t i) const {\n");
+    fprintf(out, "        if constexpr (std::is_same_v<T, bool>) {\n");
+    fprintf(out, "            return data[i] != 0;\n");
+    fprintf(out, "        } else {\n");
+    fprintf(out, "            T value;\n");
+    fprintf(out, "            memcpy(&value, data + i * sizeof(T), sizeof(T));\n");
+    fprintf(out, "            return value;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "/**\n");
+    fprintf(out,
+            " * A view of the elements of a repeated string field, pointing into the decoded "
+            "event.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "struct StatsEventStringArrayView {\n");
+    fprintf(out, "    const uint8_t* data = nullptr;\n");
+    fprintf(out, "    size_t size = 0;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Calls visitor with each string of the field in turn.\n");
+    fprintf(out, "    template <typename Visitor>\n");
+    fprintf(out, "    void forEach(Visitor&& visitor) const {\n");
+    fprintf(out, "        const uint8_t* element = data;\n");
+    fprintf(out, "        for (size_t i = 0; i < size; i++) {\n");
+    fprintf(out, "            int32_t length;\n");
+    fprintf(out, "            memcpy(&length, element, sizeof(length));\n");
+    fprintf(out, "            element += sizeof(length);\n");
+    fprintf(out,
+            "            visitor(std::string_view(reinterpret_cast<const char*>(element), "
+            "length));\n");
+    fprintf(out, "            element += length;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "/**\n");
+    fprintf(out,
+            " * A view of the nodes of an attribution chain, pointing into the decoded event.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "struct StatsEventAttributionChainView {\n");
+    fprintf(out, "    const uint8_t* data = nullptr;\n");
+    fprintf(out, "    size_t size = 0;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Calls visitor with the uid and the tag of each node in turn.\n");
+    fprintf(out, "    template <typename Visitor>\n");
+    fprintf(out, "    void forEach(Visitor&& visitor) const {\n");
+    fprintf(out, "        const uint8_t* node = data;\n");
+    fprintf(out, "        for (size_t i = 0; i < size; i++) {\n");
+    fprintf(out, "            int32_t uid;\n");
+    fprintf(out, "            int32_t length;\n");
+    fprintf(out, "            memcpy(&uid, node, sizeof(uid));\n");
+    fprintf(out, "            memcpy(&length, node + sizeof(uid), sizeof(length));\n");
+    fprintf(out, "            node += sizeof(uid) + sizeof(length);\n");
+    fprintf(out,
+            "            visitor(uid, std::string_view(reinterpret_cast<const char*>(node), "
+            "length));\n");
+    fprintf(out, "            node += length;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "/**\n");
+    fprintf(out, " * The fields every StatsEvent starts with.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "struct StatsEventHeader {\n");
+    fprintf(out, "    // The number of fields after the header.\n");
+    fprintf(out, "    uint8_t numFields;\n");
+    fprintf(out, "    int64_t elapsedTimestampNs;\n");
+    fprintf(out, "    int32_t atomId;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+}
+
+static void write_decoder_reader(FILE* out) {
+    fprintf(out, "/**\n");
+    fprintf(out,
+            " * Walks the fields of a StatsEvent without copying them. Each read checks the type "
+            "of the next\n");
+    fprintf(out,
+            " * field and fails if the field has another type or does not fit in the event.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "class StatsEventReader {\n");
+    fprintf(out, "public:\n");
+    fprintf(out,
+            "    // Type ids of the StatsEvent wire format. The varint types are only written by "
+            "the compact\n");
+    fprintf(out, "    // encoding of the generated buffer encoder.\n");
+    fprintf(out, "    static constexpr uint8_t INT32_TYPE = 0x00;\n");
+    fprintf(out, "    static constexpr uint8_t INT64_TYPE = 0x01;\n");
+    fprintf(out, "    static constexpr uint8_t STRING_TYPE = 0x02;\n");
+    fprintf(out, "    static constexpr uint8_t LIST_TYPE = 0x03;\n");
+    fprintf(out, "    static constexpr uint8_t FLOAT_TYPE = 0x04;\n");
+    fprintf(out, "    static constexpr uint8_t BOOL_TYPE = 0x05;\n");
+    fprintf(out, "    static constexpr uint8_t BYTE_ARRAY_TYPE = 0x06;\n");
+    fprintf(out, "    static constexpr uint8_t OBJECT_TYPE = 0x07;\n");
+    fprintf(out, "    static constexpr uint8_t ATTRIBUTION_CHAIN_TYPE = 0x09;\n");
+    fprintf(out, "    static constexpr uint8_t VARINT32_TYPE = 0x0A;\n");
+    fprintf(out, "    static constexpr uint8_t VARINT64_TYPE = 0x0B;\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "    StatsEventReader(const uint8_t* event, size_t size) : mEvent(event), mSize(size) "
+            "{\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readHeader(StatsEventHeader* header) {\n");
+    fprintf(out,
+            "        if (mSize < 2 || (mEvent[0] & 0x0f) != OBJECT_TYPE || mEvent[1] < 2) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        header->numFields = mEvent[1] - 2;\n");
+    fprintf(out, "        mPos = 2;\n");
+    fprintf(out,
+            "        return readInt64(&header->elapsedTimestampNs) && "
+            "readInt32(&header->atomId);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readBool(bool* value) {\n");
+    fprintf(out, "        uint8_t byte;\n");
+    fprintf(out, "        if (!readType(BOOL_TYPE) || !readFixed(&byte)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        *value = byte != 0;\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readInt32(int32_t* value) {\n");
+    fprintf(out, "        return readInteger(INT32_TYPE, VARINT32_TYPE, value);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readInt64(int64_t* value) {\n");
+    fprintf(out, "        return readInteger(INT64_TYPE, VARINT64_TYPE, value);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readFloat(float* value) {\n");
+    fprintf(out, "        return readType(FLOAT_TYPE) && readFixed(value) && skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readString(std::string_view* value) {\n");
+    fprintf(out, "        const uint8_t* data;\n");
+    fprintf(out, "        size_t length;\n");
+    fprintf(out, "        if (!readType(STRING_TYPE) || !readLengthPrefixed(&data, &length)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out,
+            "        *value = std::string_view(reinterpret_cast<const char*>(data), length);\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readByteArray(StatsEventArrayView<uint8_t>* value) {\n");
+    fprintf(out,
+            "        return readType(BYTE_ARRAY_TYPE) && readLengthPrefixed(&value->data, "
+            "&value->size) &&\n");
+    fprintf(out, "               skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    template <typename T>\n");
+    fprintf(out, "    bool readArray(StatsEventArrayView<T>* value) {\n");
+    fprintf(out,
+            "        constexpr uint8_t elementType = std::is_same_v<T, bool>      ? BOOL_TYPE\n");
+    fprintf(out,
+            "                                        : std::is_same_v<T, int64_t> ? INT64_TYPE\n");
+    fprintf(out,
+            "                                        : std::is_same_v<T, float>   ? FLOAT_TYPE\n");
+    fprintf(out,
+            "                                                                     : INT32_TYPE;\n");
+    fprintf(out, "        if (!readListHeader(elementType, &value->size) ||\n");
+    fprintf(out, "            value->size > (mSize - mPos) / sizeof(T)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        value->data = mEvent + mPos;\n");
+    fprintf(out, "        mPos += value->size * sizeof(T);\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readStringArray(StatsEventStringArrayView* value) {\n");
+    fprintf(out, "        if (!readListHeader(STRING_TYPE, &value->size)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        value->data = mEvent + mPos;\n");
+    fprintf(out, "        for (size_t i = 0; i < value->size; i++) {\n");
+    fprintf(out, "            const uint8_t* data;\n");
+    fprintf(out, "            size_t length;\n");
+    fprintf(out, "            if (!readLengthPrefixed(&data, &length)) {\n");
+    fprintf(out, "                return false;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readAttributionChain(StatsEventAttributionChainView* value) {\n");
+    fprintf(out, "        if (!readType(ATTRIBUTION_CHAIN_TYPE) || mPos >= mSize) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        value->size = mEvent[mPos++];\n");
+    fprintf(out, "        value->data = mEvent + mPos;\n");
+    fprintf(out, "        for (size_t i = 0; i < value->size; i++) {\n");
+    fprintf(out, "            int32_t uid;\n");
+    fprintf(out, "            const uint8_t* tag;\n");
+    fprintf(out, "            size_t length;\n");
+    fprintf(out, "            if (!readFixed(&uid) || !readLengthPrefixed(&tag, &length)) {\n");
+    fprintf(out, "                return false;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Returns true once the whole event was read.\n");
+    fprintf(out, "    bool done() const {\n");
+    fprintf(out, "        return mPos == mSize;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "private:\n");
+    fprintf(out, "    const uint8_t* mEvent;\n");
+    fprintf(out, "    size_t mSize;\n");
+    fprintf(out, "    size_t mPos = 0;\n");
+    fprintf(out, "    // The number of annotations after the value of the current field.\n");
+    fprintf(out, "    uint8_t mAnnotations = 0;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readType(uint8_t typeId) {\n");
+    fprintf(out, "        if (mPos >= mSize || (mEvent[mPos] & 0x0f) != typeId) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        mAnnotations = mEvent[mPos++] >> 4;\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    template <typename T>\n");
+    fprintf(out, "    bool readFixed(T* value) {\n");
+    fprintf(out, "        if (mSize - mPos < sizeof(T)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        memcpy(value, mEvent + mPos, sizeof(T));\n");
+    fprintf(out, "        mPos += sizeof(T);\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    template <typename T>\n");
+    fprintf(out, "    bool readInteger(uint8_t typeId, uint8_t varintTypeId, T* value) {\n");
+    fprintf(out, "        if (readType(typeId)) {\n");
+    fprintf(out, "            return readFixed(value) && skipAnnotations();\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        uint64_t zigzag = 0;\n");
+    fprintf(out, "        if (!readType(varintTypeId)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        for (int shift = 0;; shift += 7) {\n");
+    fprintf(out, "            if (shift >= 64 || mPos >= mSize) {\n");
+    fprintf(out, "                return false;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            const uint8_t byte = mEvent[mPos++];\n");
+    fprintf(out, "            zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;\n");
+    fprintf(out, "            if ((byte & 0x80) == 0) {\n");
+    fprintf(out, "                break;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        *value = static_cast<T>(static_cast<int64_t>(zigzag >> 1) ^\n");
+    fprintf(out, "                                -static_cast<int64_t>(zigzag & 1));\n");
+    fprintf(out, "        return skipAnnotations();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readLengthPrefixed(const uint8_t** data, size_t* length) {\n");
+    fprintf(out, "        int32_t value;\n");
+    fprintf(out,
+            "        if (!readFixed(&value) || value < 0 || mSize - mPos < "
+            "static_cast<size_t>(value)) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        *data = mEvent + mPos;\n");
+    fprintf(out, "        *length = value;\n");
+    fprintf(out, "        mPos += value;\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    bool readListHeader(uint8_t elementType, size_t* count) {\n");
+    fprintf(out,
+            "        if (!readType(LIST_TYPE) || mSize - mPos < 2 || mEvent[mPos + 1] != "
+            "elementType) {\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        *count = mEvent[mPos];\n");
+    fprintf(out, "        mPos += 2;\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Each annotation is an id, a type id and a bool or int32 value.\n");
+    fprintf(out, "    bool skipAnnotations() {\n");
+    fprintf(out, "        for (uint8_t i = 0; i < mAnnotations; i++) {\n");
+    fprintf(out, "            if (mSize - mPos < 2) {\n");
+    fprintf(out, "                return false;\n");
+    fprintf(out, "            }\n");
+    fprintf(out,
+            "            const size_t valueSize = mEvent[mPos + 1] == BOOL_TYPE ? 1 : "
+            "sizeof(int32_t);\n");
+    fprintf(out, "            mPos += 2;\n");
+    fprintf(out, "            if (mSize - mPos < valueSize) {\n");
+    fprintf(out, "                return false;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            mPos += valueSize;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        mAnnotations = 0;\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+}
+
+static int write_decoder_atom(FILE* out, const AtomDecl& atomDecl) {
+    for (const AtomField& field : atomDecl.fields) {
+        if (get_decoder_member_type(field.javaType) == nullptr) {
+            fprintf(stderr, "Cannot decode field %s of atom %s\n", field.name.c_str(),
+                    atomDecl.name.c_str());
+            return 1;
+        }
+    }
+
+    const string structName = make_camel_case_name(atomDecl.name);
+    fprintf(out, "struct %s {\n", structName.c_str());
+    fprintf(out, "    static constexpr int32_t ATOM_ID = %d;\n", atomDecl.code);
+    fprintf(out, "\n");
+    fprintf(out, "    int64_t elapsedTimestampNs;\n");
+    for (const AtomField& field : atomDecl.fields) {
+        fprintf(out, "    %s %s;\n", get_decoder_member_type(field.javaType),
+                get_decoder_member_name(field.name).c_str());
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+
+    fprintf(out,
+            "inline bool decodeStatsEventFields(StatsEventReader* reader, uint8_t numFields,\n");
+    fprintf(out, "                                   %s* %s) {\n", structName.c_str(),
+            atomDecl.fields.empty() ? "/* atom */" : "atom");
+    fprintf(out, "    return numFields == %zu &&\n", atomDecl.fields.size());
+    for (const AtomField& field : atomDecl.fields) {
+        fprintf(out, "           reader->%s(&atom->%s) &&\n",
+                get_decoder_read_method(field.javaType),
+                get_decoder_member_name(field.name).c_str());
+    }
+    fprintf(out, "           reader->done();\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    return 0;
+}
+
+static void write_decoder_dispatch(FILE* out, const Atoms& atoms) {
+    fprintf(out,
+            "// Decodes an event of any atom of this file and calls visitor with the struct of its "
+            "atom.\n");
+    fprintf(out,
+            "// Returns false if the event is malformed or belongs to no atom of this file. The "
+            "views of the\n");
+    fprintf(out, "// struct point into the event.\n");
+    fprintf(out, "template <typename Visitor>\n");
+    fprintf(out, "bool visitStatsEvent(const uint8_t* event, size_t size, Visitor&& visitor) {\n");
+    fprintf(out, "    StatsEventReader reader(event, size);\n");
+    fprintf(out, "    StatsEventHeader header;\n");
+    fprintf(out, "    if (!reader.readHeader(&header)) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    switch (header.atomId) {\n");
+    for (AtomDeclSet::const_iterator atomIt = atoms.decls.begin(); atomIt != atoms.decls.end();
+         atomIt++) {
+        const string structName = make_camel_case_name((*atomIt)->name);
+        fprintf(out, "        case %s::ATOM_ID:\n", structName.c_str());
+        fprintf(out, "            return visitStatsEventFields<%s>(&reader, header, visitor);\n",
+                structName.c_str());
+    }
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+int write_stats_log_decoder(FILE* out, const Atoms& atoms, const string& cppNamespace) {
+    int errorCount = 0;
+
+    fprintf(out, "// This file is autogenerated\n");
+    fprintf(out, "\n");
+    fprintf(out, "#pragma once\n");
+    fprintf(out, "\n");
+    fprintf(out, "#include <stdint.h>\n");
+    fprintf(out, "#include <string.h>\n");
+    fprintf(out, "\n");
+    fprintf(out, "#include <string_view>\n");
+    fprintf(out, "#include <type_traits>\n");
+    fprintf(out, "\n");
+
+    write_namespace(out, cppNamespace);
+    fprintf(out, "\n");
+    fprintf(out, "/*\n");
+    fprintf(out, " * Decoders of the StatsEvents of each atom into a struct of its fields.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "\n");
+
+    write_decoder_views(out);
+    write_decoder_reader(out);
+
+    for (AtomDeclSet::const_iterator atomIt = atoms.decls.begin(); atomIt != atoms.decls.end();
+         atomIt++) {
+        errorCount += write_decoder_atom(out, **atomIt);
+    }
+
+    fprintf(out,
+            "// Decodes an event of the atom of the struct Atom. Returns false if the event is "
+            "malformed or\n");
+    fprintf(out, "// belongs to another atom. The views of the struct point into the event.\n");
+    fprintf(out, "template <typename Atom>\n");
+    fprintf(out, "bool decodeStatsEvent(const uint8_t* event, size_t size, Atom* atom) {\n");
+    fprintf(out, "    StatsEventReader reader(event, size);\n");
+    fprintf(out, "    StatsEventHeader header;\n");
+    fprintf(out, "    if (!reader.readHeader(&header) || header.atomId != Atom::ATOM_ID) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    atom->elapsedTimestampNs = header.elapsedTimestampNs;\n");
+    fprintf(out, "    return decodeStatsEventFields(&reader, header.numFields, atom);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "template <typename Atom, typename Visitor>\n");
+    fprintf(out,
+            "bool visitStatsEventFields(StatsEventReader* reader, const StatsEventHeader& "
+            "header,\n");
+    fprintf(out, "                           Visitor& visitor) {\n");
+    fprintf(out, "    Atom atom;\n");
+    fprintf(out, "    atom.elapsedTimestampNs = header.elapsedTimestampNs;\n");
+    fprintf(out, "    if (!decodeStatsEventFields(reader, header.numFields, &atom)) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    visitor(static_cast<const Atom&>(atom));\n");
+    fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    write_decoder_dispatch(out, atoms);
+
+    write_closing_namespace(out, cppNamespace);
+
+    return errorCount;
+}
+
+}  // namespace stats_log_api_gen
+}  // namespace android
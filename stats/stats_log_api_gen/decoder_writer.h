@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#include "Collation.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+// Writes a header with a struct per atom and the functions that decode StatsEvents into them
+// without copying their strings and arrays.
+int write_stats_log_decoder(FILE* out, const Atoms& atoms, const string& cppNamespace);
+
+}  // namespace stats_log_api_gen
+}  // namespace android
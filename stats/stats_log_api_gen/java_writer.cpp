@@ -67,6 +67,185 @@ static void write_java_annotation_constants(FILE* out, const int minApiLevel,
     fprintf(out, "\n");
 }
 
+// The names each generated fill method puts in its table, which keeps the methods well below the
+// 64k bytecode limit of the JVM.
+static const size_t JAVA_NAMES_PER_METHOD = 1000;
+
+static size_t get_java_fill_method_count(const NameHashTable& table) {
+    return (table.names.size() + JAVA_NAMES_PER_METHOD - 1) / JAVA_NAMES_PER_METHOD;
+}
+
+static void write_java_name_hash_table_fill_methods(FILE* out, const string& kind,
+                                                    const NameHashTable& table) {
+    for (size_t method = 0; method < get_java_fill_method_count(table); method++) {
+        fprintf(out, "\n");
+        fprintf(out, "        private static void put%ss%zu() {\n", kind.c_str(), method);
+        const size_t end = std::min(table.names.size(), (method + 1) * JAVA_NAMES_PER_METHOD);
+        for (size_t i = method * JAVA_NAMES_PER_METHOD; i < end; i++) {
+            fprintf(out, "            put%s(%zu, %d, \"%s\", %d);\n", kind.c_str(), i,
+                    table.seeds[i], table.names[i].c_str(), table.values[i]);
+        }
+        fprintf(out, "        }\n");
+    }
+}
+
+// Writes getAtomCode() and getEnumValue(), which look the names up in minimal perfect hash
+// tables built by build_name_hash_table().
+static void write_java_name_lookup(FILE* out, const Atoms& atoms) {
+    const NameHashTable atomNames = build_name_hash_table(get_atom_name_codes(atoms));
+    const NameHashTable enumNames = build_name_hash_table(get_enum_name_values(atoms));
+
+    fprintf(out, "    // Holds the name hash tables, so that the first lookup fills them.\n");
+    fprintf(out, "    private static final class NameHashTables {\n");
+    fprintf(out, "        static final int[] ATOM_NAME_SEEDS = new int[%zu];\n",
+            atomNames.names.size());
+    fprintf(out, "        static final String[] ATOM_NAMES = new String[%zu];\n",
+            atomNames.names.size());
+    fprintf(out, "        static final int[] ATOM_NAME_CODES = new int[%zu];\n",
+            atomNames.names.size());
+    fprintf(out, "        static final int[] ENUM_NAME_SEEDS = new int[%zu];\n",
+            enumNames.names.size());
+    fprintf(out, "        static final String[] ENUM_NAMES = new String[%zu];\n",
+            enumNames.names.size());
+    fprintf(out, "        static final int[] ENUM_NAME_VALUES = new int[%zu];\n",
+            enumNames.names.size());
+    fprintf(out, "\n");
+    fprintf(out, "        static {\n");
+    for (size_t method = 0; method < get_java_fill_method_count(atomNames); method++) {
+        fprintf(out, "            putAtomNames%zu();\n", method);
+    }
+    for (size_t method = 0; method < get_java_fill_method_count(enumNames); method++) {
+        fprintf(out, "            putEnumNames%zu();\n", method);
+    }
+    fprintf(out, "        }\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "        private static void putAtomName(int slot, int seed, String name, int code) "
+            "{\n");
+    fprintf(out, "            ATOM_NAME_SEEDS[slot] = seed;\n");
+    fprintf(out, "            ATOM_NAMES[slot] = name;\n");
+    fprintf(out, "            ATOM_NAME_CODES[slot] = code;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "        private static void putEnumName(int slot, int seed, String name, int value) "
+            "{\n");
+    fprintf(out, "            ENUM_NAME_SEEDS[slot] = seed;\n");
+    fprintf(out, "            ENUM_NAMES[slot] = name;\n");
+    fprintf(out, "            ENUM_NAME_VALUES[slot] = value;\n");
+    fprintf(out, "        }\n");
+    write_java_name_hash_table_fill_methods(out, "AtomName", atomNames);
+    write_java_name_hash_table_fill_methods(out, "EnumName", enumNames);
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    private static int nameHash(String name, int seed) {\n");
+    fprintf(out, "        int hash = 0x%08x ^ seed;\n", NAME_HASH_OFFSET_BASIS);
+    fprintf(out, "        for (int i = 0; i < name.length(); i++) {\n");
+    fprintf(out, "            hash = (hash ^ name.charAt(i)) * 0x%08x;\n", NAME_HASH_PRIME);
+    fprintf(out, "        }\n");
+    fprintf(out, "        hash ^= hash >>> 16;\n");
+    fprintf(out, "        hash *= 0x%08x;\n", NAME_HASH_MIX);
+    fprintf(out, "        hash ^= hash >>> 15;\n");
+    fprintf(out, "        return hash;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Returns the slot of the name in a minimal perfect hash table, or -1.\n");
+    fprintf(out, "    private static int findName(int[] seeds, String[] names, String name) {\n");
+    fprintf(out, "        if (names.length == 0) {\n");
+    fprintf(out, "            return -1;\n");
+    fprintf(out, "        }\n");
+    fprintf(out,
+            "        final int seed = seeds[Integer.remainderUnsigned(nameHash(name, 0), "
+            "names.length)];\n");
+    fprintf(out, "        final int slot = seed < 0 ? -seed - 1\n");
+    fprintf(out,
+            "                : Integer.remainderUnsigned(nameHash(name, seed), names.length);\n");
+    fprintf(out, "        return names[slot].equals(name) ? slot : -1;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    /**\n");
+    fprintf(out, "     * Returns the code of the atom with this constant name, such as\n");
+    fprintf(out, "     * \"BLE_SCAN_STATE_CHANGED\", or -1 if there is none.\n");
+    fprintf(out, "     */\n");
+    fprintf(out, "    public static int getAtomCode(String name) {\n");
+    fprintf(out,
+            "        final int slot = findName(NameHashTables.ATOM_NAME_SEEDS, "
+            "NameHashTables.ATOM_NAMES, name);\n");
+    fprintf(out, "        return slot < 0 ? -1 : NameHashTables.ATOM_NAME_CODES[slot];\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    /**\n");
+    fprintf(out, "     * Returns the enum value with this constant name, such as\n");
+    fprintf(out, "     * \"BLE_SCAN_STATE_CHANGED__STATE__ON\", or defaultValue if there is\n");
+    fprintf(out, "     * none.\n");
+    fprintf(out, "     */\n");
+    fprintf(out, "    public static int getEnumValue(String name, int defaultValue) {\n");
+    fprintf(out,
+            "        final int slot = findName(NameHashTables.ENUM_NAME_SEEDS, "
+            "NameHashTables.ENUM_NAMES, name);\n");
+    fprintf(out,
+            "        return slot < 0 ? defaultValue : NameHashTables.ENUM_NAME_VALUES[slot];\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+}
+
+static void write_java_atom_enable_bitmap(FILE* out, const Atoms& atoms) {
+    const map<int, int> atomIndices = get_pushed_atom_indices(atoms);
+    const size_t wordCount = std::max<size_t>(1, (atomIndices.size() + 31) / 32);
+
+    fprintf(out, "    // One bit per pushed atom. All atoms start out enabled. The words are\n");
+    fprintf(out, "    // atomic, so that writers on other threads see the updates.\n");
+    fprintf(out,
+            "    private static final AtomicIntegerArray sAtomEnableBitmap = new "
+            "AtomicIntegerArray(\n");
+    fprintf(out, "            new int[] {");
+    for (size_t i = 0; i < wordCount; i++) {
+        fprintf(out, "%s-1", i == 0 ? "" : ", ");
+    }
+    fprintf(out, "});\n");
+    fprintf(out, "\n");
+    fprintf(out, "    private static int getAtomIndex(int code) {\n");
+    fprintf(out, "        switch (code) {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        const auto atomIndexIt = atomIndices.find(atomDecl->code);
+        if (atomDecl->atomType == ATOM_TYPE_PUSHED && atomIndexIt != atomIndices.end()) {
+            fprintf(out, "            case %s:\n", make_constant_name(atomDecl->name).c_str());
+            fprintf(out, "                return %d;\n", atomIndexIt->second);
+        }
+    }
+    fprintf(out, "            default:\n");
+    fprintf(out, "                return -1;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    /**\n");
+    fprintf(out, "     * Enables or disables the logging of the pushed atom with this code.\n");
+    fprintf(out, "     * Write methods of a disabled atom return without building the event.\n");
+    fprintf(out, "     */\n");
+    fprintf(out, "    public static void setAtomEnabled(int code, boolean enabled) {\n");
+    fprintf(out, "        final int index = getAtomIndex(code);\n");
+    fprintf(out, "        if (index < 0) {\n");
+    fprintf(out, "            return;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        final int word = index >> 5;\n");
+    fprintf(out, "        final int bit = 1 << index;\n");
+    fprintf(out, "        int bits;\n");
+    fprintf(out, "        do {\n");
+    fprintf(out, "            bits = sAtomEnableBitmap.get(word);\n");
+    fprintf(out,
+            "        } while (!sAtomEnableBitmap.compareAndSet(word, bits, enabled ? bits | bit : "
+            "bits & ~bit));\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    public static boolean isAtomEnabled(int code) {\n");
+    fprintf(out, "        final int index = getAtomIndex(code);\n");
+    fprintf(out,
+            "        return index < 0 || (sAtomEnableBitmap.get(index >> 5) & (1 << index)) != "
+            "0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+}
+
 static void write_annotations(FILE* out, int argIndex,
                               const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet) {
     FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
@@ -222,7 +401,8 @@ static int write_method_body(FILE* out, const vector<java_type_t>& signature,
 }
 
 static int write_java_pushed_methods(FILE* out, const SignatureInfoMap& signatureInfoMap,
-                                     const AtomDecl& attributionDecl, const int minApiLevel) {
+                                     const AtomDecl& attributionDecl, const int minApiLevel,
+                                     const bool atomEnableBitmap) {
     for (auto signatureInfoMapIt = signatureInfoMap.begin();
          signatureInfoMapIt != signatureInfoMap.end(); signatureInfoMapIt++) {
         const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet = signatureInfoMapIt->second;
@@ -241,6 +421,11 @@ static int write_java_pushed_methods(FILE* out, const SignatureInfoMap& signatur
         fprintf(out, ") {\n");
 
         // Print method body.
+        if (atomEnableBitmap) {
+            fprintf(out, "        if (!isAtomEnabled(code)) {\n");
+            fprintf(out, "            return;\n");
+            fprintf(out, "        }\n");
+        }
         string indent("");
         if (minApiLevel == API_Q) {
             fprintf(out, "        if (Build.VERSION.SDK_INT > %s) {\n",
@@ -321,7 +506,8 @@ static int write_java_pulled_methods(FILE* out, const SignatureInfoMap& signatur
 
 int write_stats_log_java(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
                          const string& javaClass, const string& javaPackage, const int minApiLevel,
-                         const int compileApiLevel, const bool supportWorkSource) {
+                         const int compileApiLevel, const bool supportWorkSource,
+                         const bool atomEnableBitmap, const bool nameLookup) {
     // Print prelude
     fprintf(out, "// This file is autogenerated\n");
     fprintf(out, "\n");
@@ -338,6 +524,10 @@ int write_stats_log_java(FILE* out, const Atoms& atoms, const AtomDecl& attribut
     if (requires_api_needed(atoms.decls)) {
         fprintf(out, "import androidx.annotation.RequiresApi;\n");
     }
+    if (atomEnableBitmap) {
+        fprintf(out, "\n");
+        fprintf(out, "import java.util.concurrent.atomic.AtomicIntegerArray;\n");
+    }
 
     fprintf(out, "\n");
     fprintf(out, "\n");
@@ -349,12 +539,19 @@ int write_stats_log_java(FILE* out, const Atoms& atoms, const AtomDecl& attribut
     write_java_atom_codes(out, atoms);
     write_java_enum_values(out, atoms);
     write_java_annotation_constants(out, minApiLevel, compileApiLevel);
+    if (atomEnableBitmap) {
+        write_java_atom_enable_bitmap(out, atoms);
+    }
+    if (nameLookup) {
+        write_java_name_lookup(out, atoms);
+    }
 
     int errors = 0;
 
     // Print write methods.
     fprintf(out, "    // Write methods\n");
-    errors += write_java_pushed_methods(out, atoms.signatureInfoMap, attributionDecl, minApiLevel);
+    errors += write_java_pushed_methods(out, atoms.signatureInfoMap, attributionDecl, minApiLevel,
+                                        atomEnableBitmap);
     errors += write_java_non_chained_methods(out, atoms.nonChainedSignatureInfoMap);
     errors += write_java_pulled_methods(out, atoms.pulledAtomsSignatureInfoMap, attributionDecl,
                                         minApiLevel);
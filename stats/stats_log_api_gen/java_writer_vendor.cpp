@@ -348,8 +348,8 @@ static void write_java_enum_values_vendor(FILE* out, const Atoms& atoms) {
 
                 fprintf(out, "    // Values for %s.%s\n", (*atomIt)->message.c_str(),
                         field->name.c_str());
-                for (map<int, string>::const_iterator value = field->enumValues.begin();
-                     value != field->enumValues.end(); value++) {
+                for (map<int, string>::const_iterator value = field->enumValues->begin();
+                     value != field->enumValues->end(); value++) {
                     fprintf(out, "    public static final int %s__%s = %d;\n",
                             make_constant_name(full_enum_type_name).c_str(),
                             make_constant_name(value->second).c_str(), value->first);
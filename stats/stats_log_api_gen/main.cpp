@@ -6,11 +6,13 @@
 
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <map>
 #include <set>
 #include <vector>
 
 #include "Collation.h"
+#include "decoder_writer.h"
 #include "frameworks/proto_logging/stats/atoms.pb.h"
 #include "frameworks/proto_logging/stats/attribution_node.pb.h"
 #include "java_writer.h"
@@ -36,6 +38,7 @@ static void print_usage() {
     fprintf(stderr, "OPTIONS\n");
     fprintf(stderr, "  --cpp FILENAME       the cpp file to output for write helpers\n");
     fprintf(stderr, "  --header FILENAME    the header file to output for write helpers\n");
+    fprintf(stderr, "  --decoder FILENAME   the header file to output for typed event decoders\n");
     fprintf(stderr, "  --help               this message\n");
     fprintf(stderr, "  --java FILENAME      the java file to output\n");
     fprintf(stderr, "  --rust FILENAME      the rust file to output\n");
@@ -70,6 +73,112 @@ static void print_usage() {
     fprintf(stderr,
             "  --bootstrap          If this logging is from a bootstrap process. "
             "Only supported for cpp. Do not use unless necessary.\n");
+    fprintf(stderr,
+            "  --perAtomMethods     Generate one cpp write method per atom with its "
+            "annotations\n");
+    fprintf(stderr,
+            "                       resolved at generation time. The stats_write(code, ...) "
+            "methods\n");
+    fprintf(stderr, "                       forward to them.\n");
+    fprintf(stderr,
+            "  --templateApi        Add stats_write<ATOM>() templates and constexpr atom "
+            "traits to the\n");
+    fprintf(stderr, "                       header. Requires --perAtomMethods.\n");
+    fprintf(stderr,
+            "  --bufferEncoder      Encode pushed atoms into a stack or thread local buffer "
+            "instead of\n");
+    fprintf(stderr,
+            "                       an AStatsEvent, and hand it to a replaceable event "
+            "sink.\n");
+    fprintf(stderr,
+            "  --batchWriter        Add a StatsEventBatch class that sends many events "
+            "with one flush.\n");
+    fprintf(stderr, "                       Requires --bufferEncoder.\n");
+    fprintf(stderr,
+            "  --async              Queue the encoded events and send them from a background "
+            "thread.\n");
+    fprintf(stderr, "                       Requires --bufferEncoder.\n");
+    fprintf(stderr,
+            "  --spillFile          Keep the events the sink fails to deliver in a memory "
+            "mapped file and\n");
+    fprintf(stderr,
+            "                       replay them once it takes events again. Requires "
+            "--bufferEncoder.\n");
+    fprintf(stderr,
+            "  --ringTransport      Add useStatsEventRing(), which sends the encoded events "
+            "through a\n");
+    fprintf(stderr,
+            "                       ring in shared memory, and StatsEventRingReader. Requires "
+            "--bufferEncoder.\n");
+    fprintf(stderr,
+            "  --compactEncoding    Write small integer fields as varints, which are expanded "
+            "before the\n");
+    fprintf(stderr,
+            "                       events reach statsd. Requires --bufferEncoder.\n");
+    fprintf(stderr,
+            "  --compactAtoms NAMES Only use --compactEncoding for these comma separated "
+            "atoms.\n");
+    fprintf(stderr,
+            "  --atomEnableBitmap   Skip encoding pushed atoms that were disabled with "
+            "setAtomEnabled().\n");
+    fprintf(stderr, "                       Supported for cpp, java and rust.\n");
+    fprintf(stderr,
+            "  --stateDedup         Drop writes of non-nested state atoms that repeat the last "
+            "state of\n");
+    fprintf(stderr,
+            "                       their primary key. resetStateCaches() forgets the states. "
+            "Requires\n");
+    fprintf(stderr, "                       --perAtomMethods.\n");
+    fprintf(stderr,
+            "  --stringViewArgs     Add per-atom write methods that take strings and attribution "
+            "tags as\n");
+    fprintf(stderr,
+            "                       std::string_view and encode them without strlen. Requires\n");
+    fprintf(stderr, "                       --perAtomMethods and --bufferEncoder.\n");
+    fprintf(stderr,
+            "  --columnarPulledAtoms Add addAStatsEvents() methods that add many rows of a "
+            "pulled atom\n");
+    fprintf(stderr, "                       from one array per field.\n");
+    fprintf(stderr,
+            "  --pulledAtomSizes    Export the encoded size of the pulled atoms and "
+            "getPulledAtomsEncodedSize().\n");
+    fprintf(stderr,
+            "  --atomRegistry       Add a constexpr registry of the atoms, with a dense index "
+            "per atom and\n");
+    fprintf(stderr, "                       the types of their fields.\n");
+    fprintf(stderr,
+            "  --nameLookup         Add getAtomCode() and getEnumValue(), which look up atom "
+            "and enum value\n");
+    fprintf(stderr,
+            "                       names in minimal perfect hash tables. Supported for cpp, "
+            "java and rust.\n");
+    fprintf(stderr,
+            "  --enumNames          Add getEnumValueName(), which returns the name of a value "
+            "of an enum\n");
+    fprintf(stderr, "                       field of an atom.\n");
+    fprintf(stderr,
+            "  --sharedEnums        Define each enum type used by more than one field once, and "
+            "alias it\n");
+    fprintf(stderr,
+            "                       from the atoms of those fields. Supported for rust.\n");
+    fprintf(stderr,
+            "  --splitHeader        Write the declarations of the header to NAME_api.h, and the "
+            "atom and\n");
+    fprintf(stderr,
+            "                       enum value constants to NAME_atoms.h and NAME_enums.h, "
+            "for a header\n");
+    fprintf(stderr, "                       NAME.h that includes them.\n");
+    fprintf(stderr,
+            "  --cppShards N        Spread the methods of the cpp file NAME.cpp over it and "
+            "NAME_1.cpp to\n");
+    fprintf(stderr, "                       NAME_<N-1>.cpp, which can be compiled in parallel.\n");
+    fprintf(stderr,
+            "  --manifest FILENAME  Generate the outputs of each line of the file, which holds the "
+            "options\n");
+    fprintf(stderr,
+            "                       of one invocation, collating the atoms of all the modules "
+            "once. Cannot\n");
+    fprintf(stderr, "                       be used with other options.\n");
 #ifdef WITH_VENDOR
     fprintf(stderr,
             "  --vendor-proto       Path to the proto file for vendor atoms logging\n"
@@ -78,11 +187,14 @@ static void print_usage() {
 }
 
 /**
- * Do the argument parsing and execute the tasks.
+ * Do the argument parsing and execute the tasks. moduleAtoms, if set, holds the atoms of the
+ * module, collated by run_manifest().
  */
-static int run(int argc, char const* const* argv) {
+static int run(int argc, char const* const* argv,
+               const map<string, Atoms>* moduleAtoms = nullptr) {
     string cppFilename;
     string headerFilename;
+    string decoderFilename;
     string javaFilename;
     string javaPackage;
     string javaClass;
@@ -97,6 +209,26 @@ static int run(int argc, char const* const* argv) {
     int minApiLevel = API_LEVEL_CURRENT;
     int compileApiLevel = API_LEVEL_CURRENT;
     bool bootstrap = false;
+    bool perAtomMethods = false;
+    bool templateApi = false;
+    bool bufferEncoder = false;
+    bool batchWriter = false;
+    bool async = false;
+    bool spillFile = false;
+    bool ringTransport = false;
+    bool compactEncoding = false;
+    string compactAtoms;
+    bool atomEnableBitmap = false;
+    bool stateDedup = false;
+    bool stringViewArgs = false;
+    bool columnarPulledAtoms = false;
+    bool pulledAtomSizes = false;
+    bool atomRegistry = false;
+    bool nameLookup = false;
+    bool enumNames = false;
+    bool sharedEnums = false;
+    bool splitHeader = false;
+    int cppShards = 1;
 
     int index = 1;
     while (index < argc) {
@@ -117,6 +249,13 @@ static int run(int argc, char const* const* argv) {
                 return 1;
             }
             headerFilename = argv[index];
+        } else if (0 == strcmp("--decoder", argv[index])) {
+            index++;
+            if (index >= argc) {
+                print_usage();
+                return 1;
+            }
+            decoderFilename = argv[index];
         } else if (0 == strcmp("--java", argv[index])) {
             index++;
             if (index >= argc) {
@@ -204,6 +343,59 @@ static int run(int argc, char const* const* argv) {
             }
         } else if (0 == strcmp("--bootstrap", argv[index])) {
             bootstrap = true;
+        } else if (0 == strcmp("--perAtomMethods", argv[index])) {
+            perAtomMethods = true;
+        } else if (0 == strcmp("--templateApi", argv[index])) {
+            templateApi = true;
+        } else if (0 == strcmp("--bufferEncoder", argv[index])) {
+            bufferEncoder = true;
+        } else if (0 == strcmp("--batchWriter", argv[index])) {
+            batchWriter = true;
+        } else if (0 == strcmp("--async", argv[index])) {
+            async = true;
+        } else if (0 == strcmp("--spillFile", argv[index])) {
+            spillFile = true;
+        } else if (0 == strcmp("--ringTransport", argv[index])) {
+            ringTransport = true;
+        } else if (0 == strcmp("--compactEncoding", argv[index])) {
+            compactEncoding = true;
+        } else if (0 == strcmp("--compactAtoms", argv[index])) {
+            index++;
+            if (index >= argc) {
+                print_usage();
+                return 1;
+            }
+            compactAtoms = argv[index];
+        } else if (0 == strcmp("--atomEnableBitmap", argv[index])) {
+            atomEnableBitmap = true;
+        } else if (0 == strcmp("--stateDedup", argv[index])) {
+            stateDedup = true;
+        } else if (0 == strcmp("--stringViewArgs", argv[index])) {
+            stringViewArgs = true;
+        } else if (0 == strcmp("--columnarPulledAtoms", argv[index])) {
+            columnarPulledAtoms = true;
+        } else if (0 == strcmp("--pulledAtomSizes", argv[index])) {
+            pulledAtomSizes = true;
+        } else if (0 == strcmp("--atomRegistry", argv[index])) {
+            atomRegistry = true;
+        } else if (0 == strcmp("--nameLookup", argv[index])) {
+            nameLookup = true;
+        } else if (0 == strcmp("--enumNames", argv[index])) {
+            enumNames = true;
+        } else if (0 == strcmp("--sharedEnums", argv[index])) {
+            sharedEnums = true;
+        } else if (0 == strcmp("--splitHeader", argv[index])) {
+            splitHeader = true;
+        } else if (0 == strcmp("--cppShards", argv[index])) {
+            index++;
+            if (index >= argc) {
+                print_usage();
+                return 1;
+            }
+            cppShards = atoi(argv[index]);
+        } else if (0 == strcmp("--manifest", argv[index])) {
+            fprintf(stderr, "manifest flag cannot be used with other flags.\n");
+            return 1;
 #ifdef WITH_VENDOR
         } else if (0 == strcmp("--vendor-proto", argv[index])) {
             index++;
@@ -224,8 +416,8 @@ static int run(int argc, char const* const* argv) {
         return 1;
     }
 
-    if (cppFilename.empty() && headerFilename.empty() && javaFilename.empty() &&
-        rustFilename.empty() && rustHeaderFilename.empty()) {
+    if (cppFilename.empty() && headerFilename.empty() && decoderFilename.empty() &&
+        javaFilename.empty() && rustFilename.empty() && rustHeaderFilename.empty()) {
         print_usage();
         return 1;
     }
@@ -277,18 +469,198 @@ static int run(int argc, char const* const* argv) {
             return 1;
         }
     }
+    if (perAtomMethods) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "perAtomMethods flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "perAtomMethods flag does not support vendor atoms.\n");
+            return 1;
+        }
+    }
+    if (templateApi) {
+        if (headerFilename.empty()) {
+            fprintf(stderr, "templateApi flag can only be used for header files.\n");
+            return 1;
+        }
+        if (!perAtomMethods) {
+            fprintf(stderr, "templateApi flag requires the perAtomMethods flag.\n");
+            return 1;
+        }
+    }
+    if (bufferEncoder) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "bufferEncoder flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "bufferEncoder flag does not support vendor atoms.\n");
+            return 1;
+        }
+        if (bootstrap) {
+            fprintf(stderr, "bufferEncoder flag does not support bootstrap processes.\n");
+            return 1;
+        }
+        if (minApiLevel < API_R) {
+            fprintf(stderr, "bufferEncoder flag requires minApiLevel %d or higher.\n", API_R);
+            return 1;
+        }
+    }
+    if (batchWriter && !bufferEncoder) {
+        fprintf(stderr, "batchWriter flag requires the bufferEncoder flag.\n");
+        return 1;
+    }
+    if (async && !bufferEncoder) {
+        fprintf(stderr, "async flag requires the bufferEncoder flag.\n");
+        return 1;
+    }
+    if (spillFile && !bufferEncoder) {
+        fprintf(stderr, "spillFile flag requires the bufferEncoder flag.\n");
+        return 1;
+    }
+    if (ringTransport && !bufferEncoder) {
+        fprintf(stderr, "ringTransport flag requires the bufferEncoder flag.\n");
+        return 1;
+    }
+    if (compactEncoding && !bufferEncoder) {
+        fprintf(stderr, "compactEncoding flag requires the bufferEncoder flag.\n");
+        return 1;
+    }
+    if (!compactAtoms.empty() && !compactEncoding) {
+        fprintf(stderr, "compactAtoms flag requires the compactEncoding flag.\n");
+        return 1;
+    }
+    if (stringViewArgs) {
+        if (!perAtomMethods) {
+            fprintf(stderr, "stringViewArgs flag requires the perAtomMethods flag.\n");
+            return 1;
+        }
+        if (!bufferEncoder) {
+            fprintf(stderr, "stringViewArgs flag requires the bufferEncoder flag.\n");
+            return 1;
+        }
+    }
+    if (!decoderFilename.empty() && !vendorProto.empty()) {
+        fprintf(stderr, "decoder flag does not support vendor atoms.\n");
+        return 1;
+    }
+    if (atomRegistry) {
+        if (headerFilename.empty()) {
+            fprintf(stderr, "atomRegistry flag can only be used for header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "atomRegistry flag does not support vendor atoms.\n");
+            return 1;
+        }
+    }
+    if (nameLookup && !vendorProto.empty()) {
+        fprintf(stderr, "nameLookup flag does not support vendor atoms.\n");
+        return 1;
+    }
+    if (enumNames) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "enumNames flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "enumNames flag does not support vendor atoms.\n");
+            return 1;
+        }
+    }
+    if (sharedEnums && rustFilename.empty()) {
+        fprintf(stderr, "sharedEnums flag can only be used for rust files.\n");
+        return 1;
+    }
+    if (splitHeader) {
+        if (headerFilename.size() < 3 ||
+            headerFilename.compare(headerFilename.size() - 2, 2, ".h") != 0) {
+            fprintf(stderr, "splitHeader flag requires a header file ending in .h.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "splitHeader flag does not support vendor atoms.\n");
+            return 1;
+        }
+    }
+    if (cppShards != 1) {
+        if (cppShards < 1) {
+            fprintf(stderr, "cppShards must be at least 1.\n");
+            return 1;
+        }
+        if (cppFilename.size() < 5 ||
+            cppFilename.compare(cppFilename.size() - 4, 4, ".cpp") != 0) {
+            fprintf(stderr, "cppShards flag requires a cpp file ending in .cpp.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "cppShards flag does not support vendor atoms.\n");
+            return 1;
+        }
+        if (bufferEncoder || atomEnableBitmap) {
+            fprintf(stderr,
+                    "cppShards flag does not support the bufferEncoder and atomEnableBitmap "
+                    "flags.\n");
+            return 1;
+        }
+    }
+    if (atomEnableBitmap && !vendorProto.empty()) {
+        fprintf(stderr, "atomEnableBitmap flag does not support vendor atoms.\n");
+        return 1;
+    }
+    if (stateDedup) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "stateDedup flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!perAtomMethods) {
+            fprintf(stderr, "stateDedup flag requires the perAtomMethods flag.\n");
+            return 1;
+        }
+    }
+    if (columnarPulledAtoms) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "columnarPulledAtoms flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "columnarPulledAtoms flag does not support vendor atoms.\n");
+            return 1;
+        }
+        if (bootstrap) {
+            fprintf(stderr, "columnarPulledAtoms flag does not support bootstrap processes.\n");
+            return 1;
+        }
+    }
+    if (pulledAtomSizes) {
+        if (cppFilename.empty() && headerFilename.empty()) {
+            fprintf(stderr, "pulledAtomSizes flag can only be used for cpp/header files.\n");
+            return 1;
+        }
+        if (!vendorProto.empty()) {
+            fprintf(stderr, "pulledAtomSizes flag does not support vendor atoms.\n");
+            return 1;
+        }
+        if (bootstrap) {
+            fprintf(stderr, "pulledAtomSizes flag does not support bootstrap processes.\n");
+            return 1;
+        }
+    }
 
     // Collate the parameters
     int errorCount = 0;
 
-    Atoms atoms;
+    Atoms collatedAtoms;
 
     MFErrorCollector errorCollector;
     google::protobuf::compiler::DiskSourceTree sourceTree;
     google::protobuf::compiler::Importer importer(&sourceTree, &errorCollector);
 
     if (vendorProto.empty()) {
-        errorCount = collate_atoms(*Atom::descriptor(), moduleName, atoms);
+        if (moduleAtoms == nullptr) {
+            errorCount = collate_atoms(*Atom::descriptor(), moduleName, collatedAtoms);
+        }
     } else {
         const google::protobuf::FileDescriptor* fileDescriptor;
         sourceTree.MapPath("", fs::current_path().c_str());
@@ -304,14 +676,31 @@ static int run(int argc, char const* const* argv) {
         }
 
         fileDescriptor = importer.Import(vendorProto);
-        errorCount =
-                collate_atoms(*fileDescriptor->FindMessageTypeByName("Atom"), moduleName, atoms);
+        errorCount = collate_atoms(*fileDescriptor->FindMessageTypeByName("Atom"), moduleName,
+                                   collatedAtoms);
     }
 
     if (errorCount != 0) {
         return 1;
     }
 
+    const Atoms& atoms = moduleAtoms != nullptr && vendorProto.empty()
+                                 ? moduleAtoms->at(moduleName)
+                                 : collatedAtoms;
+
+    if (!compactAtoms.empty()) {
+        set<string> atomNames;
+        for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+            atomNames.insert(atomDecl->name);
+        }
+        for (const string& name : Split(compactAtoms, ",")) {
+            if (atomNames.count(name) == 0) {
+                fprintf(stderr, "compactAtoms flag names an unknown atom: %s\n", name.c_str());
+                return 1;
+            }
+        }
+    }
+
     AtomDecl attributionDecl;
     vector<java_type_t> attributionSignature;
     collate_atom(*android::os::statsd::AttributionNode::descriptor(), attributionDecl,
@@ -330,22 +719,40 @@ static int run(int argc, char const* const* argv) {
             fprintf(stderr, "Must supply --headerImport if supplying a specific module\n");
             return 1;
         }
-        FILE* out = fopen(cppFilename.c_str(), "w");
+        FILE* out = open_output_file(cppFilename);
         if (out == nullptr) {
             fprintf(stderr, "Unable to open file for write: %s\n", cppFilename.c_str());
             return 1;
         }
         if (vendorProto.empty()) {
-            errorCount = android::stats_log_api_gen::write_stats_log_cpp(
+            errorCount += android::stats_log_api_gen::write_stats_log_cpp(
                     out, atoms, attributionDecl, cppNamespace, cppHeaderImport, minApiLevel,
-                    bootstrap);
+                    bootstrap, perAtomMethods, bufferEncoder, batchWriter, async,
+                    atomEnableBitmap, stateDedup, stringViewArgs, columnarPulledAtoms,
+                    pulledAtomSizes, spillFile, ringTransport, compactEncoding, compactAtoms,
+                    nameLookup, enumNames, cppShards);
         } else {
 #ifdef WITH_VENDOR
-            errorCount = android::stats_log_api_gen::write_stats_log_cpp_vendor(
+            errorCount += android::stats_log_api_gen::write_stats_log_cpp_vendor(
                     out, atoms, attributionDecl, cppNamespace, cppHeaderImport);
 #endif
         }
-        fclose(out);
+        errorCount += close_output_file(out);
+
+        const string cppStem = cppFilename.substr(0, cppFilename.size() - 4);
+        for (int shardIndex = 1; shardIndex < cppShards; shardIndex++) {
+            const string shardFilename = cppStem + "_" + std::to_string(shardIndex) + ".cpp";
+            out = open_output_file(shardFilename);
+            if (out == nullptr) {
+                fprintf(stderr, "Unable to open file for write: %s\n", shardFilename.c_str());
+                return 1;
+            }
+            errorCount += android::stats_log_api_gen::write_stats_log_cpp_shard(
+                    out, atoms, attributionDecl, cppNamespace, cppHeaderImport, minApiLevel,
+                    bootstrap, perAtomMethods, stringViewArgs, columnarPulledAtoms, shardIndex,
+                    cppShards);
+            errorCount += close_output_file(out);
+        }
     }
 
     // Write the .h file
@@ -354,22 +761,86 @@ static int run(int argc, char const* const* argv) {
         if (moduleName != DEFAULT_MODULE_NAME && cppNamespace == DEFAULT_CPP_NAMESPACE) {
             fprintf(stderr, "Must supply --namespace if supplying a specific module\n");
         }
-        FILE* out = fopen(headerFilename.c_str(), "w");
+        FILE* out = open_output_file(headerFilename);
         if (out == nullptr) {
             fprintf(stderr, "Unable to open file for write: %s\n", headerFilename.c_str());
             return 1;
         }
 
-        if (vendorProto.empty()) {
-            errorCount = android::stats_log_api_gen::write_stats_log_header(
-                    out, atoms, attributionDecl, cppNamespace, minApiLevel, bootstrap);
+        if (splitHeader) {
+            // The split headers are written next to the header, which includes them.
+            const string headerStem = headerFilename.substr(0, headerFilename.size() - 2);
+            const string includeStem = fs::path(headerStem).filename().string();
+            const string atomsHeader = includeStem + "_atoms.h";
+            const string enumsHeader = includeStem + "_enums.h";
+            const string apiHeader = includeStem + "_api.h";
+            errorCount += android::stats_log_api_gen::write_stats_log_split_header(
+                    out, atoms, bootstrap, stringViewArgs || nameLookup,
+                    {atomsHeader, enumsHeader, apiHeader});
+            errorCount += close_output_file(out);
+
+            out = open_output_file(headerStem + "_atoms.h");
+            if (out == nullptr) {
+                fprintf(stderr, "Unable to open file for write: %s_atoms.h\n",
+                        headerStem.c_str());
+                return 1;
+            }
+            errorCount += android::stats_log_api_gen::write_stats_log_atoms_header(
+                    out, atoms, attributionDecl, cppNamespace);
+            errorCount += close_output_file(out);
+
+            out = open_output_file(headerStem + "_enums.h");
+            if (out == nullptr) {
+                fprintf(stderr, "Unable to open file for write: %s_enums.h\n",
+                        headerStem.c_str());
+                return 1;
+            }
+            errorCount +=
+                    android::stats_log_api_gen::write_stats_log_enums_header(out, atoms,
+                                                                             cppNamespace);
+            errorCount += close_output_file(out);
+
+            out = open_output_file(headerStem + "_api.h");
+            if (out == nullptr) {
+                fprintf(stderr, "Unable to open file for write: %s_api.h\n", headerStem.c_str());
+                return 1;
+            }
+            errorCount += android::stats_log_api_gen::write_stats_log_header(
+                    out, atoms, attributionDecl, cppNamespace, minApiLevel, bootstrap,
+                    perAtomMethods, templateApi, bufferEncoder, batchWriter, async,
+                    atomEnableBitmap, stateDedup, stringViewArgs, columnarPulledAtoms,
+                    pulledAtomSizes, spillFile, ringTransport, compactEncoding, atomRegistry,
+                    nameLookup, enumNames, atomsHeader);
+        } else if (vendorProto.empty()) {
+            errorCount += android::stats_log_api_gen::write_stats_log_header(
+                    out, atoms, attributionDecl, cppNamespace, minApiLevel, bootstrap,
+                    perAtomMethods, templateApi, bufferEncoder, batchWriter, async,
+                    atomEnableBitmap, stateDedup, stringViewArgs, columnarPulledAtoms,
+                    pulledAtomSizes, spillFile, ringTransport, compactEncoding, atomRegistry,
+                    nameLookup, enumNames, /*atomsHeader=*/"");
         } else {
 #ifdef WITH_VENDOR
-            errorCount = android::stats_log_api_gen::write_stats_log_header_vendor(
+            errorCount += android::stats_log_api_gen::write_stats_log_header_vendor(
                     out, atoms, attributionDecl, cppNamespace);
 #endif
         }
-        fclose(out);
+        errorCount += close_output_file(out);
+    }
+
+    // Write the decoder .h file
+    if (!decoderFilename.empty()) {
+        // If this is for a specific module, the namespace must also be provided.
+        if (moduleName != DEFAULT_MODULE_NAME && cppNamespace == DEFAULT_CPP_NAMESPACE) {
+            fprintf(stderr, "Must supply --namespace if supplying a specific module\n");
+            return 1;
+        }
+        FILE* out = open_output_file(decoderFilename);
+        if (out == nullptr) {
+            fprintf(stderr, "Unable to open file for write: %s\n", decoderFilename.c_str());
+            return 1;
+        }
+        errorCount += android::stats_log_api_gen::write_stats_log_decoder(out, atoms, cppNamespace);
+        errorCount += close_output_file(out);
     }
 
     // Write the .java file
@@ -389,16 +860,16 @@ static int run(int argc, char const* const* argv) {
             return 1;
         }
 
-        FILE* out = fopen(javaFilename.c_str(), "w");
+        FILE* out = open_output_file(javaFilename);
         if (out == nullptr) {
             fprintf(stderr, "Unable to open file for write: %s\n", javaFilename.c_str());
             return 1;
         }
 
         if (vendorProto.empty()) {
-            errorCount = android::stats_log_api_gen::write_stats_log_java(
+            errorCount += android::stats_log_api_gen::write_stats_log_java(
                     out, atoms, attributionDecl, javaClass, javaPackage, minApiLevel,
-                    compileApiLevel, supportWorkSource);
+                    compileApiLevel, supportWorkSource, atomEnableBitmap, nameLookup);
         } else {
 #ifdef WITH_VENDOR
             if (supportWorkSource) {
@@ -406,12 +877,12 @@ static int run(int argc, char const* const* argv) {
                 return 1;
             }
 
-            errorCount = android::stats_log_api_gen::write_stats_log_java_vendor(out, atoms,
+            errorCount += android::stats_log_api_gen::write_stats_log_java_vendor(out, atoms,
                     javaClass, javaPackage);
 #endif
         }
 
-        fclose(out);
+        errorCount += close_output_file(out);
     }
 
     // Write the main .rs file
@@ -421,16 +892,17 @@ static int run(int argc, char const* const* argv) {
             return 1;
         }
 
-        FILE* out = fopen(rustFilename.c_str(), "w");
+        FILE* out = open_output_file(rustFilename);
         if (out == nullptr) {
             fprintf(stderr, "Unable to open file for write: %s\n", rustFilename.c_str());
             return 1;
         }
 
         errorCount += android::stats_log_api_gen::write_stats_log_rust(
-                out, atoms, attributionDecl, minApiLevel, rustHeaderCrate.c_str());
+                out, atoms, attributionDecl, minApiLevel, rustHeaderCrate.c_str(),
+                atomEnableBitmap, nameLookup, sharedEnums);
 
-        fclose(out);
+        errorCount += close_output_file(out);
     }
 
     // Write the header .rs file
@@ -440,7 +912,7 @@ static int run(int argc, char const* const* argv) {
             return 1;
         }
 
-        FILE* out = fopen(rustHeaderFilename.c_str(), "w");
+        FILE* out = open_output_file(rustHeaderFilename);
         if (out == nullptr) {
             fprintf(stderr, "Unable to open file for write: %s\n", rustHeaderFilename.c_str());
             return 1;
@@ -449,12 +921,64 @@ static int run(int argc, char const* const* argv) {
         android::stats_log_api_gen::write_stats_log_rust_header(out, atoms, attributionDecl,
                                                                 rustHeaderCrate.c_str());
 
-        fclose(out);
+        errorCount += close_output_file(out);
     }
 
     return errorCount;
 }
 
+/**
+ * Runs each line of the manifest, which holds the options of one invocation, such as
+ * "--module bluetooth --cpp bluetooth.cpp ...". The atoms of all the modules are collated in one
+ * pass, instead of once per module. Blank lines and lines starting with # are skipped.
+ */
+static int run_manifest(const string& manifestFilename) {
+    std::ifstream manifest(manifestFilename);
+    if (!manifest) {
+        fprintf(stderr, "Unable to open manifest: %s\n", manifestFilename.c_str());
+        return 1;
+    }
+
+    vector<vector<string>> invocations;
+    set<string> moduleNames;
+    string line;
+    while (std::getline(manifest, line)) {
+        vector<string> args = {"stats-log-api-gen"};
+        for (const string& arg : Split(line, " \t\r")) {
+            if (!arg.empty()) {
+                args.push_back(arg);
+            }
+        }
+        if (args.size() == 1 || args[1][0] == '#') {
+            continue;
+        }
+        string moduleName = DEFAULT_MODULE_NAME;
+        for (size_t i = 1; i + 1 < args.size(); i++) {
+            if (args[i] == "--module") {
+                moduleName = args[i + 1];
+            }
+        }
+        moduleNames.insert(moduleName);
+        invocations.push_back(std::move(args));
+    }
+
+    map<string, Atoms> moduleAtoms;
+    if (collate_atoms(*Atom::descriptor(), moduleNames, moduleAtoms) != 0) {
+        return 1;
+    }
+
+    int errorCount = 0;
+    for (const vector<string>& args : invocations) {
+        vector<const char*> argv;
+        for (const string& arg : args) {
+            argv.push_back(arg.c_str());
+        }
+        errorCount += run(argv.size(), argv.data(), &moduleAtoms);
+    }
+    // The exit status keeps only the low 8 bits of the count.
+    return errorCount > 0 ? 1 : 0;
+}
+
 }  // namespace stats_log_api_gen
 }  // namespace android
 
@@ -464,5 +988,8 @@ static int run(int argc, char const* const* argv) {
 int main(int argc, char const* const* argv) {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+    if (argc == 3 && 0 == strcmp("--manifest", argv[1])) {
+        return android::stats_log_api_gen::run_manifest(argv[2]);
+    }
     return android::stats_log_api_gen::run(argc, argv);
 }
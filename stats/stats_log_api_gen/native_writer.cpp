@@ -16,12 +16,23 @@
 
 #include "native_writer.h"
 
+#include <algorithm>
+
 #include "Collation.h"
+#include "native_writer_buffer.h"
 #include "utils.h"
 
 namespace android {
 namespace stats_log_api_gen {
 
+// Number of primary keys whose last state is remembered per state atom.
+static const size_t STATE_CACHE_SIZE = 64;
+
+// Length assumed for strings and byte arrays, and element count assumed for attribution chains
+// and repeated fields, by the pulled atom sizes.
+static const size_t STRING_SIZE_ESTIMATE = 64;
+static const size_t REPEATED_FIELD_LENGTH_ESTIMATE = 16;
+
 static void write_native_annotation_constants(FILE* out) {
     fprintf(out, "// Annotation constants.\n");
 
@@ -33,77 +44,117 @@ static void write_native_annotation_constants(FILE* out) {
     fprintf(out, "\n");
 }
 
+static void write_atom_annotations(FILE* out, int argIndex, const AtomDecl& atomDecl,
+                                   const string& methodPrefix, const string& methodSuffix,
+                                   const int minApiLevel, const string& indent) {
+    const map<AnnotationId, AnnotationStruct>& ANNOTATION_ID_CONSTANTS =
+            get_annotation_id_constants(ANNOTATION_CONSTANT_NAME_PREFIX);
+    const string constantPrefix = minApiLevel > API_R ? "ASTATSLOG_" : "";
+    const AnnotationSet& annotations = atomDecl.fieldNumberToAnnotations.at(argIndex);
+    int resetState = -1;
+    int defaultState = -1;
+    for (const shared_ptr<Annotation>& annotation : annotations) {
+        const string& annotationConstant =
+                ANNOTATION_ID_CONSTANTS.at(annotation->annotationId).name;
+        switch (annotation->type) {
+            case ANNOTATION_TYPE_INT:
+                if (ANNOTATION_ID_TRIGGER_STATE_RESET == annotation->annotationId) {
+                    resetState = annotation->value.intValue;
+                } else if (ANNOTATION_ID_DEFAULT_STATE == annotation->annotationId) {
+                    defaultState = annotation->value.intValue;
+                } else if (ANNOTATION_ID_RESTRICTION_CATEGORY == annotation->annotationId) {
+                    fprintf(out, "%s%saddInt32Annotation(%s%s%s,\n", indent.c_str(),
+                            methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
+                            annotationConstant.c_str());
+                    fprintf(out, "%s                               %s%s);\n", indent.c_str(),
+                            constantPrefix.c_str(),
+                            get_restriction_category_str(annotation->value.intValue).c_str());
+                } else {
+                    fprintf(out, "%s%saddInt32Annotation(%s%s%s, %d);\n", indent.c_str(),
+                            methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
+                            annotationConstant.c_str(), annotation->value.intValue);
+                }
+                break;
+            case ANNOTATION_TYPE_BOOL:
+                fprintf(out, "%s%saddBoolAnnotation(%s%s%s, %s);\n", indent.c_str(),
+                        methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
+                        annotationConstant.c_str(),
+                        annotation->value.boolValue ? "true" : "false");
+                break;
+            default:
+                break;
+        }
+    }
+    if (defaultState != -1 && resetState != -1) {
+        const string& annotationConstant =
+                ANNOTATION_ID_CONSTANTS.at(ANNOTATION_ID_TRIGGER_STATE_RESET).name;
+        fprintf(out, "%sif (arg%d == %d) {\n", indent.c_str(), argIndex, resetState);
+        fprintf(out, "%s    %saddInt32Annotation(%s%s%s, %d);\n", indent.c_str(),
+                methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
+                annotationConstant.c_str(), defaultState);
+        fprintf(out, "%s}\n", indent.c_str());
+    }
+}
+
+// Writes the annotations for the field at argIndex. If atomDecl is set, the method is specific to
+// that atom and its annotations are written unconditionally. Otherwise, the annotations of every
+// atom in the signature are written, each guarded by a check on the atom code.
 static void write_annotations(FILE* out, int argIndex,
                               const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet,
-                              const string& methodPrefix, const string& methodSuffix,
-                              const int minApiLevel) {
+                              const AtomDecl* atomDecl, const string& methodPrefix,
+                              const string& methodSuffix, const int minApiLevel) {
+    if (atomDecl != nullptr) {
+        if (atomDecl->fieldNumberToAnnotations.find(argIndex) !=
+            atomDecl->fieldNumberToAnnotations.end()) {
+            write_atom_annotations(out, argIndex, *atomDecl, methodPrefix, methodSuffix,
+                                   minApiLevel, "    ");
+        }
+        return;
+    }
     FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
             fieldNumberToAtomDeclSet.find(argIndex);
     if (fieldNumberToAtomDeclSet.end() == fieldNumberToAtomDeclSetIt) {
         return;
     }
     const AtomDeclSet& atomDeclSet = fieldNumberToAtomDeclSetIt->second;
-    const map<AnnotationId, AnnotationStruct>& ANNOTATION_ID_CONSTANTS =
-            get_annotation_id_constants(ANNOTATION_CONSTANT_NAME_PREFIX);
-    const string constantPrefix = minApiLevel > API_R ? "ASTATSLOG_" : "";
     for (const shared_ptr<AtomDecl>& atomDecl : atomDeclSet) {
         const string atomConstant = make_constant_name(atomDecl->name);
         fprintf(out, "    if (%s == code) {\n", atomConstant.c_str());
-        const AnnotationSet& annotations = atomDecl->fieldNumberToAnnotations.at(argIndex);
-        int resetState = -1;
-        int defaultState = -1;
-        for (const shared_ptr<Annotation>& annotation : annotations) {
-            const string& annotationConstant =
-                    ANNOTATION_ID_CONSTANTS.at(annotation->annotationId).name;
-            switch (annotation->type) {
-                case ANNOTATION_TYPE_INT:
-                    if (ANNOTATION_ID_TRIGGER_STATE_RESET == annotation->annotationId) {
-                        resetState = annotation->value.intValue;
-                    } else if (ANNOTATION_ID_DEFAULT_STATE == annotation->annotationId) {
-                        defaultState = annotation->value.intValue;
-                    } else if (ANNOTATION_ID_RESTRICTION_CATEGORY == annotation->annotationId) {
-                        fprintf(out, "        %saddInt32Annotation(%s%s%s,\n",
-                                methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
-                                annotationConstant.c_str());
-                        fprintf(out, "                                       %s%s);\n",
-                                constantPrefix.c_str(),
-                                get_restriction_category_str(annotation->value.intValue).c_str());
-                    } else {
-                        fprintf(out, "        %saddInt32Annotation(%s%s%s, %d);\n",
-                                methodPrefix.c_str(), methodSuffix.c_str(), constantPrefix.c_str(),
-                                annotationConstant.c_str(), annotation->value.intValue);
-                    }
-                    break;
-                case ANNOTATION_TYPE_BOOL:
-                    fprintf(out, "        %saddBoolAnnotation(%s%s%s, %s);\n", methodPrefix.c_str(),
-                            methodSuffix.c_str(), constantPrefix.c_str(),
-                            annotationConstant.c_str(),
-                            annotation->value.boolValue ? "true" : "false");
-                    break;
-                default:
-                    break;
-            }
-        }
-        if (defaultState != -1 && resetState != -1) {
-            const string& annotationConstant =
-                    ANNOTATION_ID_CONSTANTS.at(ANNOTATION_ID_TRIGGER_STATE_RESET).name;
-            fprintf(out, "        if (arg%d == %d) {\n", argIndex, resetState);
-            fprintf(out, "            %saddInt32Annotation(%s%s%s, %d);\n", methodPrefix.c_str(),
-                    methodSuffix.c_str(), constantPrefix.c_str(), annotationConstant.c_str(),
-                    defaultState);
-            fprintf(out, "        }\n");
-        }
+        write_atom_annotations(out, argIndex, *atomDecl, methodPrefix, methodSuffix, minApiLevel,
+                               "        ");
         fprintf(out, "    }\n");
     }
 }
 
+// Returns the expression that evaluates to the atom id inside a generated method.
+static string get_atom_code_expression(const AtomDecl* atomDecl) {
+    return atomDecl != nullptr ? make_constant_name(atomDecl->name) : "code";
+}
+
+// Returns the elements and the length of the repeated field argument argIndex, which is a
+// std::vector unless pointerArgs is set.
+static string get_array_arguments(int argIndex, bool pointerArgs) {
+    const string arg = "arg" + std::to_string(argIndex);
+    return pointerArgs ? arg + ", " + arg + "_length" : arg + ".data(), " + arg + ".size()";
+}
+
+// Writes the calls that encode the fields of the event. methodPrefix selects the encoder, which is
+// either the AStatsEvent API or the StatsEventBuffer encoder, and event is the expression passed
+// to it as the event. pointerArgs is set if the method takes the attribution tags and the repeated
+// fields as pointers.
 static int write_native_method_body(FILE* out, const vector<java_type_t>& signature,
                                     const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet,
-                                    const AtomDecl& attributionDecl, const int minApiLevel) {
+                                    const AtomDecl* atomDecl, const AtomDecl& attributionDecl,
+                                    const int minApiLevel, const string& methodPrefix,
+                                    const string& event, bool pointerArgs) {
+    const char* prefix = methodPrefix.c_str();
+    const char* eventArg = event.c_str();
+    const string annotationSuffix = event + ", ";
     int argIndex = 1;
-    fprintf(out, "    AStatsEvent_setAtomId(event, code);\n");
-    write_annotations(out, ATOM_ID_FIELD_NUMBER, fieldNumberToAtomDeclSet, "AStatsEvent_",
-                      "event, ", minApiLevel);
+    fprintf(out, "    %ssetAtomId(%s, %s);\n", prefix, eventArg,
+            get_atom_code_expression(atomDecl).c_str());
+    write_annotations(out, ATOM_ID_FIELD_NUMBER, fieldNumberToAtomDeclSet, atomDecl, methodPrefix,
+                      annotationSuffix, minApiLevel);
     for (vector<java_type_t>::const_iterator arg = signature.begin(); arg != signature.end();
          arg++) {
         if (minApiLevel < API_T && is_repeated_field(*arg)) {
@@ -115,61 +166,57 @@ static int write_native_method_body(FILE* out, const vector<java_type_t>& signat
                 const char* uidName = attributionDecl.fields.front().name.c_str();
                 const char* tagName = attributionDecl.fields.back().name.c_str();
                 fprintf(out,
-                        "    AStatsEvent_writeAttributionChain(event, "
-                        "reinterpret_cast<const uint32_t*>(%s), %s.data(), "
+                        "    %swriteAttributionChain(%s, "
+                        "reinterpret_cast<const uint32_t*>(%s), %s%s, "
                         "static_cast<uint8_t>(%s_length));\n",
-                        uidName, tagName, uidName);
+                        prefix, eventArg, uidName, tagName, pointerArgs ? "" : ".data()", uidName);
                 break;
             }
             case JAVA_TYPE_BYTE_ARRAY:
                 fprintf(out,
-                        "    AStatsEvent_writeByteArray(event, "
+                        "    %swriteByteArray(%s, "
                         "reinterpret_cast<const uint8_t*>(arg%d.arg), "
                         "arg%d.arg_length);\n",
-                        argIndex, argIndex);
+                        prefix, eventArg, argIndex, argIndex);
                 break;
             case JAVA_TYPE_BOOLEAN:
-                fprintf(out, "    AStatsEvent_writeBool(event, arg%d);\n", argIndex);
+                fprintf(out, "    %swriteBool(%s, arg%d);\n", prefix, eventArg, argIndex);
                 break;
             case JAVA_TYPE_INT:
                 [[fallthrough]];
             case JAVA_TYPE_ENUM:
-                fprintf(out, "    AStatsEvent_writeInt32(event, arg%d);\n", argIndex);
+                fprintf(out, "    %swriteInt32(%s, arg%d);\n", prefix, eventArg, argIndex);
                 break;
             case JAVA_TYPE_FLOAT:
-                fprintf(out, "    AStatsEvent_writeFloat(event, arg%d);\n", argIndex);
+                fprintf(out, "    %swriteFloat(%s, arg%d);\n", prefix, eventArg, argIndex);
                 break;
             case JAVA_TYPE_LONG:
-                fprintf(out, "    AStatsEvent_writeInt64(event, arg%d);\n", argIndex);
+                fprintf(out, "    %swriteInt64(%s, arg%d);\n", prefix, eventArg, argIndex);
                 break;
             case JAVA_TYPE_STRING:
-                fprintf(out, "    AStatsEvent_writeString(event, arg%d);\n", argIndex);
+                fprintf(out, "    %swriteString(%s, arg%d);\n", prefix, eventArg, argIndex);
                 break;
             case JAVA_TYPE_BOOLEAN_ARRAY:
-                fprintf(out, "    AStatsEvent_writeBoolArray(event, arg%d, arg%d_length);\n",
-                        argIndex, argIndex);
+                fprintf(out, "    %swriteBoolArray(%s, arg%d, arg%d_length);\n", prefix,
+                        eventArg, argIndex, argIndex);
                 break;
             case JAVA_TYPE_INT_ARRAY:
                 [[fallthrough]];
             case JAVA_TYPE_ENUM_ARRAY:
-                fprintf(out,
-                        "    AStatsEvent_writeInt32Array(event, arg%d.data(), arg%d.size());\n",
-                        argIndex, argIndex);
+                fprintf(out, "    %swriteInt32Array(%s, %s);\n", prefix, eventArg,
+                        get_array_arguments(argIndex, pointerArgs).c_str());
                 break;
             case JAVA_TYPE_FLOAT_ARRAY:
-                fprintf(out,
-                        "    AStatsEvent_writeFloatArray(event, arg%d.data(), arg%d.size());\n",
-                        argIndex, argIndex);
+                fprintf(out, "    %swriteFloatArray(%s, %s);\n", prefix, eventArg,
+                        get_array_arguments(argIndex, pointerArgs).c_str());
                 break;
             case JAVA_TYPE_LONG_ARRAY:
-                fprintf(out,
-                        "    AStatsEvent_writeInt64Array(event, arg%d.data(), arg%d.size());\n",
-                        argIndex, argIndex);
+                fprintf(out, "    %swriteInt64Array(%s, %s);\n", prefix, eventArg,
+                        get_array_arguments(argIndex, pointerArgs).c_str());
                 break;
             case JAVA_TYPE_STRING_ARRAY:
-                fprintf(out,
-                        "    AStatsEvent_writeStringArray(event, arg%d.data(), arg%d.size());\n",
-                        argIndex, argIndex);
+                fprintf(out, "    %swriteStringArray(%s, %s);\n", prefix, eventArg,
+                        get_array_arguments(argIndex, pointerArgs).c_str());
                 break;
 
             default:
@@ -177,327 +224,2085 @@ static int write_native_method_body(FILE* out, const vector<java_type_t>& signat
                 fprintf(stderr, "Encountered unsupported type.\n");
                 return 1;
         }
-        write_annotations(out, argIndex, fieldNumberToAtomDeclSet, "AStatsEvent_", "event, ",
-                          minApiLevel);
+        write_annotations(out, argIndex, fieldNumberToAtomDeclSet, atomDecl, methodPrefix,
+                          annotationSuffix, minApiLevel);
         argIndex++;
     }
     return 0;
 }
 
+// How write_native_method_call passes on the attribution tags and repeated fields of the enclosing
+// method.
+enum VectorArgumentPassing {
+    // The enclosing method and the callee take them as std::vector.
+    PASS_VECTORS,
+    // The enclosing method and the callee take them as pointers.
+    PASS_POINTERS,
+    // The enclosing method takes them as std::vector, and the callee as pointers.
+    PASS_VECTOR_DATA,
+};
+
+// Returns true if the signature has an attribution chain.
+static bool has_attribution_chain(const vector<java_type_t>& signature) {
+    return std::find(signature.begin(), signature.end(), JAVA_TYPE_ATTRIBUTION_CHAIN) !=
+           signature.end();
+}
+
+// Writes the conversion of the attribution tags of the enclosing method into the array of
+// std::string_view that write_native_method_call passes on if stringViews is set.
+static void write_native_tag_views(FILE* out, const vector<java_type_t>& signature,
+                                   const AtomDecl& attributionDecl, VectorArgumentPassing passing,
+                                   const char* indent) {
+    if (!has_attribution_chain(signature)) {
+        return;
+    }
+    const char* uidName = attributionDecl.fields.front().name.c_str();
+    const char* tagName = attributionDecl.fields.back().name.c_str();
+    fprintf(out, "%sstd::string_view %s_views[STATS_EVENT_MAX_COUNT];\n", indent, tagName);
+    fprintf(out, "%sto_string_views(%s%s, %s_length, %s_views);\n", indent, tagName,
+            passing == PASS_VECTOR_DATA ? ".data()" : "", uidName, tagName);
+}
+
+// Writes a call that passes the arguments of the enclosing method on to methodName. If
+// stringViews is set, the enclosing method takes the strings as char const* and the callee as
+// std::string_view, and the attribution tags are passed from write_native_tag_views.
 static void write_native_method_call(FILE* out, const string& methodName,
+                                     const string& leadingArg,
                                      const vector<java_type_t>& signature,
-                                     const AtomDecl& attributionDecl, int argIndex) {
-    fprintf(out, "%s(code", methodName.c_str());
+                                     const AtomDecl& attributionDecl, int argIndex,
+                                     VectorArgumentPassing passing = PASS_VECTORS,
+                                     bool stringViews = false) {
+    fprintf(out, "%s(%s", methodName.c_str(), leadingArg.c_str());
+    const char* separator = leadingArg.empty() ? "" : ", ";
     for (vector<java_type_t>::const_iterator arg = signature.begin(); arg != signature.end();
          arg++) {
         if (*arg == JAVA_TYPE_ATTRIBUTION_CHAIN) {
             for (const auto& chainField : attributionDecl.fields) {
-                if (chainField.javaType == JAVA_TYPE_STRING) {
-                    fprintf(out, ", %s", chainField.name.c_str());
+                if (chainField.javaType == JAVA_TYPE_STRING && stringViews) {
+                    fprintf(out, "%s%s_views", separator, chainField.name.c_str());
+                } else if (chainField.javaType == JAVA_TYPE_STRING) {
+                    fprintf(out, "%s%s%s", separator, chainField.name.c_str(),
+                            passing == PASS_VECTOR_DATA ? ".data()" : "");
                 } else {
-                    fprintf(out, ",  %s,  %s_length", chainField.name.c_str(),
-                            chainField.name.c_str());
+                    // Keep the historical double spacing of the generated calls.
+                    fprintf(out, "%s%s,  %s_length", *separator ? ",  " : "",
+                            chainField.name.c_str(), chainField.name.c_str());
                 }
+                separator = ", ";
             }
+        } else if (passing != PASS_VECTORS && is_vector_field(*arg)) {
+            fprintf(out, "%s%s", separator,
+                    get_array_arguments(argIndex, passing == PASS_POINTERS).c_str());
+        } else if (stringViews && *arg == JAVA_TYPE_STRING) {
+            // Unlike std::string_view, the char const* arguments may be null.
+            fprintf(out, "%sto_string_view(arg%d)", separator, argIndex);
         } else {
-            fprintf(out, ", arg%d", argIndex);
+            fprintf(out, "%sarg%d", separator, argIndex);
 
             if (*arg == JAVA_TYPE_BOOLEAN_ARRAY) {
                 fprintf(out, ", arg%d_length", argIndex);
             }
         }
+        separator = ", ";
         argIndex++;
     }
     fprintf(out, ");\n");
 }
 
-static int write_native_stats_write_methods(FILE* out, const SignatureInfoMap& signatureInfoMap,
-                                            const AtomDecl& attributionDecl, const int minApiLevel,
-                                            bool bootstrap) {
-    fprintf(out, "\n");
-    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
-        write_native_method_signature(out, "int stats_write(", signature, attributionDecl, " {");
+// Writes the body of a write method that takes the attribution tags and repeated fields as
+// std::vector. It forwards them to the overload named methodName that takes them as pointers, and
+// the strings as std::string_view if stringViews is set.
+static void write_native_vector_arguments_forward(FILE* out, const string& methodName,
+                                                  const string& leadingArg,
+                                                  const vector<java_type_t>& signature,
+                                                  const AtomDecl& attributionDecl,
+                                                  bool stringViews = false) {
+    if (stringViews) {
+        write_native_tag_views(out, signature, attributionDecl, PASS_VECTOR_DATA, "    ");
+    }
+    fprintf(out, "    return ");
+    write_native_method_call(out, methodName, leadingArg, signature, attributionDecl, 1,
+                             PASS_VECTOR_DATA, stringViews);
+    fprintf(out, "}\n\n");  // end method.
+}
 
-        // Write method body.
-        if (bootstrap) {
-            fprintf(out, "    ::android::os::StatsBootstrapAtom atom;\n");
-            fprintf(out, "    atom.atomId = code;\n");
-            FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
-                    fieldNumberToAtomDeclSet.find(ATOM_ID_FIELD_NUMBER);
-            if (fieldNumberToAtomDeclSet.end() != fieldNumberToAtomDeclSetIt) {
-                fprintf(stderr, "Bootstrap atoms do not support annotations\n");
-                return 1;
-            }
-            int argIndex = 1;
-            const char* atomVal = "::android::os::StatsBootstrapAtomValue::";
-            for (vector<java_type_t>::const_iterator arg = signature.begin();
-                 arg != signature.end(); arg++) {
-                switch (*arg) {
-                    case JAVA_TYPE_BYTE_ARRAY:
-                        fprintf(out,
-                                "    const uint8_t* arg%dbyte = reinterpret_cast<const "
-                                "uint8_t*>(arg%d.arg);\n",
-                                argIndex, argIndex);
-                        fprintf(out,
-                                "    "
-                                "atom.values.push_back(%smake<%sbytesValue>(std::vector(arg%dbyte, "
-                                "arg%dbyte + arg%d.arg_length)));\n",
-                                atomVal, atomVal, argIndex, argIndex, argIndex);
-                        break;
-                    case JAVA_TYPE_BOOLEAN:
-                        fprintf(out, "    atom.values.push_back(%smake<%sboolValue>(arg%d));\n",
-                                atomVal, atomVal, argIndex);
-                        break;
-                    case JAVA_TYPE_INT:  // Fall through.
-                    case JAVA_TYPE_ENUM:
-                        fprintf(out, "    atom.values.push_back(%smake<%sintValue>(arg%d));\n",
-                                atomVal, atomVal, argIndex);
-                        break;
-                    case JAVA_TYPE_FLOAT:
-                        fprintf(out, "    atom.values.push_back(%smake<%sfloatValue>(arg%d));\n",
-                                atomVal, atomVal, argIndex);
-                        break;
-                    case JAVA_TYPE_LONG:
-                        fprintf(out, "    atom.values.push_back(%smake<%slongValue>(arg%d));\n",
-                                atomVal, atomVal, argIndex);
-                        break;
-                    case JAVA_TYPE_STRING:
-                        fprintf(out,
-                                "    atom.values.push_back(%smake<%sstringValue>("
-                                "::android::String16(arg%d)));\n",
-                                atomVal, atomVal, argIndex);
-                        break;
-                    default:
-                        // Unsupported types: OBJECT, DOUBLE, ATTRIBUTION_CHAIN,
-                        // and all repeated fields
-                        fprintf(stderr, "Encountered unsupported type.\n");
-                        return 1;
-                }
-                FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
-                        fieldNumberToAtomDeclSet.find(argIndex);
-                if (fieldNumberToAtomDeclSet.end() != fieldNumberToAtomDeclSetIt) {
-                    fprintf(stderr, "Bootstrap atoms do not support annotations\n");
-                    return 1;
-                }
-                argIndex++;
-            }
-            fprintf(out,
-                    "    bool success = "
-                    "::android::os::stats::StatsBootstrapAtomClient::reportBootstrapAtom(atom);\n");
-            fprintf(out, "    return success? 0 : -1;\n");
-
-        } else if (minApiLevel == API_Q) {
-            int argIndex = 1;
-            fprintf(out, "    StatsEventCompat event;\n");
-            fprintf(out, "    event.setAtomId(code);\n");
-            write_annotations(out, ATOM_ID_FIELD_NUMBER, fieldNumberToAtomDeclSet, "event.", "",
-                              minApiLevel);
-            for (vector<java_type_t>::const_iterator arg = signature.begin();
-                 arg != signature.end(); arg++) {
-                switch (*arg) {
-                    case JAVA_TYPE_ATTRIBUTION_CHAIN: {
-                        const char* uidName = attributionDecl.fields.front().name.c_str();
-                        const char* tagName = attributionDecl.fields.back().name.c_str();
-                        fprintf(out, "    event.writeAttributionChain(%s, %s_length, %s);\n",
-                                uidName, uidName, tagName);
-                        break;
-                    }
-                    case JAVA_TYPE_BYTE_ARRAY:
-                        fprintf(out, "    event.writeByteArray(arg%d.arg, arg%d.arg_length);\n",
-                                argIndex, argIndex);
-                        break;
-                    case JAVA_TYPE_BOOLEAN:
-                        fprintf(out, "    event.writeBool(arg%d);\n", argIndex);
-                        break;
-                    case JAVA_TYPE_INT:  // Fall through.
-                    case JAVA_TYPE_ENUM:
-                        fprintf(out, "    event.writeInt32(arg%d);\n", argIndex);
-                        break;
-                    case JAVA_TYPE_FLOAT:
-                        fprintf(out, "    event.writeFloat(arg%d);\n", argIndex);
-                        break;
-                    case JAVA_TYPE_LONG:
-                        fprintf(out, "    event.writeInt64(arg%d);\n", argIndex);
-                        break;
-                    case JAVA_TYPE_STRING:
-                        fprintf(out, "    event.writeString(arg%d);\n", argIndex);
-                        break;
-                    default:
-                        // Unsupported types: OBJECT, DOUBLE, and all repeated
-                        // fields.
-                        fprintf(stderr, "Encountered unsupported type.\n");
-                        return 1;
-                }
-                write_annotations(out, argIndex, fieldNumberToAtomDeclSet, "event.", "",
-                                  minApiLevel);
-                argIndex++;
-            }
-            fprintf(out, "    return event.writeToSocket();\n");  // end method body.
-        } else {
-            fprintf(out, "    AStatsEvent* event = AStatsEvent_obtain();\n");
-            int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet,
-                                               attributionDecl, minApiLevel);
-            if (ret != 0) {
-                return ret;
-            }
-            fprintf(out, "    const int ret = AStatsEvent_write(event);\n");
-            fprintf(out, "    AStatsEvent_release(event);\n");
-            fprintf(out, "    return ret;\n");  // end method body.
-        }
-        fprintf(out, "}\n\n");  // end method.
+// Returns an upper bound on the bytes that the annotations add to the encoded event.
+static size_t get_annotations_encoded_size(const AnnotationSet& annotations) {
+    size_t size = 0;
+    for (const shared_ptr<Annotation>& annotation : annotations) {
+        // Annotation id, type id and value. The state reset annotation is at most one int.
+        size += annotation->type == ANNOTATION_TYPE_BOOL ? 3 : 6;
     }
-    return 0;
+    return size;
 }
 
-static void write_native_stats_write_non_chained_methods(FILE* out,
-                                                         const SignatureInfoMap& signatureInfoMap,
-                                                         const AtomDecl& attributionDecl) {
-    fprintf(out, "\n");
-    for (const auto& [signature, _] : signatureInfoMap) {
-        write_native_method_signature(out, "int stats_write_non_chained(", signature,
-                                      attributionDecl, " {");
+// Object type and element count, then the timestamp and atom id fields.
+static const size_t ENCODED_HEADER_SIZE = 2 + 9 + 5;
 
-        vector<java_type_t> newSignature;
+// Returns the encoded size of a field of the given type, including its type id, or 0 if the size
+// of the field varies.
+static size_t get_fixed_field_encoded_size(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_BOOLEAN:
+            return 2;
+        case JAVA_TYPE_INT:
+            [[fallthrough]];
+        case JAVA_TYPE_ENUM:
+            [[fallthrough]];
+        case JAVA_TYPE_FLOAT:
+            return 5;
+        case JAVA_TYPE_LONG:
+            return 9;
+        default:
+            return 0;
+    }
+}
 
-        // First two args form the attribution node so size goes down by 1.
-        newSignature.reserve(signature.size() - 1);
+// Returns an upper bound on the encoded size of an event with the given signature, or 0 if the
+// signature has fields of variable size.
+static size_t get_max_encoded_size(const vector<java_type_t>& signature,
+                                   const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet,
+                                   const AtomDecl* atomDecl) {
+    size_t size = ENCODED_HEADER_SIZE;
+    for (const java_type_t& arg : signature) {
+        const size_t fieldSize = get_fixed_field_encoded_size(arg);
+        if (fieldSize == 0) {
+            return 0;
+        }
+        size += fieldSize;
+    }
+    if (atomDecl != nullptr) {
+        for (const auto& [_, annotations] : atomDecl->fieldNumberToAnnotations) {
+            size += get_annotations_encoded_size(annotations);
+        }
+    } else {
+        // Only the annotations of one atom are written for each field.
+        for (const auto& [fieldNumber, atomDeclSet] : fieldNumberToAtomDeclSet) {
+            size_t maxAnnotationsSize = 0;
+            for (const shared_ptr<AtomDecl>& fieldAtomDecl : atomDeclSet) {
+                maxAnnotationsSize = std::max(
+                        maxAnnotationsSize,
+                        get_annotations_encoded_size(
+                                fieldAtomDecl->fieldNumberToAnnotations.at(fieldNumber)));
+            }
+            size += maxAnnotationsSize;
+        }
+    }
+    // An event with errors is replaced with one that only has the header and an error field.
+    return std::max(size, ENCODED_HEADER_SIZE + 5);
+}
 
-        // First arg is Attribution Chain.
-        newSignature.push_back(JAVA_TYPE_ATTRIBUTION_CHAIN);
+// Returns the encoded size of an element of a repeated field of the given type.
+static size_t get_repeated_element_encoded_size(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_BOOLEAN_ARRAY:
+            return 1;
+        case JAVA_TYPE_INT_ARRAY:
+            [[fallthrough]];
+        case JAVA_TYPE_ENUM_ARRAY:
+            [[fallthrough]];
+        case JAVA_TYPE_FLOAT_ARRAY:
+            return 4;
+        case JAVA_TYPE_LONG_ARRAY:
+            return 8;
+        default:
+            // Strings and the uid and tag of attribution nodes.
+            return 8 + STRING_SIZE_ESTIMATE;
+    }
+}
 
-        // Followed by the originial signature except the first 2 args.
-        newSignature.insert(newSignature.end(), signature.begin() + 2, signature.end());
+// Returns an upper bound on the encoded size of an event of atomDecl, assuming that its strings
+// and byte arrays are at most STRING_SIZE_ESTIMATE bytes long and that its attribution chain and
+// repeated fields have at most REPEATED_FIELD_LENGTH_ESTIMATE elements. The bound is capped at
+// the largest event.
+static size_t get_max_encoded_size_estimate(const AtomDecl& atomDecl) {
+    size_t size = ENCODED_HEADER_SIZE;
+    for (const java_type_t& arg : get_atom_signature(atomDecl)) {
+        const size_t fieldSize = get_fixed_field_encoded_size(arg);
+        if (fieldSize != 0) {
+            size += fieldSize;
+        } else if (arg == JAVA_TYPE_STRING || arg == JAVA_TYPE_BYTE_ARRAY) {
+            // Type id and length, then the bytes.
+            size += 5 + STRING_SIZE_ESTIMATE;
+        } else {
+            // Type id and element count, and the element type id of repeated fields.
+            size += 3 + REPEATED_FIELD_LENGTH_ESTIMATE * get_repeated_element_encoded_size(arg);
+        }
+    }
+    for (const auto& [_, annotations] : atomDecl.fieldNumberToAnnotations) {
+        size += get_annotations_encoded_size(annotations);
+    }
+    return std::min(size, STATS_EVENT_BUFFER_MAX_PAYLOAD);
+}
 
-        const char* uidName = attributionDecl.fields.front().name.c_str();
-        const char* tagName = attributionDecl.fields.back().name.c_str();
-        fprintf(out, "    const int32_t* %s = &arg1;\n", uidName);
-        fprintf(out, "    const size_t %s_length = 1;\n", uidName);
-        fprintf(out, "    const std::vector<char const*> %s(1, arg2);\n", tagName);
-        fprintf(out, "    return ");
-        write_native_method_call(out, "stats_write", newSignature, attributionDecl, 2);
+static string get_max_encoded_size_constant_name(const AtomDecl& atomDecl) {
+    return make_constant_name(atomDecl.name) + "_MAX_ENCODED_SIZE";
+}
 
-        fprintf(out, "}\n\n");
+static void write_native_pulled_atom_sizes_header(FILE* out, const Atoms& atoms) {
+    fprintf(out, "// Upper bound on the encoded size of one event of each pulled atom.\n");
+    fprintf(out, "// Strings and byte arrays are assumed to be at most %zu bytes long, and\n",
+            STRING_SIZE_ESTIMATE);
+    fprintf(out, "// attribution chains and repeated fields to have at most %zu elements.\n",
+            REPEATED_FIELD_LENGTH_ESTIMATE);
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        if (atomDecl->atomType == ATOM_TYPE_PULLED) {
+            fprintf(out, "const size_t %s = %zu;\n",
+                    get_max_encoded_size_constant_name(*atomDecl).c_str(),
+                    get_max_encoded_size_estimate(*atomDecl));
+        }
     }
+    fprintf(out, "\n");
+    fprintf(out, "// Returns the bytes needed by rowCount events of the pulled atom with this\n");
+    fprintf(out, "// code, so that pull callbacks can size their buffers once for the expected\n");
+    fprintf(out, "// rows.\n");
+    fprintf(out, "size_t getPulledAtomsEncodedSize(int32_t code, size_t rowCount);\n");
+    fprintf(out, "\n");
 }
 
-static int write_native_build_stats_event_methods(FILE* out,
-                                                  const SignatureInfoMap& signatureInfoMap,
-                                                  const AtomDecl& attributionDecl,
-                                                  const int minApiLevel) {
-    fprintf(out, "\n");
-    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
-        write_native_method_signature(out, "void addAStatsEvent(AStatsEventList* pulled_data, ",
-                                      signature, attributionDecl, " {");
+static const size_t ATOM_INDEX_PAGE_SIZE = 256;
 
-        fprintf(out, "    AStatsEvent* event = AStatsEventList_addStatsEvent(pulled_data);\n");
-        int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet,
-                                           attributionDecl, minApiLevel);
-        if (ret != 0) {
-            return ret;
+static const char* get_atom_field_type_name(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_ATTRIBUTION_CHAIN:
+            return "ATOM_FIELD_TYPE_ATTRIBUTION_CHAIN";
+        case JAVA_TYPE_BOOLEAN:
+            return "ATOM_FIELD_TYPE_BOOL";
+        case JAVA_TYPE_INT:
+            return "ATOM_FIELD_TYPE_INT32";
+        case JAVA_TYPE_LONG:
+            return "ATOM_FIELD_TYPE_INT64";
+        case JAVA_TYPE_FLOAT:
+            return "ATOM_FIELD_TYPE_FLOAT";
+        case JAVA_TYPE_STRING:
+            return "ATOM_FIELD_TYPE_STRING";
+        case JAVA_TYPE_ENUM:
+            return "ATOM_FIELD_TYPE_ENUM";
+        case JAVA_TYPE_BYTE_ARRAY:
+            return "ATOM_FIELD_TYPE_BYTES";
+        case JAVA_TYPE_BOOLEAN_ARRAY:
+            return "ATOM_FIELD_TYPE_BOOL_ARRAY";
+        case JAVA_TYPE_INT_ARRAY:
+            return "ATOM_FIELD_TYPE_INT32_ARRAY";
+        case JAVA_TYPE_LONG_ARRAY:
+            return "ATOM_FIELD_TYPE_INT64_ARRAY";
+        case JAVA_TYPE_FLOAT_ARRAY:
+            return "ATOM_FIELD_TYPE_FLOAT_ARRAY";
+        case JAVA_TYPE_STRING_ARRAY:
+            return "ATOM_FIELD_TYPE_STRING_ARRAY";
+        case JAVA_TYPE_ENUM_ARRAY:
+            return "ATOM_FIELD_TYPE_ENUM_ARRAY";
+        default:
+            return "ATOM_FIELD_TYPE_UNKNOWN";
+    }
+}
+
+static string get_atom_flags(const AtomDecl& atomDecl) {
+    vector<string> flags;
+    if (atomDecl.atomType == ATOM_TYPE_PULLED) {
+        flags.push_back("ATOM_FLAG_PULLED");
+    }
+    if (atomDecl.restricted) {
+        flags.push_back("ATOM_FLAG_RESTRICTED");
+    }
+    if (atomDecl.exclusiveField != 0) {
+        flags.push_back("ATOM_FLAG_STATE");
+        if (atomDecl.nested) {
+            flags.push_back("ATOM_FLAG_STATE_NESTED");
+        }
+    }
+    if (!atomDecl.fieldNumberToAnnotations.empty()) {
+        flags.push_back("ATOM_FLAG_ANNOTATED");
+    }
+    const auto atomAnnotationsIt = atomDecl.fieldNumberToAnnotations.find(ATOM_ID_FIELD_NUMBER);
+    if (atomAnnotationsIt != atomDecl.fieldNumberToAnnotations.end()) {
+        for (const shared_ptr<Annotation>& annotation : atomAnnotationsIt->second) {
+            if (annotation->annotationId == ANNOTATION_ID_TRUNCATE_TIMESTAMP) {
+                flags.push_back("ATOM_FLAG_TRUNCATE_TIMESTAMP");
+            }
         }
-        fprintf(out, "    AStatsEvent_build(event);\n");  // end method body.
+    }
+    if (!atomDecl.fields.empty() && atomDecl.fields[0].javaType == JAVA_TYPE_ATTRIBUTION_CHAIN) {
+        flags.push_back("ATOM_FLAG_ATTRIBUTION_CHAIN");
+    }
 
-        fprintf(out, "}\n\n");  // end method.
+    if (flags.empty()) {
+        return "0";
     }
-    return 0;
+    string result = flags[0];
+    for (size_t i = 1; i < flags.size(); i++) {
+        result += " | " + flags[i];
+    }
+    return result;
 }
 
-int write_stats_log_cpp(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
-                        const string& cppNamespace, const string& importHeader,
-                        const int minApiLevel, bool bootstrap) {
-    // Print prelude
-    fprintf(out, "// This file is autogenerated\n");
+// Writes a constexpr registry of all atoms of the file. The atoms get dense indices in atom code
+// order, and codes map to indices through a two-level table of ATOM_INDEX_PAGE_SIZE codes per page.
+static void write_native_atom_registry(FILE* out, const Atoms& atoms) {
+    fprintf(out, "enum AtomFieldType : uint8_t {\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_UNKNOWN = 0,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_ATTRIBUTION_CHAIN = 1,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_BOOL = 2,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_INT32 = 3,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_INT64 = 4,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_FLOAT = 5,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_STRING = 6,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_ENUM = 7,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_BYTES = 8,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_BOOL_ARRAY = 9,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_INT32_ARRAY = 10,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_INT64_ARRAY = 11,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_FLOAT_ARRAY = 12,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_STRING_ARRAY = 13,\n");
+    fprintf(out, "    ATOM_FIELD_TYPE_ENUM_ARRAY = 14,\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_PULLED = 0x01;\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_RESTRICTED = 0x02;\n");
+    fprintf(out, "// The atom has an exclusive state field.\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_STATE = 0x04;\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_STATE_NESTED = 0x08;\n");
+    fprintf(out, "// The atom or one of its fields has annotations.\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_ANNOTATED = 0x10;\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_TRUNCATE_TIMESTAMP = 0x20;\n");
+    fprintf(out, "const uint32_t ATOM_FLAG_ATTRIBUTION_CHAIN = 0x40;\n");
+    fprintf(out, "\n");
+    fprintf(out, "// fieldTypes points at the fieldCount types of the fields of the atom.\n");
+    fprintf(out, "struct AtomInfo {\n");
+    fprintf(out, "    int32_t code;\n");
+    fprintf(out, "    const char* name;\n");
+    fprintf(out, "    const AtomFieldType* fieldTypes;\n");
+    fprintf(out, "    uint8_t fieldCount;\n");
+    fprintf(out, "    uint32_t flags;\n");
+    fprintf(out, "};\n");
     fprintf(out, "\n");
 
-    fprintf(out, "#include <%s>\n", importHeader.c_str());
-    if (!bootstrap) {
-        if (minApiLevel == API_Q) {
-            fprintf(out, "#include <StatsEventCompat.h>\n");
-        } else {
-            fprintf(out, "#include <stats_event.h>\n");
+    size_t fieldTypeCount = 0;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        fieldTypeCount += atomDecl->fields.size();
+    }
+    fprintf(out, "// The field types of all atoms, back to back.\n");
+    fprintf(out, "inline constexpr AtomFieldType ATOM_FIELD_TYPES[%zu] = {\n",
+            std::max<size_t>(1, fieldTypeCount));
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        if (atomDecl->fields.empty()) {
+            continue;
         }
-
-        if (minApiLevel > API_R) {
-            fprintf(out, "#include <stats_annotations.h>\n");
+        fprintf(out, "        // %s\n", atomDecl->name.c_str());
+        for (const AtomField& field : atomDecl->fields) {
+            fprintf(out, "        %s,\n", get_atom_field_type_name(field.javaType));
         }
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
 
-        if (minApiLevel > API_Q && !atoms.pulledAtomsSignatureInfoMap.empty()) {
-            fprintf(out, "#include <stats_pull_atom_callback.h>\n");
+    fprintf(out, "constexpr size_t ATOM_COUNT = %zu;\n", atoms.decls.size());
+    fprintf(out, "\n");
+    fprintf(out, "// The metadata of each atom at its dense index, in atom code order.\n");
+    fprintf(out, "inline constexpr AtomInfo ATOM_INFOS[%zu] = {\n",
+            std::max<size_t>(1, atoms.decls.size()));
+    map<int, int> atomIndices;
+    size_t fieldTypeOffset = 0;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        atomIndices.emplace(atomDecl->code, atomIndices.size());
+        fprintf(out, "        {%d, \"%s\", ATOM_FIELD_TYPES + %zu, %zu, %s},\n", atomDecl->code,
+                atomDecl->name.c_str(), fieldTypeOffset, atomDecl->fields.size(),
+                get_atom_flags(*atomDecl).c_str());
+        fieldTypeOffset += atomDecl->fields.size();
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+
+    // Page 0 is left empty, for the codes of pages without atoms.
+    const int maxCode = atomIndices.empty() ? 0 : atomIndices.rbegin()->first;
+    const size_t pageTableSize = maxCode / ATOM_INDEX_PAGE_SIZE + 1;
+    vector<size_t> pageTable(pageTableSize, 0);
+    size_t pageCount = 1;
+    for (const auto& [code, _] : atomIndices) {
+        if (pageTable[code / ATOM_INDEX_PAGE_SIZE] == 0) {
+            pageTable[code / ATOM_INDEX_PAGE_SIZE] = pageCount++;
         }
-    } else {
-        fprintf(out, "#include <StatsBootstrapAtomClient.h>\n");
-        fprintf(out, "#include <android/os/StatsBootstrapAtom.h>\n");
-        fprintf(out, "#include <utils/String16.h>\n");
+    }
+    vector<int> pages(pageCount * ATOM_INDEX_PAGE_SIZE, -1);
+    for (const auto& [code, index] : atomIndices) {
+        pages[pageTable[code / ATOM_INDEX_PAGE_SIZE] * ATOM_INDEX_PAGE_SIZE +
+              code % ATOM_INDEX_PAGE_SIZE] = index;
     }
 
+    fprintf(out, "const size_t ATOM_INDEX_PAGE_SIZE = %zu;\n", ATOM_INDEX_PAGE_SIZE);
     fprintf(out, "\n");
-    write_namespace(out, cppNamespace);
-
-    int ret = write_native_stats_write_methods(out, atoms.signatureInfoMap, attributionDecl,
-                                               minApiLevel, bootstrap);
-    if (ret != 0) {
-        return ret;
+    fprintf(out, "// The page of ATOM_INDEX_PAGES with the indices of each page of codes.\n");
+    fprintf(out, "inline constexpr uint16_t ATOM_INDEX_PAGE_TABLE[%zu] = {", pageTableSize);
+    for (size_t i = 0; i < pageTableSize; i++) {
+        fprintf(out, "%s%zu,", i % 16 == 0 ? "\n        " : " ", pageTable[i]);
     }
-    if (!bootstrap) {
-        write_native_stats_write_non_chained_methods(out, atoms.nonChainedSignatureInfoMap,
-                                                     attributionDecl);
-        ret = write_native_build_stats_event_methods(out, atoms.pulledAtomsSignatureInfoMap,
-                                                     attributionDecl, minApiLevel);
-        if (ret != 0) {
-            return ret;
+    fprintf(out, "\n};\n");
+    fprintf(out, "\n");
+    fprintf(out, "// The index of each code of a page, or -1 if no atom has that code.\n");
+    fprintf(out, "inline constexpr %s ATOM_INDEX_PAGES[%zu][ATOM_INDEX_PAGE_SIZE] = {\n",
+            atoms.decls.size() <= INT16_MAX ? "int16_t" : "int32_t", pageCount);
+    for (size_t page = 0; page < pageCount; page++) {
+        fprintf(out, "        {");
+        for (size_t i = 0; i < ATOM_INDEX_PAGE_SIZE; i++) {
+            fprintf(out, "%s%d,", i == 0 ? "" : i % 16 == 0 ? "\n         " : " ",
+                    pages[page * ATOM_INDEX_PAGE_SIZE + i]);
         }
+        fprintf(out, "},\n");
     }
-
-    // Print footer
+    fprintf(out, "};\n");
     fprintf(out, "\n");
-    write_closing_namespace(out, cppNamespace);
 
-    return 0;
+    fprintf(out, "// Returns the dense index of the atom with this code, or -1.\n");
+    fprintf(out, "constexpr int getAtomIndex(int32_t code) {\n");
+    fprintf(out, "    if (code < 0 || static_cast<size_t>(code) / ATOM_INDEX_PAGE_SIZE >= %zu) {\n",
+            pageTableSize);
+    fprintf(out, "        return -1;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const size_t page = ATOM_INDEX_PAGE_TABLE[code / ATOM_INDEX_PAGE_SIZE];\n");
+    fprintf(out, "    return ATOM_INDEX_PAGES[page][code %% ATOM_INDEX_PAGE_SIZE];\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Returns the metadata of the atom with this code, or nullptr.\n");
+    fprintf(out, "constexpr const AtomInfo* getAtomInfo(int32_t code) {\n");
+    fprintf(out, "    const int index = getAtomIndex(code);\n");
+    fprintf(out, "    return index < 0 ? nullptr : &ATOM_INFOS[index];\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
 }
 
-int write_stats_log_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
-                           const string& cppNamespace, const int minApiLevel, bool bootstrap) {
-    const bool includePull = !atoms.pulledAtomsSignatureInfoMap.empty() && !bootstrap;
-    write_native_header_preamble(out, cppNamespace, includePull);
-    write_native_atom_constants(out, atoms, attributionDecl);
-    write_native_atom_enums(out, atoms);
+// Writes is_compact_atom(), which selects the atoms whose events write small integers as varints:
+// the atoms named in the comma separated compactAtoms, or all atoms if it is empty.
+static void write_native_compact_atoms(FILE* out, const Atoms& atoms,
+                                       const string& compactAtoms) {
+    fprintf(out, "namespace {\n");
+    fprintf(out, "\n");
+    if (compactAtoms.empty()) {
+        fprintf(out, "inline bool is_compact_atom(uint32_t) {\n");
+        fprintf(out, "    return true;\n");
+        fprintf(out, "}\n");
+    } else {
+        const vector<string> names = Split(compactAtoms, ",");
+        const set<string> compactNames(names.begin(), names.end());
+        fprintf(out, "inline bool is_compact_atom(uint32_t atomId) {\n");
+        fprintf(out, "    switch (atomId) {\n");
+        for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+            if (compactNames.count(atomDecl->name) != 0) {
+                fprintf(out, "        case %s:\n", make_constant_name(atomDecl->name).c_str());
+            }
+        }
+        fprintf(out, "            return true;\n");
+        fprintf(out, "        default:\n");
+        fprintf(out, "            return false;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "}\n");
+    }
+    fprintf(out, "\n");
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+}
 
-    if (minApiLevel <= API_R) {
-        write_native_annotation_constants(out);
+static void write_native_pulled_atom_sizes(FILE* out, const Atoms& atoms) {
+    fprintf(out, "size_t getPulledAtomsEncodedSize(int32_t code, size_t rowCount) {\n");
+    fprintf(out, "    switch (code) {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        if (atomDecl->atomType == ATOM_TYPE_PULLED) {
+            fprintf(out, "        case %s:\n", make_constant_name(atomDecl->name).c_str());
+            fprintf(out, "            return rowCount * %s;\n",
+                    get_max_encoded_size_constant_name(*atomDecl).c_str());
+        }
     }
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return rowCount * %zu;\n", STATS_EVENT_BUFFER_MAX_PAYLOAD);
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
 
-    fprintf(out, "struct BytesField {\n");
+// Writes the bitmap of enabled pushed atoms, one bit per dense atom index. Unknown atom codes
+// are treated as enabled.
+static void write_native_atom_enable_bitmap(FILE* out, const Atoms& atoms) {
+    const map<int, int> atomIndices = get_pushed_atom_indices(atoms);
+    const size_t wordCount = std::max<size_t>(1, (atomIndices.size() + 63) / 64);
+
+    fprintf(out, "namespace {\n\n");
+    fprintf(out, "// All atoms start out enabled.\n");
+    fprintf(out, "std::atomic<uint64_t> sAtomEnableBitmap[%zu] = {", wordCount);
+    for (size_t i = 0; i < wordCount; i++) {
+        fprintf(out, "%s~0ull", i == 0 ? "" : ", ");
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline int get_atom_index(int32_t code) {\n");
+    fprintf(out, "    switch (code) {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        const auto atomIndexIt = atomIndices.find(atomDecl->code);
+        if (atomDecl->atomType == ATOM_TYPE_PUSHED && atomIndexIt != atomIndices.end()) {
+            fprintf(out, "        case %s:\n", make_constant_name(atomDecl->name).c_str());
+            fprintf(out, "            return %d;\n", atomIndexIt->second);
+        }
+    }
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return -1;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline bool is_atom_enabled(int32_t code) {\n");
+    fprintf(out, "    const int index = get_atom_index(code);\n");
+    fprintf(out, "    return index < 0 ||\n");
     fprintf(out,
-            "  BytesField(char const* array, size_t len) : arg(array), "
-            "arg_length(len) {}\n");
-    fprintf(out, "  char const* arg;\n");
-    fprintf(out, "  size_t arg_length;\n");
+            "           (sAtomEnableBitmap[index / 64].load(std::memory_order_relaxed) &\n");
+    fprintf(out, "            (1ull << (index %% 64))) != 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+    fprintf(out, "void setAtomEnabled(int32_t code, bool enabled) {\n");
+    fprintf(out, "    const int index = get_atom_index(code);\n");
+    fprintf(out, "    if (index < 0) {\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const uint64_t bit = 1ull << (index %% 64);\n");
+    fprintf(out, "    if (enabled) {\n");
+    fprintf(out,
+            "        sAtomEnableBitmap[index / 64].fetch_or(bit, std::memory_order_relaxed);\n");
+    fprintf(out, "    } else {\n");
+    fprintf(out,
+            "        sAtomEnableBitmap[index / 64].fetch_and(~bit, std::memory_order_relaxed);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "bool isAtomEnabled(int32_t code) {\n");
+    fprintf(out, "    return is_atom_enabled(code);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes the seeds and the entries of table as the arrays PREFIX_SEEDS and PREFIX_ENTRIES.
+static void write_native_name_hash_table(FILE* out, const string& prefix,
+                                         const NameHashTable& table) {
+    // Empty tables keep one unused entry, since C++ has no empty arrays.
+    fprintf(out, "const int32_t %s_SEEDS[] = {", prefix.c_str());
+    for (size_t i = 0; i < table.seeds.size(); i++) {
+        fprintf(out, "%s%d,", i % 16 == 0 ? "\n        " : " ", table.seeds[i]);
+    }
+    fprintf(out, "%s\n};\n", table.seeds.empty() ? "0," : "");
+    fprintf(out, "\n");
+    fprintf(out, "const NameHashEntry %s_ENTRIES[] = {\n", prefix.c_str());
+    for (size_t i = 0; i < table.names.size(); i++) {
+        fprintf(out, "        {\"%s\", %d},\n", table.names[i].c_str(), table.values[i]);
+    }
+    if (table.names.empty()) {
+        fprintf(out, "        {\"\", 0},\n");
+    }
     fprintf(out, "};\n");
     fprintf(out, "\n");
+}
 
-    // Print write methods
-    fprintf(out, "//\n");
-    fprintf(out, "// Write methods\n");
-    fprintf(out, "//\n");
-    write_native_method_header(out, "int stats_write(", atoms.signatureInfoMap, attributionDecl);
+static void write_native_name_lookup_header(FILE* out) {
+    fprintf(out, "// Returns the code of the atom with this constant name, such as\n");
+    fprintf(out, "// \"BLE_SCAN_STATE_CHANGED\", or -1 if there is none.\n");
+    fprintf(out, "int32_t getAtomCode(std::string_view name);\n");
     fprintf(out, "\n");
+    fprintf(out, "// Sets value to the enum value with this constant name, such as\n");
+    fprintf(out, "// \"BLE_SCAN_STATE_CHANGED__STATE__ON\". Returns false if there is none.\n");
+    fprintf(out, "bool getEnumValue(std::string_view name, int32_t* value);\n");
+    fprintf(out, "\n");
+}
 
-    // Attribution chains and pulled atoms are not supported for bootstrap processes.
-    if (!bootstrap) {
-        fprintf(out, "//\n");
-        fprintf(out, "// Write flattened methods\n");
-        fprintf(out, "//\n");
-        write_native_method_header(out, "int stats_write_non_chained(",
-                                   atoms.nonChainedSignatureInfoMap, attributionDecl);
-        fprintf(out, "\n");
+// Writes getAtomCode() and getEnumValue(), which look the names up in minimal perfect hash
+// tables built by build_name_hash_table().
+static void write_native_name_lookup(FILE* out, const Atoms& atoms) {
+    const NameHashTable atomNames = build_name_hash_table(get_atom_name_codes(atoms));
+    const NameHashTable enumNames = build_name_hash_table(get_enum_name_values(atoms));
 
-        // Print pulled atoms methods.
-        fprintf(out, "//\n");
-        fprintf(out, "// Add AStatsEvent methods\n");
-        fprintf(out, "//\n");
-        write_native_method_header(out, "void addAStatsEvent(AStatsEventList* pulled_data, ",
-                                   atoms.pulledAtomsSignatureInfoMap, attributionDecl);
-        fprintf(out, "\n");
+    fprintf(out, "namespace {\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct NameHashEntry {\n");
+    fprintf(out, "    const char* name;\n");
+    fprintf(out, "    int32_t value;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "uint32_t get_name_hash(std::string_view name, uint32_t seed) {\n");
+    fprintf(out, "    uint32_t hash = 0x%08x ^ seed;\n", NAME_HASH_OFFSET_BASIS);
+    fprintf(out, "    for (const char c : name) {\n");
+    fprintf(out, "        hash = (hash ^ static_cast<uint8_t>(c)) * 0x%08x;\n", NAME_HASH_PRIME);
+    fprintf(out, "    }\n");
+    fprintf(out, "    hash ^= hash >> 16;\n");
+    fprintf(out, "    hash *= 0x%08x;\n", NAME_HASH_MIX);
+    fprintf(out, "    hash ^= hash >> 15;\n");
+    fprintf(out, "    return hash;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Returns the entry of the name in a minimal perfect hash table, or nullptr.\n");
+    fprintf(out,
+            "const NameHashEntry* find_name(const int32_t* seeds, const NameHashEntry* entries, "
+            "size_t size,\n");
+    fprintf(out, "                               std::string_view name) {\n");
+    fprintf(out, "    if (size == 0) {\n");
+    fprintf(out, "        return nullptr;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const int32_t seed = seeds[get_name_hash(name, 0) %% size];\n");
+    fprintf(out, "    const size_t slot = seed < 0 ? -static_cast<int64_t>(seed) - 1\n");
+    fprintf(out, "                                 : get_name_hash(name, seed) %% size;\n");
+    fprintf(out, "    return name == entries[slot].name ? &entries[slot] : nullptr;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    write_native_name_hash_table(out, "ATOM_NAME", atomNames);
+    write_native_name_hash_table(out, "ENUM_NAME", enumNames);
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+    fprintf(out, "int32_t getAtomCode(std::string_view name) {\n");
+    fprintf(out,
+            "    const NameHashEntry* entry = find_name(ATOM_NAME_SEEDS, ATOM_NAME_ENTRIES, %zu, "
+            "name);\n",
+            atomNames.names.size());
+    fprintf(out, "    return entry == nullptr ? -1 : entry->value;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "bool getEnumValue(std::string_view name, int32_t* value) {\n");
+    fprintf(out,
+            "    const NameHashEntry* entry = find_name(ENUM_NAME_SEEDS, ENUM_NAME_ENTRIES, %zu, "
+            "name);\n",
+            enumNames.names.size());
+    fprintf(out, "    if (entry == nullptr) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    *value = entry->value;\n");
+    fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+static bool is_enum_field(const AtomField& field) {
+    return field.javaType == JAVA_TYPE_ENUM || field.javaType == JAVA_TYPE_ENUM_ARRAY;
+}
+
+static bool has_contiguous_values(const map<int, string>& enumValues) {
+    return !enumValues.empty() &&
+           static_cast<int64_t>(enumValues.rbegin()->first) - enumValues.begin()->first + 1 ==
+                   static_cast<int64_t>(enumValues.size());
+}
+
+static void write_native_enum_names_header(FILE* out) {
+    fprintf(out, "// Returns the name of the value of enum field fieldNumber of the atom with\n");
+    fprintf(out, "// this code, or nullptr if the field has no such value.\n");
+    fprintf(out,
+            "const char* getEnumValueName(int32_t code, int32_t fieldNumber, int32_t value);\n");
+    fprintf(out, "\n");
+}
+
+// Writes getEnumValueName(). Each distinct set of enum values gets one table, shared by all the
+// fields that use it: an array of names if its values are contiguous, or an array of values and
+// names sorted by value otherwise.
+static void write_native_enum_names(FILE* out, const Atoms& atoms) {
+    // The fields of an enum type share its values, so each type is only compared once.
+    map<const map<int, string>*, size_t> typeTables;
+    map<map<int, string>, size_t> tableIndices;
+    vector<const map<int, string>*> tables;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        for (const AtomField& field : atomDecl->fields) {
+            if (!is_enum_field(field) || typeTables.count(field.enumValues.get()) != 0) {
+                continue;
+            }
+            const auto [it, inserted] = tableIndices.emplace(*field.enumValues, tables.size());
+            if (inserted) {
+                tables.push_back(&it->first);
+            }
+            typeTables[field.enumValues.get()] = it->second;
+        }
+    }
+
+    if (tables.empty()) {
+        fprintf(out, "const char* getEnumValueName(int32_t, int32_t, int32_t) {\n");
+        fprintf(out, "    return nullptr;\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+        return;
+    }
+
+    fprintf(out, "namespace {\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct EnumValueName {\n");
+    fprintf(out, "    int32_t value;\n");
+    fprintf(out, "    const char* name;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "// names holds the names of minValue, minValue + 1, ... if it is set, and\n");
+    fprintf(out, "// values the values and names sorted by value otherwise.\n");
+    fprintf(out, "struct EnumNameTable {\n");
+    fprintf(out, "    int32_t minValue;\n");
+    fprintf(out, "    size_t size;\n");
+    fprintf(out, "    const char* const* names;\n");
+    fprintf(out, "    const EnumValueName* values;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (has_contiguous_values(*tables[i])) {
+            fprintf(out, "const char* const ENUM_NAMES_%zu[] = {\n", i);
+            for (const auto& [value, name] : *tables[i]) {
+                fprintf(out, "        \"%s\",\n", name.c_str());
+            }
+        } else {
+            fprintf(out, "const EnumValueName ENUM_VALUES_%zu[] = {\n", i);
+            for (const auto& [value, name] : *tables[i]) {
+                fprintf(out, "        {%d, \"%s\"},\n", value, name.c_str());
+            }
+        }
+        fprintf(out, "};\n");
+        fprintf(out, "\n");
+    }
+    fprintf(out, "const EnumNameTable ENUM_NAME_TABLES[] = {\n");
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (has_contiguous_values(*tables[i])) {
+            fprintf(out, "        {%d, %zu, ENUM_NAMES_%zu, nullptr},\n",
+                    tables[i]->begin()->first, tables[i]->size(), i);
+        } else {
+            fprintf(out, "        {0, %zu, nullptr, ENUM_VALUES_%zu},\n", tables[i]->size(), i);
+        }
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "const char* get_enum_value_name(const EnumNameTable& table, int32_t value) {\n");
+    fprintf(out, "    if (table.names != nullptr) {\n");
+    fprintf(out, "        const int64_t index = static_cast<int64_t>(value) - table.minValue;\n");
+    fprintf(out,
+            "        return index >= 0 && index < static_cast<int64_t>(table.size) ? "
+            "table.names[index]\n");
+    fprintf(out, "                                                                : nullptr;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    size_t low = 0;\n");
+    fprintf(out, "    size_t high = table.size;\n");
+    fprintf(out, "    while (low < high) {\n");
+    fprintf(out, "        const size_t mid = low + (high - low) / 2;\n");
+    fprintf(out, "        if (table.values[mid].value < value) {\n");
+    fprintf(out, "            low = mid + 1;\n");
+    fprintf(out, "        } else {\n");
+    fprintf(out, "            high = mid;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    return low < table.size && table.values[low].value == value ? "
+            "table.values[low].name\n");
+    fprintf(out, "                                                                : nullptr;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "const EnumNameTable* get_enum_name_table(int32_t code, int32_t fieldNumber) {\n");
+    fprintf(out, "    switch (code) {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        bool hasEnumFields = false;
+        for (size_t i = 0; i < atomDecl->fields.size(); i++) {
+            const AtomField& field = atomDecl->fields[i];
+            if (!is_enum_field(field)) {
+                continue;
+            }
+            if (!hasEnumFields) {
+                fprintf(out, "        case %s:\n", make_constant_name(atomDecl->name).c_str());
+                hasEnumFields = true;
+            }
+            fprintf(out, "            if (fieldNumber == %zu) {\n", i + 1);
+            fprintf(out, "                return &ENUM_NAME_TABLES[%zu];\n",
+                    typeTables.at(field.enumValues.get()));
+            fprintf(out, "            }\n");
+        }
+        if (hasEnumFields) {
+            fprintf(out, "            return nullptr;\n");
+        }
+    }
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return nullptr;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "const char* getEnumValueName(int32_t code, int32_t fieldNumber, int32_t value) {\n");
+    fprintf(out, "    const EnumNameTable* table = get_enum_name_table(code, fieldNumber);\n");
+    fprintf(out, "    return table == nullptr ? nullptr : get_enum_value_name(*table, value);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes the early return taken by write methods when their atom is disabled.
+static void write_native_atom_enabled_check(FILE* out, const AtomDecl* atomDecl) {
+    fprintf(out, "    if (!is_atom_enabled(%s)) {\n", get_atom_code_expression(atomDecl).c_str());
+    fprintf(out, "        return 0;\n");
+    fprintf(out, "    }\n");
+}
+
+static int write_native_stats_write_body(FILE* out, const vector<java_type_t>& signature,
+                                         const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet,
+                                         const AtomDecl* atomDecl,
+                                         const AtomDecl& attributionDecl, const int minApiLevel,
+                                         bool bootstrap, bool bufferEncoder,
+                                         bool atomEnableBitmap) {
+    if (atomEnableBitmap) {
+        write_native_atom_enabled_check(out, atomDecl);
+    }
+    if (bootstrap) {
+        fprintf(out, "    ::android::os::StatsBootstrapAtom atom;\n");
+        fprintf(out, "    atom.atomId = %s;\n", get_atom_code_expression(atomDecl).c_str());
+        FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
+                fieldNumberToAtomDeclSet.find(ATOM_ID_FIELD_NUMBER);
+        if (fieldNumberToAtomDeclSet.end() != fieldNumberToAtomDeclSetIt ||
+            (atomDecl != nullptr && !atomDecl->fieldNumberToAnnotations.empty())) {
+            fprintf(stderr, "Bootstrap atoms do not support annotations\n");
+            return 1;
+        }
+        // The values are constructed in place in a vector reserved for all of them, so that
+        // neither the vector nor the byte and string payloads are reallocated or copied.
+        fprintf(out, "    atom.values.reserve(%zu);\n", signature.size());
+        int argIndex = 1;
+        const char* atomVal = "::android::os::StatsBootstrapAtomValue::";
+        for (vector<java_type_t>::const_iterator arg = signature.begin();
+             arg != signature.end(); arg++) {
+            switch (*arg) {
+                case JAVA_TYPE_BYTE_ARRAY:
+                    fprintf(out,
+                            "    const uint8_t* arg%dbyte = reinterpret_cast<const "
+                            "uint8_t*>(arg%d.arg);\n",
+                            argIndex, argIndex);
+                    fprintf(out,
+                            "    atom.values.emplace_back(%smake<%sbytesValue>(arg%dbyte, "
+                            "arg%dbyte + arg%d.arg_length));\n",
+                            atomVal, atomVal, argIndex, argIndex, argIndex);
+                    break;
+                case JAVA_TYPE_BOOLEAN:
+                    fprintf(out, "    atom.values.emplace_back(%smake<%sboolValue>(arg%d));\n",
+                            atomVal, atomVal, argIndex);
+                    break;
+                case JAVA_TYPE_INT:  // Fall through.
+                case JAVA_TYPE_ENUM:
+                    fprintf(out, "    atom.values.emplace_back(%smake<%sintValue>(arg%d));\n",
+                            atomVal, atomVal, argIndex);
+                    break;
+                case JAVA_TYPE_FLOAT:
+                    fprintf(out, "    atom.values.emplace_back(%smake<%sfloatValue>(arg%d));\n",
+                            atomVal, atomVal, argIndex);
+                    break;
+                case JAVA_TYPE_LONG:
+                    fprintf(out, "    atom.values.emplace_back(%smake<%slongValue>(arg%d));\n",
+                            atomVal, atomVal, argIndex);
+                    break;
+                case JAVA_TYPE_STRING:
+                    // The String16 is constructed in the value from the UTF-8 string. The
+                    // conversion remains since stringValue is a UTF-16 string in the AIDL.
+                    fprintf(out,
+                            "    atom.values.emplace_back(%smake<%sstringValue>("
+                            "arg%d));\n",
+                            atomVal, atomVal, argIndex);
+                    break;
+                default:
+                    // Unsupported types: OBJECT, DOUBLE, ATTRIBUTION_CHAIN,
+                    // and all repeated fields
+                    fprintf(stderr, "Encountered unsupported type.\n");
+                    return 1;
+            }
+            FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
+                    fieldNumberToAtomDeclSet.find(argIndex);
+            if (fieldNumberToAtomDeclSet.end() != fieldNumberToAtomDeclSetIt) {
+                fprintf(stderr, "Bootstrap atoms do not support annotations\n");
+                return 1;
+            }
+            argIndex++;
+        }
+        fprintf(out,
+                "    bool success = "
+                "::android::os::stats::StatsBootstrapAtomClient::reportBootstrapAtom(atom);\n");
+        fprintf(out, "    return success? 0 : -1;\n");
+
+    } else if (minApiLevel == API_Q) {
+        int argIndex = 1;
+        fprintf(out, "    StatsEventCompat event;\n");
+        fprintf(out, "    event.setAtomId(%s);\n", get_atom_code_expression(atomDecl).c_str());
+        write_annotations(out, ATOM_ID_FIELD_NUMBER, fieldNumberToAtomDeclSet, atomDecl, "event.",
+                          "", minApiLevel);
+        for (vector<java_type_t>::const_iterator arg = signature.begin();
+             arg != signature.end(); arg++) {
+            switch (*arg) {
+                case JAVA_TYPE_ATTRIBUTION_CHAIN: {
+                    const char* uidName = attributionDecl.fields.front().name.c_str();
+                    const char* tagName = attributionDecl.fields.back().name.c_str();
+                    // StatsEventCompat only takes the tags as a std::vector.
+                    fprintf(out,
+                            "    event.writeAttributionChain(%s, %s_length, "
+                            "std::vector<char const*>(%s, %s + %s_length));\n",
+                            uidName, uidName, tagName, tagName, uidName);
+                    break;
+                }
+                case JAVA_TYPE_BYTE_ARRAY:
+                    fprintf(out, "    event.writeByteArray(arg%d.arg, arg%d.arg_length);\n",
+                            argIndex, argIndex);
+                    break;
+                case JAVA_TYPE_BOOLEAN:
+                    fprintf(out, "    event.writeBool(arg%d);\n", argIndex);
+                    break;
+                case JAVA_TYPE_INT:  // Fall through.
+                case JAVA_TYPE_ENUM:
+                    fprintf(out, "    event.writeInt32(arg%d);\n", argIndex);
+                    break;
+                case JAVA_TYPE_FLOAT:
+                    fprintf(out, "    event.writeFloat(arg%d);\n", argIndex);
+                    break;
+                case JAVA_TYPE_LONG:
+                    fprintf(out, "    event.writeInt64(arg%d);\n", argIndex);
+                    break;
+                case JAVA_TYPE_STRING:
+                    fprintf(out, "    event.writeString(arg%d);\n", argIndex);
+                    break;
+                default:
+                    // Unsupported types: OBJECT, DOUBLE, and all repeated
+                    // fields.
+                    fprintf(stderr, "Encountered unsupported type.\n");
+                    return 1;
+            }
+            write_annotations(out, argIndex, fieldNumberToAtomDeclSet, atomDecl, "event.", "",
+                              minApiLevel);
+            argIndex++;
+        }
+        fprintf(out, "    return event.writeToSocket();\n");  // end method body.
+    } else if (bufferEncoder) {
+        const size_t maxEncodedSize =
+                get_max_encoded_size(signature, fieldNumberToAtomDeclSet, atomDecl);
+        if (maxEncodedSize > 0 && maxEncodedSize <= STATS_EVENT_BUFFER_MAX_PAYLOAD) {
+            fprintf(out, "    uint8_t buffer[%zu];\n", maxEncodedSize);
+            fprintf(out, "    StatsEventBuffer event(buffer, sizeof(buffer));\n");
+        } else {
+            fprintf(out,
+                    "    StatsEventBuffer event(get_stats_event_thread_buffer(), "
+                    "STATS_EVENT_MAX_PAYLOAD);\n");
+        }
+        int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet, atomDecl,
+                                           attributionDecl, minApiLevel, "StatsEventBuffer_",
+                                           "&event", /*pointerArgs=*/true);
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "    return StatsEventBuffer_write(&event);\n");  // end method body.
+    } else {
+        fprintf(out, "    AStatsEvent* event = AStatsEvent_obtain();\n");
+        int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet, atomDecl,
+                                           attributionDecl, minApiLevel, "AStatsEvent_", "event",
+                                           /*pointerArgs=*/true);
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "    const int ret = AStatsEvent_write(event);\n");
+        fprintf(out, "    AStatsEvent_release(event);\n");
+        fprintf(out, "    return ret;\n");  // end method body.
+    }
+    return 0;
+}
+
+// Returns the atoms of a signature that have annotations on at least one field.
+static AtomDeclSet get_annotated_atoms(const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet) {
+    AtomDeclSet atomDeclSet;
+    for (const auto& [_, fieldAtomDeclSet] : fieldNumberToAtomDeclSet) {
+        atomDeclSet.insert(fieldAtomDeclSet.begin(), fieldAtomDeclSet.end());
+    }
+    return atomDeclSet;
+}
+
+// Writes a switch that forwards the atoms with annotations to their per-atom methods. Atoms
+// without annotations fall through to the unannotated body of the signature.
+static void write_native_per_atom_dispatch(FILE* out, const string& methodName,
+                                           const string& leadingArg,
+                                           const vector<java_type_t>& signature,
+                                           const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet,
+                                           const AtomDecl& attributionDecl, bool hasReturnValue,
+                                           VectorArgumentPassing passing,
+                                           bool stringViews = false) {
+    const AtomDeclSet atomDeclSet = get_annotated_atoms(fieldNumberToAtomDeclSet);
+    if (atomDeclSet.empty()) {
+        return;
+    }
+    // The tag views are only made for the atoms that take them.
+    const bool tagViews = stringViews && has_attribution_chain(signature);
+    fprintf(out, "    switch (code) {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atomDeclSet) {
+        fprintf(out, "        case %s:%s\n", make_constant_name(atomDecl->name).c_str(),
+                tagViews ? " {" : "");
+        if (tagViews) {
+            write_native_tag_views(out, signature, attributionDecl, passing, "            ");
+        }
+        fprintf(out, "            %s", hasReturnValue ? "return " : "");
+        write_native_method_call(out, atomDecl->name + "::" + methodName, leadingArg, signature,
+                                 attributionDecl, 1, passing, stringViews);
+        if (!hasReturnValue) {
+            fprintf(out, "            return;\n");
+        }
+        if (tagViews) {
+            fprintf(out, "        }\n");
+        }
+    }
+    fprintf(out, "        default:\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "    }\n");
+}
+
+static int write_native_stats_write_methods(FILE* out, const SignatureInfoMap& signatureInfoMap,
+                                            const AtomDecl& attributionDecl, const int minApiLevel,
+                                            bool bootstrap, bool perAtomMethods,
+                                            bool bufferEncoder, bool atomEnableBitmap,
+                                            bool stringViewArgs) {
+    fprintf(out, "\n");
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        if (has_vector_arguments(signature)) {
+            write_native_method_signature(out, "int stats_write(", signature, attributionDecl,
+                                          " {");
+            write_native_vector_arguments_forward(out, "stats_write", "code", signature,
+                                                  attributionDecl);
+        }
+        write_native_method_signature(out, "int stats_write(", signature, attributionDecl, " {",
+                                      /*isVendorAtomLogging=*/false, /*pointerArgs=*/true);
+
+        // Write method body.
+        int ret;
+        if (perAtomMethods) {
+            // Atoms with annotations are handled by their own methods, so the shared body does
+            // not need to check the atom code.
+            write_native_per_atom_dispatch(out, "stats_write", "", signature,
+                                           fieldNumberToAtomDeclSet, attributionDecl,
+                                           /*hasReturnValue=*/true, PASS_POINTERS, stringViewArgs);
+            ret = write_native_stats_write_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                nullptr, attributionDecl, minApiLevel, bootstrap,
+                                                bufferEncoder, atomEnableBitmap);
+        } else {
+            ret = write_native_stats_write_body(out, signature, fieldNumberToAtomDeclSet, nullptr,
+                                                attributionDecl, minApiLevel, bootstrap,
+                                                bufferEncoder, atomEnableBitmap);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "}\n\n");  // end method.
+    }
+    return 0;
+}
+
+static int write_native_stats_event_batch_write_methods(FILE* out,
+                                                       const SignatureInfoMap& signatureInfoMap,
+                                                       const AtomDecl& attributionDecl,
+                                                       const int minApiLevel,
+                                                       bool atomEnableBitmap) {
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        if (has_vector_arguments(signature)) {
+            write_native_method_signature(out, "int StatsEventBatch::stats_write(", signature,
+                                          attributionDecl, " {");
+            write_native_vector_arguments_forward(out, "stats_write", "code", signature,
+                                                  attributionDecl);
+        }
+        write_native_method_signature(out, "int StatsEventBatch::stats_write(", signature,
+                                      attributionDecl, " {", /*isVendorAtomLogging=*/false,
+                                      /*pointerArgs=*/true);
+        if (atomEnableBitmap) {
+            write_native_atom_enabled_check(out, nullptr);
+        }
+        fprintf(out,
+                "    StatsEventBuffer event = StatsEventBuffer_atBatchEnd(mBuffer, "
+                "mBufferSize);\n");
+        int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet, nullptr,
+                                           attributionDecl, minApiLevel, "StatsEventBuffer_",
+                                           "&event", /*pointerArgs=*/true);
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "    StatsEventBuffer_finish(&event);\n");
+        fprintf(out, "    return append(event.size, event.atomId);\n");
+        fprintf(out, "}\n\n");  // end method.
+    }
+    return 0;
+}
+
+static void write_native_stats_write_non_chained_methods(FILE* out,
+                                                         const SignatureInfoMap& signatureInfoMap,
+                                                         const AtomDecl& attributionDecl) {
+    fprintf(out, "\n");
+    for (const auto& [signature, _] : signatureInfoMap) {
+        write_native_method_signature(out, "int stats_write_non_chained(", signature,
+                                      attributionDecl, " {");
+
+        vector<java_type_t> newSignature;
+
+        // First two args form the attribution node so size goes down by 1.
+        newSignature.reserve(signature.size() - 1);
+
+        // First arg is Attribution Chain.
+        newSignature.push_back(JAVA_TYPE_ATTRIBUTION_CHAIN);
+
+        // Followed by the originial signature except the first 2 args.
+        newSignature.insert(newSignature.end(), signature.begin() + 2, signature.end());
+
+        const char* uidName = attributionDecl.fields.front().name.c_str();
+        const char* tagName = attributionDecl.fields.back().name.c_str();
+        fprintf(out, "    const int32_t* %s = &arg1;\n", uidName);
+        fprintf(out, "    const size_t %s_length = 1;\n", uidName);
+        fprintf(out, "    const std::array<char const*, 1> %s = {arg2};\n", tagName);
+        fprintf(out, "    return ");
+        write_native_method_call(out, "stats_write", "code", newSignature, attributionDecl, 2,
+                                 PASS_VECTOR_DATA);
+
+        fprintf(out, "}\n\n");
+    }
+}
+
+static int write_native_build_stats_event_body(
+        FILE* out, const vector<java_type_t>& signature,
+        const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet, const AtomDecl* atomDecl,
+        const AtomDecl& attributionDecl, const int minApiLevel) {
+    fprintf(out, "    AStatsEvent* event = AStatsEventList_addStatsEvent(pulled_data);\n");
+    int ret = write_native_method_body(out, signature, fieldNumberToAtomDeclSet, atomDecl,
+                                       attributionDecl, minApiLevel, "AStatsEvent_", "event",
+                                       /*pointerArgs=*/false);
+    if (ret != 0) {
+        return ret;
+    }
+    fprintf(out, "    AStatsEvent_build(event);\n");  // end method body.
+    return 0;
+}
+
+static int write_native_build_stats_event_methods(FILE* out,
+                                                  const SignatureInfoMap& signatureInfoMap,
+                                                  const AtomDecl& attributionDecl,
+                                                  const int minApiLevel, bool perAtomMethods) {
+    fprintf(out, "\n");
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        write_native_method_signature(out, "void addAStatsEvent(AStatsEventList* pulled_data, ",
+                                      signature, attributionDecl, " {");
+
+        int ret;
+        if (perAtomMethods) {
+            write_native_per_atom_dispatch(out, "addAStatsEvent", "pulled_data", signature,
+                                           fieldNumberToAtomDeclSet, attributionDecl,
+                                           /*hasReturnValue=*/false, PASS_VECTORS);
+            ret = write_native_build_stats_event_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                      nullptr, attributionDecl, minApiLevel);
+        } else {
+            ret = write_native_build_stats_event_body(out, signature, fieldNumberToAtomDeclSet,
+                                                      nullptr, attributionDecl, minApiLevel);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+
+        fprintf(out, "}\n\n");  // end method.
+    }
+    return 0;
+}
+
+// Returns the type of a column of values of a field, or nullptr if rows of the field type cannot
+// be passed as columns.
+static const char* get_column_type_name(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_BOOLEAN:
+            return "const bool*";
+        case JAVA_TYPE_INT:  // Fall through.
+        case JAVA_TYPE_ENUM:
+            return "const int32_t*";
+        case JAVA_TYPE_LONG:
+            return "const int64_t*";
+        case JAVA_TYPE_FLOAT:
+            return "const float*";
+        case JAVA_TYPE_STRING:
+            return "char const* const*";
+        case JAVA_TYPE_BYTE_ARRAY:
+            return "const BytesField*";
+        default:
+            return nullptr;
+    }
+}
+
+static bool is_columnar_signature(const vector<java_type_t>& signature) {
+    return std::all_of(signature.begin(), signature.end(),
+                       [](java_type_t type) { return get_column_type_name(type) != nullptr; });
+}
+
+// Writes the signature of the method that adds rowCount events of the same atom, with the values
+// of each field passed as a column.
+static void write_native_columnar_method_signature(FILE* out, const vector<java_type_t>& signature,
+                                                   const string& closer) {
+    fprintf(out,
+            "void addAStatsEvents(AStatsEventList* pulled_data, size_t rowCount, int32_t code");
+    int argIndex = 1;
+    for (const java_type_t& arg : signature) {
+        fprintf(out, ", %s arg%d", get_column_type_name(arg), argIndex);
+        argIndex++;
+    }
+    fprintf(out, ")%s\n", closer.c_str());
+}
+
+// Writes a loop that hands each row of the columns to methodName.
+static void write_native_row_loop(FILE* out, const string& methodName, const string& leadingArgs,
+                                  const vector<java_type_t>& signature, const string& indent) {
+    fprintf(out, "%sfor (size_t i = 0; i < rowCount; i++) {\n", indent.c_str());
+    fprintf(out, "%s    %s(%s", indent.c_str(), methodName.c_str(), leadingArgs.c_str());
+    for (size_t argIndex = 1; argIndex <= signature.size(); argIndex++) {
+        fprintf(out, ", arg%zu[i]", argIndex);
+    }
+    fprintf(out, ");\n");
+    fprintf(out, "%s}\n", indent.c_str());
+}
+
+// Writes the columnar addAStatsEvents methods of the pulled atoms. The atom code is checked once
+// per call instead of once per field of each row: atoms with annotations get a row method of
+// their own that writes them unconditionally, and the other atoms share one without annotations.
+static int write_native_columnar_build_stats_event_methods(FILE* out,
+                                                           const SignatureInfoMap& signatureInfoMap,
+                                                           const AtomDecl& attributionDecl,
+                                                           const int minApiLevel) {
+    const string rowMethodPrefix = "inline void add_stats_event_row(AStatsEventList* pulled_data, ";
+    fprintf(out, "namespace {\n\n");
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        if (!is_columnar_signature(signature)) {
+            continue;
+        }
+        write_native_method_signature(out, rowMethodPrefix, signature, attributionDecl, " {");
+        int ret = write_native_build_stats_event_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                      nullptr, attributionDecl, minApiLevel);
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "}\n\n");
+        for (const shared_ptr<AtomDecl>& atomDecl : get_annotated_atoms(fieldNumberToAtomDeclSet)) {
+            fprintf(out, "inline void add_%s_row(AStatsEventList* pulled_data%s",
+                    atomDecl->name.c_str(), signature.empty() ? "" : ", ");
+            write_native_method_arguments(out, signature, attributionDecl);
+            fprintf(out, ") {\n");
+            ret = write_native_build_stats_event_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                      atomDecl.get(), attributionDecl,
+                                                      minApiLevel);
+            if (ret != 0) {
+                return ret;
+            }
+            fprintf(out, "}\n\n");
+        }
+    }
+    fprintf(out, "}  // namespace\n\n");
+
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        if (!is_columnar_signature(signature)) {
+            continue;
+        }
+        write_native_columnar_method_signature(out, signature, " {");
+        const AtomDeclSet atomDeclSet = get_annotated_atoms(fieldNumberToAtomDeclSet);
+        if (!atomDeclSet.empty()) {
+            fprintf(out, "    switch (code) {\n");
+            for (const shared_ptr<AtomDecl>& atomDecl : atomDeclSet) {
+                fprintf(out, "        case %s:\n", make_constant_name(atomDecl->name).c_str());
+                write_native_row_loop(out, "add_" + atomDecl->name + "_row", "pulled_data",
+                                      signature, "            ");
+                fprintf(out, "            return;\n");
+            }
+            fprintf(out, "        default:\n");
+            fprintf(out, "            break;\n");
+            fprintf(out, "    }\n");
+        }
+        write_native_row_loop(out, "add_stats_event_row", "pulled_data, code", signature, "    ");
+        fprintf(out, "}\n\n");  // end method.
+    }
+    return 0;
+}
+
+// Writes the start of the per-atom method for atomDecl, up to and including the opening brace.
+// Pushed atoms get a stats_write method, pulled atoms an addAStatsEvent method.
+static void write_native_per_atom_method_signature(FILE* out, const AtomDecl& atomDecl,
+                                                   const vector<java_type_t>& signature,
+                                                   const AtomDecl& attributionDecl,
+                                                   const string& closer, bool pointerArgs = false,
+                                                   bool stringViews = false) {
+    if (atomDecl.atomType == ATOM_TYPE_PUSHED) {
+        fprintf(out, "int stats_write(");
+    } else {
+        fprintf(out, "void addAStatsEvent(AStatsEventList* pulled_data%s",
+                signature.empty() ? "" : ", ");
+    }
+    write_native_method_arguments(out, signature, attributionDecl,
+                                  /*isVendorAtomLogging=*/false, pointerArgs, stringViews);
+    fprintf(out, ")%s\n", closer.c_str());
+}
+
+// Returns true if repeated writes of the same state of atomDecl can be dropped on the client.
+// Nested state atoms are excluded because statsd counts their repeated states. So are atoms with
+// fields besides the primary fields and the state, including attribution chains, since a write
+// that repeats the state can change those.
+static bool is_state_dedup_atom(const AtomDecl& atomDecl) {
+    if (atomDecl.atomType != ATOM_TYPE_PUSHED || atomDecl.exclusiveField == 0 ||
+        atomDecl.nested) {
+        return false;
+    }
+    switch (atomDecl.fields[atomDecl.exclusiveField - 1].javaType) {
+        case JAVA_TYPE_INT:
+        case JAVA_TYPE_ENUM:
+        case JAVA_TYPE_BOOLEAN:
+            break;
+        default:
+            return false;
+    }
+    if (atomDecl.fields.size() != atomDecl.primaryFields.size() + 1) {
+        return false;
+    }
+    for (const int primaryField : atomDecl.primaryFields) {
+        if (primaryField == FIRST_UID_IN_CHAIN_ID) {
+            return false;
+        }
+        switch (atomDecl.fields[primaryField - 1].javaType) {
+            case JAVA_TYPE_INT:
+            case JAVA_TYPE_ENUM:
+            case JAVA_TYPE_LONG:
+            case JAVA_TYPE_BOOLEAN:
+            case JAVA_TYPE_FLOAT:
+            case JAVA_TYPE_STRING:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static void write_native_state_cache_helpers(FILE* out, bool stringViewArgs) {
+    fprintf(out, "namespace {\n\n");
+    fprintf(out, "// Remembers the last exclusive state written for each primary key of a state\n");
+    fprintf(out, "// atom, so that writes of an unchanged state are dropped before they are\n");
+    fprintf(out, "// encoded. An entry holds a hash of the key and the state, and is updated\n");
+    fprintf(out, "// with a single atomic exchange, so writers on different threads never\n");
+    fprintf(out, "// wait for each other. A thread local cache would not do: the last state of\n");
+    fprintf(out, "// a key is the one written last by any thread. Keys that map to the same\n");
+    fprintf(out, "// entry evict each other, which only costs a redundant write. 0 is no state.\n");
+    fprintf(out, "constexpr size_t STATE_CACHE_SIZE = %zu;\n", STATE_CACHE_SIZE);
+    fprintf(out, "\n");
+    fprintf(out, "struct StateCache {\n");
+    fprintf(out, "    std::atomic<uint64_t> entries[STATE_CACHE_SIZE];\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Part of every entry, so that resetStateCaches() forgets all of them.\n");
+    fprintf(out, "std::atomic<uint64_t> sStateCacheGeneration(0);\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline uint64_t mix_state_key(uint64_t key, uint64_t value) {\n");
+    fprintf(out, "    key = (key ^ value) * 0x9e3779b97f4a7c15ull;\n");
+    fprintf(out, "    return key ^ (key >> 29);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline uint64_t mix_state_key(uint64_t key, float value) {\n");
+    fprintf(out, "    uint32_t bits;\n");
+    fprintf(out, "    memcpy(&bits, &value, sizeof(bits));\n");
+    fprintf(out, "    return mix_state_key(key, static_cast<uint64_t>(bits));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline uint64_t mix_state_key(uint64_t key, const char* value) {\n");
+    fprintf(out, "    if (value == nullptr) {\n");
+    fprintf(out, "        return mix_state_key(key, static_cast<uint64_t>(0));\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    for (; *value != '\\0'; value++) {\n");
+    fprintf(out, "        key = (key ^ static_cast<uint8_t>(*value)) * 0x100000001b3ull;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return mix_state_key(key, static_cast<uint64_t>(1));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (stringViewArgs) {
+        fprintf(out, "inline uint64_t mix_state_key(uint64_t key, std::string_view value) {\n");
+        fprintf(out, "    for (const char c : value) {\n");
+        fprintf(out, "        key = (key ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    return mix_state_key(key, static_cast<uint64_t>(1));\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+    fprintf(out,
+            "inline uint64_t get_state_cache_value(uint64_t key, int32_t state) {\n");
+    fprintf(out,
+            "    key = mix_state_key(key, static_cast<uint64_t>(static_cast<uint32_t>(state)));\n");
+    fprintf(out,
+            "    return mix_state_key(key, sStateCacheGeneration.load(std::memory_order_relaxed)) "
+            "| 1;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Records state for key. Returns false if it already was its last state.\n");
+    fprintf(out,
+            "inline bool update_state_cache(StateCache* cache, uint64_t key, int32_t state) "
+            "{\n");
+    fprintf(out, "    const uint64_t value = get_state_cache_value(key, state);\n");
+    fprintf(out,
+            "    return cache->entries[key %% STATE_CACHE_SIZE].exchange(value, "
+            "std::memory_order_relaxed) !=\n");
+    fprintf(out, "           value;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Forgets all states, after statsd was told to reset them.\n");
+    fprintf(out, "inline void reset_state_cache(StateCache* cache) {\n");
+    fprintf(out, "    for (std::atomic<uint64_t>& entry : cache->entries) {\n");
+    fprintf(out, "        entry.store(0, std::memory_order_relaxed);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+    fprintf(out, "void resetStateCaches() {\n");
+    fprintf(out, "    sStateCacheGeneration.fetch_add(1, std::memory_order_relaxed);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes the per-atom stats_write of a state atom, which drops writes of an unchanged state and
+// hands the others to the write_state method of the atom.
+static void write_native_state_dedup_method(FILE* out, const AtomDecl& atomDecl,
+                                            const vector<java_type_t>& signature,
+                                            const AtomDecl& attributionDecl,
+                                            bool atomEnableBitmap, bool stringViewArgs) {
+    fprintf(out, "static StateCache sStateCache;\n");
+    fprintf(out, "\n");
+    write_native_per_atom_method_signature(out, atomDecl, signature, attributionDecl, " {",
+                                           /*pointerArgs=*/true, stringViewArgs);
+    if (atomEnableBitmap) {
+        // A disabled atom must not update the cache, since its state never reaches statsd.
+        write_native_atom_enabled_check(out, &atomDecl);
+    }
+    fprintf(out, "    const int32_t state = static_cast<int32_t>(arg%d);\n",
+            atomDecl.exclusiveField);
+    if (atomDecl.triggerStateReset != INT_MAX) {
+        fprintf(out, "    if (state == %d) {\n", atomDecl.triggerStateReset);
+        fprintf(out, "        reset_state_cache(&sStateCache);\n");
+        fprintf(out, "        return ");
+        write_native_method_call(out, "write_state", "", signature, attributionDecl, 1,
+                                 PASS_POINTERS);
+        fprintf(out, "    }\n");
+    }
+    fprintf(out, "    uint64_t key = 0;\n");
+    for (const int primaryField : atomDecl.primaryFields) {
+        if (atomDecl.fields[primaryField - 1].javaType == JAVA_TYPE_FLOAT ||
+                   atomDecl.fields[primaryField - 1].javaType == JAVA_TYPE_STRING) {
+            fprintf(out, "    key = mix_state_key(key, arg%d);\n", primaryField);
+        } else {
+            fprintf(out, "    key = mix_state_key(key, static_cast<uint64_t>(arg%d));\n",
+                    primaryField);
+        }
+    }
+    fprintf(out, "    if (!update_state_cache(&sStateCache, key, state)) {\n");
+    fprintf(out, "        return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const int ret = ");
+    write_native_method_call(out, "write_state", "", signature, attributionDecl, 1,
+                             PASS_POINTERS);
+    // statsd may have lost all states if it could not take this one, for instance because it is
+    // restarting.
+    fprintf(out, "    if (ret < 0) {\n");
+    fprintf(out, "        resetStateCaches();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return ret;\n");
+    fprintf(out, "}\n\n");  // end method.
+}
+
+static int write_native_per_atom_methods(FILE* out, const Atoms& atoms,
+                                         const AtomDecl& attributionDecl, const int minApiLevel,
+                                         bool bootstrap, bool bufferEncoder,
+                                         bool atomEnableBitmap, bool stateDedup,
+                                         bool stringViewArgs) {
+    fprintf(out, "\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        // Pulled atoms are not supported for bootstrap processes.
+        if (bootstrap && atomDecl->atomType == ATOM_TYPE_PULLED) {
+            continue;
+        }
+        const vector<java_type_t> signature = get_atom_signature(*atomDecl);
+        const bool dedupState = stateDedup && is_state_dedup_atom(*atomDecl);
+        fprintf(out, "namespace %s {\n\n", atomDecl->name.c_str());
+        const bool isPushed = atomDecl->atomType == ATOM_TYPE_PUSHED;
+        if (isPushed && has_pointer_overload(signature, stringViewArgs)) {
+            write_native_per_atom_method_signature(out, *atomDecl, signature, attributionDecl,
+                                                   " {");
+            write_native_vector_arguments_forward(out, "stats_write", "", signature,
+                                                  attributionDecl, stringViewArgs);
+        }
+        if (dedupState) {
+            fprintf(out, "static int write_state(");
+            write_native_method_arguments(out, signature, attributionDecl,
+                                          /*isVendorAtomLogging=*/false, /*pointerArgs=*/true,
+                                          stringViewArgs);
+            fprintf(out, ") {\n");
+        } else {
+            write_native_per_atom_method_signature(out, *atomDecl, signature, attributionDecl,
+                                                   " {", /*pointerArgs=*/isPushed,
+                                                   stringViewArgs && isPushed);
+        }
+        int ret;
+        if (atomDecl->atomType == ATOM_TYPE_PUSHED) {
+            // With the state cache, the enabled check is done by the stats_write method.
+            ret = write_native_stats_write_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                atomDecl.get(), attributionDecl, minApiLevel,
+                                                bootstrap, bufferEncoder,
+                                                atomEnableBitmap && !dedupState);
+        } else {
+            ret = write_native_build_stats_event_body(out, signature, FieldNumberToAtomDeclSet(),
+                                                      atomDecl.get(), attributionDecl,
+                                                      minApiLevel);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        fprintf(out, "}\n\n");  // end method.
+        if (dedupState) {
+            write_native_state_dedup_method(out, *atomDecl, signature, attributionDecl,
+                                            atomEnableBitmap, stringViewArgs);
+        }
+        fprintf(out, "} // namespace %s\n\n", atomDecl->name.c_str());
+    }
+    return 0;
+}
+
+static void write_native_per_atom_method_header(FILE* out, const Atoms& atoms,
+                                                const AtomDecl& attributionDecl, bool bootstrap,
+                                                bool stringViewArgs) {
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        if (bootstrap && atomDecl->atomType == ATOM_TYPE_PULLED) {
+            continue;
+        }
+        const vector<java_type_t> signature = get_atom_signature(*atomDecl);
+        fprintf(out, "namespace %s {\n", atomDecl->name.c_str());
+        write_native_per_atom_method_signature(out, *atomDecl, signature, attributionDecl, ";");
+        if (atomDecl->atomType == ATOM_TYPE_PUSHED &&
+            has_pointer_overload(signature, stringViewArgs)) {
+            write_native_per_atom_method_signature(out, *atomDecl, signature, attributionDecl,
+                                                   ";", /*pointerArgs=*/true, stringViewArgs);
+        }
+        fprintf(out, "} // namespace %s\n", atomDecl->name.c_str());
+    }
+}
+
+static void write_native_atom_traits(FILE* out, const AtomDecl& atomDecl,
+                                     const AtomDecl& attributionDecl, bool stringViewArgs) {
+    const vector<java_type_t> signature = get_atom_signature(atomDecl);
+    const bool isPulled = atomDecl.atomType == ATOM_TYPE_PULLED;
+
+    size_t annotationCount = 0;
+    for (const auto& [fieldNumber, annotations] : atomDecl.fieldNumberToAnnotations) {
+        annotationCount += annotations.size();
+    }
+
+    fprintf(out, "template <>\n");
+    fprintf(out, "struct AtomTraits<%s> {\n", make_constant_name(atomDecl.name).c_str());
+    fprintf(out, "    static constexpr bool isPulled = %s;\n", isPulled ? "true" : "false");
+    fprintf(out, "    static constexpr size_t fieldCount = %zu;\n", atomDecl.fields.size());
+    fprintf(out, "    static constexpr size_t annotationCount = %zu;\n", annotationCount);
+    fprintf(out, "\n");
+    fprintf(out, "    static inline ");
+    write_native_per_atom_method_signature(out, atomDecl, signature, attributionDecl, " {");
+    if (isPulled) {
+        fprintf(out, "        ");
+        write_native_method_call(out, atomDecl.name + "::addAStatsEvent", "pulled_data",
+                                 signature, attributionDecl, 1);
+    } else {
+        fprintf(out, "        return ");
+        write_native_method_call(out, atomDecl.name + "::stats_write", "", signature,
+                                 attributionDecl, 1);
+    }
+    fprintf(out, "    }\n");
+    if (!isPulled && has_pointer_overload(signature, stringViewArgs)) {
+        fprintf(out, "\n");
+        fprintf(out, "    static inline ");
+        write_native_per_atom_method_signature(out, atomDecl, signature, attributionDecl, " {",
+                                               /*pointerArgs=*/true, stringViewArgs);
+        fprintf(out, "        return ");
+        write_native_method_call(out, atomDecl.name + "::stats_write", "", signature,
+                                 attributionDecl, 1, PASS_POINTERS);
+        fprintf(out, "    }\n");
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+}
+
+static void write_native_template_api(FILE* out, const Atoms& atoms,
+                                      const AtomDecl& attributionDecl, bool bootstrap,
+                                      bool stringViewArgs) {
+    fprintf(out, "template <int32_t Code>\n");
+    fprintf(out, "struct AtomTraits;\n");
+    fprintf(out, "\n");
+
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        // Pulled atoms are not supported for bootstrap processes.
+        if (bootstrap && atomDecl->atomType == ATOM_TYPE_PULLED) {
+            continue;
+        }
+        write_native_atom_traits(out, *atomDecl, attributionDecl, stringViewArgs);
+    }
+
+    fprintf(out, "template <int32_t Code, typename... Args>\n");
+    fprintf(out, "inline int stats_write(Args&&... args) {\n");
+    fprintf(out,
+            "    static_assert(!AtomTraits<Code>::isPulled, \"stats_write<>() is only for pushed "
+            "atoms\");\n");
+    fprintf(out, "    return AtomTraits<Code>::stats_write(static_cast<Args&&>(args)...);\n");
+    fprintf(out, "}\n");
+
+    if (!atoms.pulledAtomsSignatureInfoMap.empty() && !bootstrap) {
+        fprintf(out, "\n");
+        fprintf(out, "template <int32_t Code, typename... Args>\n");
+        fprintf(out, "inline void addAStatsEvent(AStatsEventList* pulled_data, Args&&... args) {\n");
+        fprintf(out,
+                "    static_assert(AtomTraits<Code>::isPulled, \"addAStatsEvent<>() is only for "
+                "pulled atoms\");\n");
+        fprintf(out,
+                "    AtomTraits<Code>::addAStatsEvent(pulled_data, "
+                "static_cast<Args&&>(args)...);\n");
+        fprintf(out, "}\n");
+    }
+}
+
+// Returns the signature groups of signatureInfoMap that go to the shard with this index. Each
+// signature goes to a shard picked by its hash, so that adding or removing a signature does not
+// move the others.
+static SignatureInfoMap get_shard_signatures(const SignatureInfoMap& signatureInfoMap,
+                                             int shardIndex, int shardCount) {
+    SignatureInfoMap shardSignatures;
+    for (const auto& [signature, fieldNumberToAtomDeclSet] : signatureInfoMap) {
+        string signatureKey;
+        for (const java_type_t type : signature) {
+            signatureKey += std::to_string(type) + ",";
+        }
+        if (static_cast<int>(get_name_hash(signatureKey, 0) % shardCount) == shardIndex) {
+            shardSignatures.emplace(signature, fieldNumberToAtomDeclSet);
+        }
+    }
+    return shardSignatures;
+}
+
+static void write_native_cpp_includes(FILE* out, const Atoms& atoms, const string& importHeader,
+                                      const int minApiLevel, bool bootstrap) {
+    // Print prelude
+    fprintf(out, "// This file is autogenerated\n");
+    fprintf(out, "\n");
+
+    fprintf(out, "#include <%s>\n", importHeader.c_str());
+    if (!bootstrap) {
+        if (!atoms.nonChainedSignatureInfoMap.empty()) {
+            fprintf(out, "#include <array>\n");
+        }
+        if (minApiLevel == API_Q) {
+            fprintf(out, "#include <StatsEventCompat.h>\n");
+        } else {
+            fprintf(out, "#include <stats_event.h>\n");
+        }
+
+        if (minApiLevel > API_R) {
+            fprintf(out, "#include <stats_annotations.h>\n");
+        }
+
+        if (minApiLevel > API_Q && !atoms.pulledAtomsSignatureInfoMap.empty()) {
+            fprintf(out, "#include <stats_pull_atom_callback.h>\n");
+        }
+    } else {
+        fprintf(out, "#include <StatsBootstrapAtomClient.h>\n");
+        fprintf(out, "#include <android/os/StatsBootstrapAtom.h>\n");
+        fprintf(out, "#include <utils/String16.h>\n");
+    }
+}
+
+// Writes the methods of the signature groups of a shard of --cppShards. These methods only call
+// methods declared in the header, so that the shards can be compiled separately.
+static int write_native_signature_methods(FILE* out, const Atoms& atoms,
+                                          const AtomDecl& attributionDecl, const int minApiLevel,
+                                          bool bootstrap, bool perAtomMethods,
+                                          bool stringViewArgs, bool columnarPulledAtoms,
+                                          int shardIndex, int shardCount) {
+    int ret = write_native_stats_write_methods(
+            out, get_shard_signatures(atoms.signatureInfoMap, shardIndex, shardCount),
+            attributionDecl, minApiLevel, bootstrap, perAtomMethods,
+            /*bufferEncoder=*/false, /*atomEnableBitmap=*/false, stringViewArgs);
+    if (ret != 0 || bootstrap) {
+        return ret;
+    }
+    write_native_stats_write_non_chained_methods(
+            out, get_shard_signatures(atoms.nonChainedSignatureInfoMap, shardIndex, shardCount),
+            attributionDecl);
+    const SignatureInfoMap pulledSignatures =
+            get_shard_signatures(atoms.pulledAtomsSignatureInfoMap, shardIndex, shardCount);
+    ret = write_native_build_stats_event_methods(out, pulledSignatures, attributionDecl,
+                                                 minApiLevel, perAtomMethods);
+    if (ret != 0) {
+        return ret;
+    }
+    if (columnarPulledAtoms) {
+        ret = write_native_columnar_build_stats_event_methods(out, pulledSignatures,
+                                                              attributionDecl, minApiLevel);
+    }
+    return ret;
+}
+
+int write_stats_log_cpp_shard(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                              const string& cppNamespace, const string& importHeader,
+                              const int minApiLevel, bool bootstrap, bool perAtomMethods,
+                              bool stringViewArgs, bool columnarPulledAtoms, int shardIndex,
+                              int shardCount) {
+    write_native_cpp_includes(out, atoms, importHeader, minApiLevel, bootstrap);
+    fprintf(out, "\n");
+    write_namespace(out, cppNamespace);
+
+    const int ret = write_native_signature_methods(out, atoms, attributionDecl, minApiLevel,
+                                                   bootstrap, perAtomMethods, stringViewArgs,
+                                                   columnarPulledAtoms, shardIndex, shardCount);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // Print footer
+    fprintf(out, "\n");
+    write_closing_namespace(out, cppNamespace);
+
+    return 0;
+}
+
+int write_stats_log_cpp(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                        const string& cppNamespace, const string& importHeader,
+                        const int minApiLevel, bool bootstrap, bool perAtomMethods,
+                        bool bufferEncoder, bool batchWriter, bool async, bool atomEnableBitmap,
+                        bool stateDedup, bool stringViewArgs, bool columnarPulledAtoms,
+                        bool pulledAtomSizes, bool spillFile, bool ringTransport,
+                        bool compactEncoding, const string& compactAtoms, bool nameLookup,
+                        bool enumNames, int cppShards) {
+    write_native_cpp_includes(out, atoms, importHeader, minApiLevel, bootstrap);
+    if (bufferEncoder) {
+        write_native_stats_event_buffer_includes(out, batchWriter, async, spillFile,
+                                                 ringTransport);
+    } else if (atomEnableBitmap) {
+        fprintf(out, "#include <atomic>\n");
+    }
+    if (stateDedup && !bufferEncoder) {
+        if (!atomEnableBitmap) {
+            fprintf(out, "#include <atomic>\n");
+        }
+        fprintf(out, "#include <string.h>\n");
+    }
+
+    fprintf(out, "\n");
+    write_namespace(out, cppNamespace);
+
+    if (compactEncoding) {
+        write_native_compact_atoms(out, atoms, compactAtoms);
+    }
+
+    if (bufferEncoder) {
+        write_native_stats_event_buffer_helpers(out, batchWriter, async, spillFile,
+                                                ringTransport, compactEncoding);
+    }
+
+    if (atomEnableBitmap) {
+        write_native_atom_enable_bitmap(out, atoms);
+    }
+
+    if (nameLookup) {
+        write_native_name_lookup(out, atoms);
+    }
+
+    if (enumNames) {
+        write_native_enum_names(out, atoms);
+    }
+
+    if (stateDedup) {
+        write_native_state_cache_helpers(out, stringViewArgs);
+    }
+
+    int ret;
+    if (perAtomMethods) {
+        ret = write_native_per_atom_methods(out, atoms, attributionDecl, minApiLevel, bootstrap,
+                                            bufferEncoder, atomEnableBitmap, stateDedup,
+                                            stringViewArgs);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    if (cppShards > 1) {
+        // The other shards are written by write_stats_log_cpp_shard().
+        ret = write_native_signature_methods(out, atoms, attributionDecl, minApiLevel, bootstrap,
+                                             perAtomMethods, stringViewArgs, columnarPulledAtoms,
+                                             /*shardIndex=*/0, cppShards);
+        if (ret != 0) {
+            return ret;
+        }
+    } else {
+        ret = write_native_stats_write_methods(out, atoms.signatureInfoMap, attributionDecl,
+                                               minApiLevel, bootstrap, perAtomMethods,
+                                               bufferEncoder, atomEnableBitmap, stringViewArgs);
+        if (ret != 0) {
+            return ret;
+        }
+        if (!bootstrap) {
+            write_native_stats_write_non_chained_methods(out, atoms.nonChainedSignatureInfoMap,
+                                                         attributionDecl);
+            ret = write_native_build_stats_event_methods(out, atoms.pulledAtomsSignatureInfoMap,
+                                                         attributionDecl, minApiLevel,
+                                                         perAtomMethods);
+            if (ret != 0) {
+                return ret;
+            }
+            if (columnarPulledAtoms) {
+                ret = write_native_columnar_build_stats_event_methods(
+                        out, atoms.pulledAtomsSignatureInfoMap, attributionDecl, minApiLevel);
+                if (ret != 0) {
+                    return ret;
+                }
+            }
+        }
+    }
+    if (!bootstrap && pulledAtomSizes) {
+        write_native_pulled_atom_sizes(out, atoms);
+    }
+
+    if (batchWriter) {
+        write_native_stats_event_batch_methods(out);
+        ret = write_native_stats_event_batch_write_methods(out, atoms.signatureInfoMap,
+                                                           attributionDecl, minApiLevel,
+                                                           atomEnableBitmap);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    // Print footer
+    fprintf(out, "\n");
+    write_closing_namespace(out, cppNamespace);
+
+    return 0;
+}
+
+// The API header of --splitHeader only includes what its declarations need. The atom codes are
+// only needed by the templated methods.
+static void write_native_api_header_preamble(FILE* out, const Atoms& atoms,
+                                             const string& cppNamespace, bool includePull,
+                                             bool includeStringView, const string& atomsHeader) {
+    bool includeVector = false;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        includeVector = includeVector || has_vector_arguments(get_atom_signature(*atomDecl));
+    }
+
+    fprintf(out, "// This file is autogenerated\n");
+    fprintf(out, "\n");
+    fprintf(out, "#pragma once\n");
+    fprintf(out, "\n");
+    fprintf(out, "#include <stddef.h>\n");
+    fprintf(out, "#include <stdint.h>\n");
+    if (includeVector) {
+        fprintf(out, "#include <vector>\n");
+    }
+    if (includeStringView) {
+        fprintf(out, "#include <string_view>\n");
+    }
+    if (!atomsHeader.empty()) {
+        fprintf(out, "\n");
+        fprintf(out, "#include \"%s\"\n", atomsHeader.c_str());
+    }
+    fprintf(out, "\n");
+    if (includePull) {
+        fprintf(out, "struct AStatsEventList;\n");
+        fprintf(out, "\n");
+    }
+
+    write_namespace(out, cppNamespace);
+    fprintf(out, "\n");
+    fprintf(out, "/*\n");
+    fprintf(out, " * API For logging statistics events.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "\n");
+}
+
+int write_stats_log_atoms_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                                 const string& cppNamespace) {
+    fprintf(out, "// This file is autogenerated\n");
+    fprintf(out, "\n");
+    fprintf(out, "#pragma once\n");
+    fprintf(out, "\n");
+    write_namespace(out, cppNamespace);
+    fprintf(out, "\n");
+    write_native_atom_constants(out, atoms, attributionDecl);
+    write_native_header_epilogue(out, cppNamespace);
+
+    return 0;
+}
+
+int write_stats_log_enums_header(FILE* out, const Atoms& atoms, const string& cppNamespace) {
+    fprintf(out, "// This file is autogenerated\n");
+    fprintf(out, "\n");
+    fprintf(out, "#pragma once\n");
+    fprintf(out, "\n");
+    fprintf(out, "#include <stdint.h>\n");
+    fprintf(out, "\n");
+    write_namespace(out, cppNamespace);
+    fprintf(out, "\n");
+    write_native_atom_enums(out, atoms);
+    write_native_header_epilogue(out, cppNamespace);
+
+    return 0;
+}
+
+int write_stats_log_split_header(FILE* out, const Atoms& atoms, bool bootstrap,
+                                 bool includeStringView, const vector<string>& headers) {
+    const bool includePull = !atoms.pulledAtomsSignatureInfoMap.empty() && !bootstrap;
+    write_native_header_includes(out, includePull, /*isVendorAtomLogging=*/false,
+                                 includeStringView);
+    for (const string& header : headers) {
+        fprintf(out, "#include \"%s\"\n", header.c_str());
+    }
+
+    return 0;
+}
+
+int write_stats_log_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                           const string& cppNamespace, const int minApiLevel, bool bootstrap,
+                           bool perAtomMethods, bool templateApi, bool bufferEncoder,
+                           bool batchWriter, bool async, bool atomEnableBitmap,
+                           bool stateDedup, bool stringViewArgs, bool columnarPulledAtoms,
+                           bool pulledAtomSizes, bool spillFile, bool ringTransport,
+                           bool compactEncoding, bool atomRegistry, bool nameLookup,
+                           bool enumNames, const string& atomsHeader) {
+    const bool includePull = !atoms.pulledAtomsSignatureInfoMap.empty() && !bootstrap;
+    if (atomsHeader.empty()) {
+        write_native_header_preamble(out, cppNamespace, includePull,
+                                     /*isVendorAtomLogging=*/false, stringViewArgs || nameLookup);
+        write_native_atom_constants(out, atoms, attributionDecl);
+        write_native_atom_enums(out, atoms);
+    } else {
+        write_native_api_header_preamble(out, atoms, cppNamespace, includePull,
+                                         stringViewArgs || nameLookup,
+                                         templateApi ? atomsHeader : "");
+    }
+
+    if (minApiLevel <= API_R) {
+        write_native_annotation_constants(out);
+    }
+
+    fprintf(out, "struct BytesField {\n");
+    fprintf(out,
+            "  BytesField(char const* array, size_t len) : arg(array), "
+            "arg_length(len) {}\n");
+    fprintf(out, "  char const* arg;\n");
+    fprintf(out, "  size_t arg_length;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+
+    // Print write methods
+    fprintf(out, "//\n");
+    fprintf(out, "// Write methods\n");
+    fprintf(out, "//\n");
+    write_native_method_header(out, "int stats_write(", atoms.signatureInfoMap, attributionDecl,
+                               /*isVendorAtomLogging=*/false, /*pointerOverloads=*/true);
+    fprintf(out, "\n");
+
+    // Attribution chains and pulled atoms are not supported for bootstrap processes.
+    if (!bootstrap) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Write flattened methods\n");
+        fprintf(out, "//\n");
+        write_native_method_header(out, "int stats_write_non_chained(",
+                                   atoms.nonChainedSignatureInfoMap, attributionDecl);
+        fprintf(out, "\n");
+
+        // Print pulled atoms methods.
+        fprintf(out, "//\n");
+        fprintf(out, "// Add AStatsEvent methods\n");
+        fprintf(out, "//\n");
+        write_native_method_header(out, "void addAStatsEvent(AStatsEventList* pulled_data, ",
+                                   atoms.pulledAtomsSignatureInfoMap, attributionDecl);
+        fprintf(out, "\n");
+
+        if (columnarPulledAtoms) {
+            fprintf(out, "//\n");
+            fprintf(out, "// Columnar add AStatsEvent methods\n");
+            fprintf(out, "//\n");
+            fprintf(out, "// Add rowCount events of the pulled atom with this code.\n");
+            fprintf(out, "// arg<N>[i] is the value of field N in row i.\n");
+            for (const auto& [signature, _] : atoms.pulledAtomsSignatureInfoMap) {
+                if (is_columnar_signature(signature)) {
+                    write_native_columnar_method_signature(out, signature, ";");
+                }
+            }
+            fprintf(out, "\n");
+        }
+
+        if (pulledAtomSizes) {
+            fprintf(out, "//\n");
+            fprintf(out, "// Pulled atom sizes\n");
+            fprintf(out, "//\n");
+            write_native_pulled_atom_sizes_header(out, atoms);
+        }
+    }
+
+    if (perAtomMethods) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Per-atom methods\n");
+        fprintf(out, "//\n");
+        write_native_per_atom_method_header(out, atoms, attributionDecl, bootstrap,
+                                            stringViewArgs);
+        fprintf(out, "\n");
+    }
+
+    if (bufferEncoder) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Event sink\n");
+        fprintf(out, "//\n");
+        write_native_stats_event_buffer_header(out, async, spillFile, ringTransport,
+                                               compactEncoding);
+    }
+
+    if (atomEnableBitmap) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Atom enable bitmap\n");
+        fprintf(out, "//\n");
+        fprintf(out, "// Enables or disables the logging of the pushed atom with this code.\n");
+        fprintf(out, "// Write methods of a disabled atom return 0 without encoding the event.\n");
+        fprintf(out, "void setAtomEnabled(int32_t code, bool enabled);\n");
+        fprintf(out, "\n");
+        fprintf(out, "bool isAtomEnabled(int32_t code);\n");
+        fprintf(out, "\n");
+    }
+
+    if (stateDedup) {
+        fprintf(out, "//\n");
+        fprintf(out, "// State dedup\n");
+        fprintf(out, "//\n");
+        fprintf(out, "// Forgets the last states of the state atoms, so that the next write of\n");
+        fprintf(out, "// each state reaches statsd. Call it when statsd restarts, since statsd\n");
+        fprintf(out, "// lost them.\n");
+        fprintf(out, "void resetStateCaches();\n");
+        fprintf(out, "\n");
+    }
+
+    if (batchWriter) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Batch writer\n");
+        fprintf(out, "//\n");
+        write_native_stats_event_batch_header_start(out);
+        write_native_method_header(out, "    int stats_write(", atoms.signatureInfoMap,
+                                   attributionDecl, /*isVendorAtomLogging=*/false,
+                                   /*pointerOverloads=*/true);
+        write_native_stats_event_batch_header_end(out);
+    }
+
+    if (templateApi) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Templated methods\n");
+        fprintf(out, "//\n");
+        write_native_template_api(out, atoms, attributionDecl, bootstrap, stringViewArgs);
+        fprintf(out, "\n");
+    }
+
+    if (atomRegistry) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Atom registry\n");
+        fprintf(out, "//\n");
+        write_native_atom_registry(out, atoms);
+    }
+
+    if (nameLookup) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Name lookup\n");
+        fprintf(out, "//\n");
+        write_native_name_lookup_header(out);
+    }
+
+    if (enumNames) {
+        fprintf(out, "//\n");
+        fprintf(out, "// Enum value names\n");
+        fprintf(out, "//\n");
+        write_native_enum_names_header(out);
     }
 
     write_native_header_epilogue(out, cppNamespace);
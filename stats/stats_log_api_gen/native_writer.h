@@ -27,10 +27,41 @@ namespace stats_log_api_gen {
 
 int write_stats_log_cpp(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
                         const string& cppNamespace, const string& importHeader,
-                        const int minApiLevel, bool bootstrap);
+                        const int minApiLevel, bool bootstrap, bool perAtomMethods,
+                        bool bufferEncoder, bool batchWriter, bool async, bool atomEnableBitmap,
+                        bool stateDedup, bool stringViewArgs, bool columnarPulledAtoms,
+                        bool pulledAtomSizes, bool spillFile, bool ringTransport,
+                        bool compactEncoding, const string& compactAtoms, bool nameLookup,
+                        bool enumNames, int cppShards);
+
+// Writes the methods of the signature groups of shard shardIndex of cppShards. The first shard
+// goes to the file written by write_stats_log_cpp(), with everything else.
+int write_stats_log_cpp_shard(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                              const string& cppNamespace, const string& importHeader,
+                              const int minApiLevel, bool bootstrap, bool perAtomMethods,
+                              bool stringViewArgs, bool columnarPulledAtoms, int shardIndex,
+                              int shardCount);
 
 int write_stats_log_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
-                           const string& cppNamespace, const int minApiLevel, bool bootstrap);
+                           const string& cppNamespace, const int minApiLevel, bool bootstrap,
+                           bool perAtomMethods, bool templateApi, bool bufferEncoder,
+                           bool batchWriter, bool async, bool atomEnableBitmap,
+                           bool stateDedup, bool stringViewArgs, bool columnarPulledAtoms,
+                           bool pulledAtomSizes, bool spillFile, bool ringTransport,
+                           bool compactEncoding, bool atomRegistry, bool nameLookup,
+                           bool enumNames, const string& atomsHeader);
+
+// The headers of --splitHeader. The atoms and enums headers hold the constants of the atom codes
+// and of the enum values. The API header, written by write_stats_log_header() with the name of the
+// atoms header, holds the rest of the declarations and includes only what they need. The split
+// header includes the headers and the standard headers of statslog.h, to stay compatible with it.
+int write_stats_log_atoms_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
+                                 const string& cppNamespace);
+
+int write_stats_log_enums_header(FILE* out, const Atoms& atoms, const string& cppNamespace);
+
+int write_stats_log_split_header(FILE* out, const Atoms& atoms, bool bootstrap,
+                                 bool includeStringView, const vector<string>& headers);
 
 }  // namespace stats_log_api_gen
 }  // namespace android
@@ -0,0 +1,1829 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "native_writer_buffer.h"
+
+#include "utils.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+void write_native_stats_event_buffer_includes(FILE* out, bool batchWriter, bool async,
+                                              bool spillFile, bool ringTransport) {
+    fprintf(out, "#include <errno.h>\n");
+    if (spillFile || ringTransport) {
+        fprintf(out, "#include <fcntl.h>\n");
+    }
+    if (ringTransport) {
+        fprintf(out, "#include <poll.h>\n");
+    }
+    fprintf(out, "#include <string.h>\n");
+    if (ringTransport) {
+        fprintf(out, "#include <sys/eventfd.h>\n");
+    }
+    if (spillFile) {
+        fprintf(out, "#include <sys/file.h>\n");
+    }
+    if (spillFile || ringTransport) {
+        fprintf(out, "#include <sys/mman.h>\n");
+    }
+    fprintf(out, "#include <sys/socket.h>\n");
+    if (ringTransport) {
+        fprintf(out, "#include <sys/stat.h>\n");
+    }
+    fprintf(out, "#include <sys/un.h>\n");
+    fprintf(out, "#include <time.h>\n");
+    fprintf(out, "#include <unistd.h>\n");
+    fprintf(out, "#include <atomic>\n");
+    fprintf(out, "#include <string_view>\n");
+    if (batchWriter) {
+        fprintf(out, "#include <sys/uio.h>\n");
+    }
+    if (async) {
+        fprintf(out, "#include <condition_variable>\n");
+        fprintf(out, "#include <mutex>\n");
+        fprintf(out, "#include <thread>\n");
+    } else if (spillFile || ringTransport) {
+        fprintf(out, "#include <mutex>\n");
+    }
+    fprintf(out, "#include <stats_buffer_writer.h>\n");
+}
+
+// Writes the sinks a StatsEventBatch hands its events to. By default each event is handed to the
+// event sink, which writes it through libstatssocket: the statsd socket, the header of its
+// datagrams and the accounting of dropped events are private to that library, so a batch cannot
+// be sent to statsd with one sendmmsg call without bypassing them. The stand-in socket gets the
+// whole batch in a single sendmmsg call.
+static void write_native_stats_event_batch_sinks(FILE* out) {
+    fprintf(out,
+            "typedef int (*StatsEventBatchSink)(const struct iovec* events, const uint32_t* "
+            "atomIds,\n");
+    fprintf(out, "                                   size_t count);\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline int write_batch_to_sink(const struct iovec* events, const uint32_t* "
+            "atomIds,\n");
+    fprintf(out, "                               size_t count) {\n");
+    fprintf(out, "    int ret = count;\n");
+    fprintf(out, "    for (size_t i = 0; i < count; i++) {\n");
+    fprintf(out,
+            "        const int eventRet = deliver_stats_event(\n");
+    fprintf(out, "                static_cast<const uint8_t*>(events[i].iov_base),\n");
+    fprintf(out, "                events[i].iov_len, atomIds[i]);\n");
+    fprintf(out, "        if (eventRet < 0) {\n");
+    fprintf(out, "            ret = eventRet;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return ret;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline int write_batch_to_stand_in_socket(const struct iovec* events, const "
+            "uint32_t*,\n");
+    fprintf(out, "                                          size_t count) {\n");
+    fprintf(out, "    struct mmsghdr messages[StatsEventBatch::MAX_EVENTS] = {};\n");
+    fprintf(out, "    for (size_t i = 0; i < count; i++) {\n");
+    fprintf(out,
+            "        messages[i].msg_hdr.msg_iov = const_cast<struct iovec*>(&events[i]);\n");
+    fprintf(out, "        messages[i].msg_hdr.msg_iovlen = 1;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const int fd = sStandInSocket.load(std::memory_order_relaxed);\n");
+    fprintf(out, "    size_t sent = 0;\n");
+    fprintf(out, "    while (sent < count) {\n");
+    fprintf(out,
+            "        const int ret = TEMP_FAILURE_RETRY(sendmmsg(fd, messages + sent, count - "
+            "sent,\n");
+    fprintf(out, "                                                    MSG_DONTWAIT));\n");
+    fprintf(out, "        if (ret < 0) {\n");
+    fprintf(out, "            return -errno;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        sent += ret;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return sent;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "std::atomic<StatsEventBatchSink> sStatsEventBatchSink(&write_batch_to_sink);\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "static_assert(StatsEventBatch::BUFFER_SIZE >= STATS_EVENT_MAX_PAYLOAD,\n");
+    fprintf(out, "              \"the batch buffer must hold the largest event\");\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Starts an event behind the events already in the batch buffer. The batch\n");
+    fprintf(out, "// is flushed once less than STATS_EVENT_MAX_PAYLOAD bytes remain, so there\n");
+    fprintf(out, "// is always room for the largest event.\n");
+    fprintf(out,
+            "inline StatsEventBuffer StatsEventBuffer_atBatchEnd(uint8_t* buffer, size_t size) "
+            "{\n");
+    fprintf(out, "    return StatsEventBuffer(buffer + size, STATS_EVENT_MAX_PAYLOAD);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes the queue that hands the events to the sink on a background thread.
+static void write_native_stats_event_queue(FILE* out) {
+    fprintf(out,
+            "// Bounded multi-producer, single-consumer queue of encoded events. Producers claim "
+            "the slots\n");
+    fprintf(out,
+            "// of an event with a compare-and-swap on the tail and publish them through the "
+            "sequence\n");
+    fprintf(out,
+            "// number of the first slot, so they never block on each other or on the drainer "
+            "thread.\n");
+    fprintf(out,
+            "// Each side stores its own state and loads the other's behind a seq_cst fence, so no "
+            "wakeup\n");
+    fprintf(out, "// of the drainer or of a flush is lost.\n");
+    fprintf(out, "//\n");
+    fprintf(out,
+            "// The bytes of the events are kept in a ring of STATS_EVENT_QUEUE_SLOT_SIZE chunks, "
+            "one per\n");
+    fprintf(out,
+            "// slot, and an event takes as many consecutive slots as it needs. The drainer frees "
+            "the\n");
+    fprintf(out,
+            "// slots in order, so all the slots of an event are free once its last one is.\n");
+    fprintf(out, "struct StatsEventQueueSlot {\n");
+    fprintf(out, "    std::atomic<size_t> sequence;\n");
+    fprintf(out, "    uint32_t atomId;\n");
+    fprintf(out, "    size_t size;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "const size_t STATS_EVENT_QUEUE_DATA_SIZE = STATS_EVENT_QUEUE_LENGTH * "
+            "STATS_EVENT_QUEUE_SLOT_SIZE;\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventQueue {\n");
+    fprintf(out, "    StatsEventQueueSlot slots[STATS_EVENT_QUEUE_LENGTH];\n");
+    fprintf(out, "    uint8_t data[STATS_EVENT_QUEUE_DATA_SIZE];\n");
+    fprintf(out, "    std::atomic<size_t> tail;\n");
+    fprintf(out, "    std::atomic<size_t> head;\n");
+    fprintf(out, "    std::atomic<uint64_t> droppedEvents;\n");
+    fprintf(out, "    std::atomic<bool> drainerStarted;\n");
+    fprintf(out, "    std::atomic<bool> drainerWaiting;\n");
+    fprintf(out, "    std::atomic<size_t> flushWaiters;\n");
+    fprintf(out, "    std::mutex drainerMutex;\n");
+    fprintf(out, "    std::condition_variable drainerCondition;\n");
+    fprintf(out, "    std::mutex flushMutex;\n");
+    fprintf(out, "    std::condition_variable flushCondition;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    StatsEventQueue()\n");
+    fprintf(out, "        : tail(0),\n");
+    fprintf(out, "          head(0),\n");
+    fprintf(out, "          droppedEvents(0),\n");
+    fprintf(out, "          drainerStarted(false),\n");
+    fprintf(out, "          drainerWaiting(false),\n");
+    fprintf(out, "          flushWaiters(0) {\n");
+    fprintf(out, "        for (size_t i = 0; i < STATS_EVENT_QUEUE_LENGTH; i++) {\n");
+    fprintf(out, "            slots[i].sequence.store(i, std::memory_order_relaxed);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline StatsEventQueue& get_stats_event_queue() {\n");
+    fprintf(out, "    static StatsEventQueue* queue = new StatsEventQueue();\n");
+    fprintf(out, "    return *queue;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline size_t get_stats_event_slot_count(size_t size) {\n");
+    fprintf(out,
+            "    return (size + STATS_EVENT_QUEUE_SLOT_SIZE - 1) / STATS_EVENT_QUEUE_SLOT_SIZE;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "void drain_stats_event_queue() {\n");
+    fprintf(out, "    StatsEventQueue& queue = get_stats_event_queue();\n");
+    fprintf(out, "    // Events that wrap around the end of the ring are copied here first.\n");
+    fprintf(out, "    uint8_t event[STATS_EVENT_MAX_PAYLOAD];\n");
+    fprintf(out, "    size_t head = queue.head.load(std::memory_order_relaxed);\n");
+    fprintf(out, "    while (true) {\n");
+    fprintf(out,
+            "        StatsEventQueueSlot& slot = queue.slots[head %% STATS_EVENT_QUEUE_LENGTH];\n");
+    fprintf(out, "        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {\n");
+    fprintf(out, "            std::unique_lock<std::mutex> lock(queue.drainerMutex);\n");
+    fprintf(out, "            queue.drainerWaiting.store(true, std::memory_order_seq_cst);\n");
+    fprintf(out, "            std::atomic_thread_fence(std::memory_order_seq_cst);\n");
+    fprintf(out, "            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {\n");
+    fprintf(out, "                queue.drainerCondition.wait(lock, [&queue] {\n");
+    fprintf(out,
+            "                    return !queue.drainerWaiting.load(std::memory_order_relaxed);\n");
+    fprintf(out, "                });\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            queue.drainerWaiting.store(false, std::memory_order_relaxed);\n");
+    fprintf(out, "            continue;\n");
+    fprintf(out, "        }\n");
+    fprintf(out,
+            "        const size_t offset = (head %% STATS_EVENT_QUEUE_LENGTH) * "
+            "STATS_EVENT_QUEUE_SLOT_SIZE;\n");
+    fprintf(out, "        const uint8_t* data = queue.data + offset;\n");
+    fprintf(out, "        if (offset + slot.size > STATS_EVENT_QUEUE_DATA_SIZE) {\n");
+    fprintf(out, "            const size_t firstSize = STATS_EVENT_QUEUE_DATA_SIZE - offset;\n");
+    fprintf(out, "            memcpy(event, data, firstSize);\n");
+    fprintf(out, "            memcpy(event + firstSize, queue.data, slot.size - firstSize);\n");
+    fprintf(out, "            data = event;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        deliver_stats_event(data, slot.size, slot.atomId);\n");
+    fprintf(out, "        const size_t slotCount = get_stats_event_slot_count(slot.size);\n");
+    fprintf(out, "        for (size_t i = 0; i < slotCount; i++) {\n");
+    fprintf(out,
+            "            queue.slots[(head + i) %% STATS_EVENT_QUEUE_LENGTH].sequence.store(\n");
+    fprintf(out,
+            "                    head + i + STATS_EVENT_QUEUE_LENGTH, "
+            "std::memory_order_release);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        head += slotCount;\n");
+    fprintf(out, "        queue.head.store(head, std::memory_order_release);\n");
+    fprintf(out, "        std::atomic_thread_fence(std::memory_order_seq_cst);\n");
+    fprintf(out, "        if (queue.flushWaiters.load(std::memory_order_relaxed) != 0) {\n");
+    fprintf(out, "            std::lock_guard<std::mutex> lock(queue.flushMutex);\n");
+    fprintf(out, "            queue.flushCondition.notify_all();\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void wake_stats_event_queue_drainer(StatsEventQueue& queue) {\n");
+    fprintf(out, "    if (!queue.drainerStarted.load(std::memory_order_acquire) &&\n");
+    fprintf(out, "        !queue.drainerStarted.exchange(true, std::memory_order_acq_rel)) {\n");
+    fprintf(out, "        std::thread(drain_stats_event_queue).detach();\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    std::atomic_thread_fence(std::memory_order_seq_cst);\n");
+    fprintf(out, "    if (queue.drainerWaiting.exchange(false, std::memory_order_seq_cst)) {\n");
+    fprintf(out, "        std::lock_guard<std::mutex> lock(queue.drainerMutex);\n");
+    fprintf(out, "        queue.drainerCondition.notify_one();\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Copies the finished event into the queue.\n");
+    fprintf(out, "inline int StatsEventBuffer_enqueue(const StatsEventBuffer* event) {\n");
+    fprintf(out, "    StatsEventQueue& queue = get_stats_event_queue();\n");
+    fprintf(out, "    const size_t slotCount = get_stats_event_slot_count(event->size);\n");
+    fprintf(out, "    size_t tail = queue.tail.load(std::memory_order_relaxed);\n");
+    fprintf(out, "    while (true) {\n");
+    fprintf(out, "        const size_t sequence =\n");
+    fprintf(out,
+            "                queue.slots[tail %% STATS_EVENT_QUEUE_LENGTH].sequence.load("
+            "std::memory_order_acquire);\n");
+    fprintf(out, "        const size_t last = tail + slotCount - 1;\n");
+    fprintf(out, "        if (sequence == tail) {\n");
+    fprintf(out,
+            "            if (queue.slots[last %% STATS_EVENT_QUEUE_LENGTH].sequence.load(\n");
+    fprintf(out, "                        std::memory_order_acquire) < last) {\n");
+    fprintf(out,
+            "                // The drainer has not freed the last slot yet, so the event does "
+            "not fit.\n");
+    fprintf(out, "                queue.droppedEvents.fetch_add(1, std::memory_order_relaxed);\n");
+    fprintf(out, "                return -ENOBUFS;\n");
+    fprintf(out, "            }\n");
+    fprintf(out,
+            "            if (queue.tail.compare_exchange_weak(tail, tail + slotCount,\n");
+    fprintf(out,
+            "                                                 std::memory_order_relaxed)) {\n");
+    fprintf(out, "                break;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "        } else if (sequence < tail) {\n");
+    fprintf(out, "            // The drainer has not freed this slot yet, so the queue is full.\n");
+    fprintf(out, "            queue.droppedEvents.fetch_add(1, std::memory_order_relaxed);\n");
+    fprintf(out, "            return -ENOBUFS;\n");
+    fprintf(out, "        } else {\n");
+    fprintf(out, "            tail = queue.tail.load(std::memory_order_relaxed);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    const size_t offset = (tail %% STATS_EVENT_QUEUE_LENGTH) * "
+            "STATS_EVENT_QUEUE_SLOT_SIZE;\n");
+    fprintf(out, "    size_t firstSize = STATS_EVENT_QUEUE_DATA_SIZE - offset;\n");
+    fprintf(out, "    if (firstSize > event->size) {\n");
+    fprintf(out, "        firstSize = event->size;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    memcpy(queue.data + offset, event->buf, firstSize);\n");
+    fprintf(out, "    memcpy(queue.data, event->buf + firstSize, event->size - firstSize);\n");
+    fprintf(out,
+            "    StatsEventQueueSlot& slot = queue.slots[tail %% STATS_EVENT_QUEUE_LENGTH];\n");
+    fprintf(out, "    slot.size = event->size;\n");
+    fprintf(out, "    slot.atomId = event->atomId;\n");
+    fprintf(out, "    slot.sequence.store(tail + 1, std::memory_order_release);\n");
+    fprintf(out, "    wake_stats_event_queue_drainer(queue);\n");
+    fprintf(out, "    return event->size;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "\n");
+}
+
+// Writes the spill file that keeps the events the sink fails to deliver, and the
+// deliver_stats_event function that hands the events to the sink and spills them on failure.
+static void write_native_stats_event_spill_file(FILE* out) {
+    fprintf(out, "// The spill file is a header followed by records of the atom id, the size\n");
+    fprintf(out, "// and the bytes of an event. Events are appended behind the last record, and\n");
+    fprintf(out, "// the records are read back in order when the sink takes events again.\n");
+    fprintf(out, "const uint32_t STATS_EVENT_SPILL_MAGIC = 0x4c505353;\n");
+    fprintf(out, "const size_t STATS_EVENT_SPILL_FILE_SIZE = %zu;\n", STATS_EVENT_SPILL_FILE_SIZE);
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventSpillHeader {\n");
+    fprintf(out, "    uint32_t magic;\n");
+    fprintf(out, "    uint32_t eventCount;\n");
+    fprintf(out, "    uint64_t size;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventSpillRecord {\n");
+    fprintf(out, "    uint32_t atomId;\n");
+    fprintf(out, "    uint32_t size;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "const size_t STATS_EVENT_SPILL_CAPACITY =\n");
+    fprintf(out, "        STATS_EVENT_SPILL_FILE_SIZE - sizeof(StatsEventSpillHeader);\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventSpillFile {\n");
+    fprintf(out, "    std::mutex mutex;\n");
+    fprintf(out, "    int fd;\n");
+    fprintf(out, "    uint8_t* data;\n");
+    fprintf(out, "    std::atomic<bool> pending;\n");
+    fprintf(out, "    std::atomic<uint64_t> droppedEvents;\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "    StatsEventSpillFile() : fd(-1), data(nullptr), pending(false), droppedEvents(0) "
+            "{}\n");
+    fprintf(out, "\n");
+    fprintf(out, "    StatsEventSpillHeader* header() {\n");
+    fprintf(out, "        return reinterpret_cast<StatsEventSpillHeader*>(data);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    uint8_t* records() {\n");
+    fprintf(out, "        return data + sizeof(StatsEventSpillHeader);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline StatsEventSpillFile& get_stats_event_spill_file() {\n");
+    fprintf(out, "    static StatsEventSpillFile* spillFile = new StatsEventSpillFile();\n");
+    fprintf(out, "    return *spillFile;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Appends the event to the spill file. Returns false if there is no spill\n");
+    fprintf(out, "// file or if it is full.\n");
+    fprintf(out,
+            "inline bool spill_stats_event_locked(StatsEventSpillFile& spillFile, const uint8_t* "
+            "buffer,\n");
+    fprintf(out, "                                     size_t size, uint32_t atomId) {\n");
+    fprintf(out, "    if (spillFile.data == nullptr) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventSpillHeader* header = spillFile.header();\n");
+    fprintf(out, "    const size_t recordSize = sizeof(StatsEventSpillRecord) + size;\n");
+    fprintf(out, "    if (header->size + recordSize > STATS_EVENT_SPILL_CAPACITY) {\n");
+    fprintf(out, "        spillFile.droppedEvents.fetch_add(1, std::memory_order_relaxed);\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    uint8_t* record = spillFile.records() + header->size;\n");
+    fprintf(out,
+            "    const StatsEventSpillRecord recordHeader = {atomId, static_cast<uint32_t>(size)};"
+            "\n");
+    fprintf(out, "    memcpy(record, &recordHeader, sizeof(recordHeader));\n");
+    fprintf(out, "    memcpy(record + sizeof(recordHeader), buffer, size);\n");
+    fprintf(out, "    // The header only counts the record once it is complete, so a process\n");
+    fprintf(out, "    // that dies while spilling never leaves a partial record behind.\n");
+    fprintf(out, "    header->size += recordSize;\n");
+    fprintf(out, "    header->eventCount++;\n");
+    fprintf(out, "    spillFile.pending.store(true, std::memory_order_release);\n");
+    fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline bool spill_stats_event(const uint8_t* buffer, size_t size, uint32_t atomId) "
+            "{\n");
+    fprintf(out, "    StatsEventSpillFile& spillFile = get_stats_event_spill_file();\n");
+    fprintf(out, "    std::lock_guard<std::mutex> lock(spillFile.mutex);\n");
+    fprintf(out, "    return spill_stats_event_locked(spillFile, buffer, size, atomId);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Hands the spilled events to sink in order, and removes the delivered ones\n");
+    fprintf(out, "// from the spill file. Stops at the first event that sink fails to take,\n");
+    fprintf(out, "// or at the first malformed record, which is truncated off the file.\n");
+    fprintf(out, "// Returns the number of events replayed, or the error of sink.\n");
+    fprintf(out,
+            "inline int replay_spilled_stats_events_locked(StatsEventSpillFile& spillFile,\n");
+    fprintf(out, "                                              StatsEventSink sink) {\n");
+    fprintf(out, "    if (spillFile.data == nullptr) {\n");
+    fprintf(out, "        return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventSpillHeader* header = spillFile.header();\n");
+    fprintf(out, "    uint8_t* records = spillFile.records();\n");
+    fprintf(out, "    size_t offset = 0;\n");
+    fprintf(out, "    int replayed = 0;\n");
+    fprintf(out, "    int ret = 0;\n");
+    fprintf(out, "    bool malformed = header->size > STATS_EVENT_SPILL_CAPACITY;\n");
+    fprintf(out, "    while (!malformed && offset < header->size) {\n");
+    fprintf(out, "        // The file outlives the process that wrote it, so each record is\n");
+    fprintf(out, "        // checked against the bounds of the spilled records. A malformed\n");
+    fprintf(out, "        // record and the records behind it are dropped.\n");
+    fprintf(out, "        const size_t remaining = header->size - offset;\n");
+    fprintf(out, "        StatsEventSpillRecord record;\n");
+    fprintf(out, "        if (remaining < sizeof(record)) {\n");
+    fprintf(out, "            malformed = true;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        memcpy(&record, records + offset, sizeof(record));\n");
+    fprintf(out,
+            "        if (record.size > STATS_EVENT_MAX_PAYLOAD || record.size > remaining - "
+            "sizeof(record)) {\n");
+    fprintf(out, "            malformed = true;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out,
+            "        ret = sink(records + offset + sizeof(record), record.size, record.atomId);\n");
+    fprintf(out, "        if (ret < 0) {\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        offset += sizeof(record) + record.size;\n");
+    fprintf(out, "        replayed++;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (malformed) {\n");
+    fprintf(out, "        header->size = offset;\n");
+    fprintf(out, "        header->eventCount = replayed;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    memmove(records, records + offset, header->size - offset);\n");
+    fprintf(out, "    header->size -= offset;\n");
+    fprintf(out, "    header->eventCount -= replayed;\n");
+    fprintf(out,
+            "    spillFile.pending.store(header->size != 0, std::memory_order_release);\n");
+    fprintf(out, "    return ret < 0 ? ret : replayed;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Hands the event to the sink. An event the sink fails to take is appended\n");
+    fprintf(out, "// to the spill file and counts as written. The spilled events are replayed\n");
+    fprintf(out, "// before the event, and it is spilled behind them if they do not all get\n");
+    fprintf(out, "// through, so the sink takes the events in the order they were written.\n");
+    fprintf(out,
+            "inline int deliver_stats_event(const uint8_t* buffer, size_t size, uint32_t "
+            "atomId) {\n");
+    fprintf(out,
+            "    const StatsEventSink sink = sStatsEventSink.load(std::memory_order_acquire);\n");
+    fprintf(out, "    StatsEventSpillFile& spillFile = get_stats_event_spill_file();\n");
+    fprintf(out, "    if (spillFile.pending.load(std::memory_order_acquire)) {\n");
+    fprintf(out, "        // Writers wait for a replay that is already running, since their\n");
+    fprintf(out, "        // events would otherwise overtake the spilled ones.\n");
+    fprintf(out, "        std::lock_guard<std::mutex> lock(spillFile.mutex);\n");
+    fprintf(out,
+            "        const int replayed = replay_spilled_stats_events_locked(spillFile, sink);\n");
+    fprintf(out, "        if (spillFile.pending.load(std::memory_order_relaxed)) {\n");
+    fprintf(out,
+            "            return spill_stats_event_locked(spillFile, buffer, size, atomId)\n");
+    fprintf(out, "                           ? static_cast<int>(size)\n");
+    fprintf(out, "                           : replayed;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const int ret = sink(buffer, size, atomId);\n");
+    fprintf(out, "    if (ret < 0) {\n");
+    fprintf(out,
+            "        return spill_stats_event(buffer, size, atomId) ? static_cast<int>(size) : "
+            "ret;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return ret;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+static void write_native_stats_event_spill_file_methods(FILE* out) {
+    fprintf(out, "int useStatsEventSpillFile(const char* path) {\n");
+    fprintf(out,
+            "    const int fd = TEMP_FAILURE_RETRY(open(path, O_RDWR | O_CREAT | O_CLOEXEC, "
+            "0600));\n");
+    fprintf(out, "    if (fd < 0) {\n");
+    fprintf(out, "        return -errno;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    // The mutex only serializes the threads of this process, so the file\n");
+    fprintf(out, "    // is locked for as long as it is used. Processes never share it.\n");
+    fprintf(out, "    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(fd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (ftruncate(fd, STATS_EVENT_SPILL_FILE_SIZE) != 0) {\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(fd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    void* mapping = mmap(nullptr, STATS_EVENT_SPILL_FILE_SIZE, PROT_READ | "
+            "PROT_WRITE,\n");
+    fprintf(out, "                         MAP_SHARED, fd, 0);\n");
+    fprintf(out, "    if (mapping == MAP_FAILED) {\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(fd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    // Events spilled by an earlier process are kept for the replay.\n");
+    fprintf(out,
+            "    StatsEventSpillHeader* header = static_cast<StatsEventSpillHeader*>(mapping);\n");
+    fprintf(out,
+            "    if (header->magic != STATS_EVENT_SPILL_MAGIC || header->size > "
+            "STATS_EVENT_SPILL_CAPACITY) {\n");
+    fprintf(out, "        header->magic = STATS_EVENT_SPILL_MAGIC;\n");
+    fprintf(out, "        header->eventCount = 0;\n");
+    fprintf(out, "        header->size = 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventSpillFile& spillFile = get_stats_event_spill_file();\n");
+    fprintf(out, "    std::lock_guard<std::mutex> lock(spillFile.mutex);\n");
+    fprintf(out, "    if (spillFile.data != nullptr) {\n");
+    fprintf(out, "        munmap(spillFile.data, STATS_EVENT_SPILL_FILE_SIZE);\n");
+    fprintf(out, "        close(spillFile.fd);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    spillFile.fd = fd;\n");
+    fprintf(out, "    spillFile.data = static_cast<uint8_t*>(mapping);\n");
+    fprintf(out,
+            "    spillFile.pending.store(header->size != 0, std::memory_order_release);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "int replayStatsEventSpillFile() {\n");
+    fprintf(out, "    StatsEventSpillFile& spillFile = get_stats_event_spill_file();\n");
+    fprintf(out, "    std::lock_guard<std::mutex> lock(spillFile.mutex);\n");
+    fprintf(out,
+            "    return replay_spilled_stats_events_locked(\n");
+    fprintf(out,
+            "            spillFile, sStatsEventSink.load(std::memory_order_acquire));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "size_t getStatsEventSpillFileEventCount() {\n");
+    fprintf(out, "    StatsEventSpillFile& spillFile = get_stats_event_spill_file();\n");
+    fprintf(out, "    std::lock_guard<std::mutex> lock(spillFile.mutex);\n");
+    fprintf(out,
+            "    return spillFile.data != nullptr ? spillFile.header()->eventCount : 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "uint64_t getStatsEventSpillDropCount() {\n");
+    fprintf(out,
+            "    return get_stats_event_spill_file().droppedEvents.load(std::memory_order_relaxed);"
+            "\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes the ring that hands the events to a consumer process through shared memory, and the
+// sink that writes to it.
+static void write_native_stats_event_ring(FILE* out) {
+    fprintf(out,
+            "// Ring of encoded events in memory shared with the consumer process. The producer "
+            "appends\n");
+    fprintf(out,
+            "// records behind the tail, and the consumer frees them by moving the head. A record "
+            "that does\n");
+    fprintf(out,
+            "// not fit before the end of the ring starts at its beginning, behind a padding "
+            "record.\n");
+    fprintf(out, "const uint32_t STATS_EVENT_RING_MAGIC = 0x474e4952;\n");
+    fprintf(out, "const size_t STATS_EVENT_RING_SIZE = %zu;\n", STATS_EVENT_RING_SIZE);
+    fprintf(out, "const uint32_t STATS_EVENT_RING_PADDING = 0xffffffff;\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventRingHeader {\n");
+    fprintf(out, "    uint32_t magic;\n");
+    fprintf(out, "    uint32_t size;\n");
+    fprintf(out, "    std::atomic<uint64_t> head;\n");
+    fprintf(out, "    std::atomic<uint64_t> tail;\n");
+    fprintf(out, "    std::atomic<uint32_t> consumerWaiting;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventRingRecord {\n");
+    fprintf(out, "    uint32_t size;\n");
+    fprintf(out, "    uint32_t atomId;\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "const size_t STATS_EVENT_RING_MAPPING_SIZE = sizeof(StatsEventRingHeader) + "
+            "STATS_EVENT_RING_SIZE;\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline uint8_t* get_stats_event_ring_data(void* mapping) {\n");
+    fprintf(out, "    return static_cast<uint8_t*>(mapping) + sizeof(StatsEventRingHeader);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "// Records are 8 byte aligned, so that a padding record always fits before the end of "
+            "the ring.\n");
+    fprintf(out, "inline size_t get_stats_event_ring_record_size(size_t eventSize) {\n");
+    fprintf(out,
+            "    return (sizeof(StatsEventRingRecord) + eventSize + 7) & "
+            "~static_cast<size_t>(7);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "struct StatsEventRingProducer {\n");
+    fprintf(out, "    std::mutex mutex;\n");
+    fprintf(out, "    void* mapping;\n");
+    fprintf(out, "    int eventFd;\n");
+    fprintf(out, "    std::atomic<uint64_t> droppedEvents;\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "    StatsEventRingProducer() : mapping(nullptr), eventFd(-1), droppedEvents(0) {}\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline StatsEventRingProducer& get_stats_event_ring_producer() {\n");
+    fprintf(out, "    static StatsEventRingProducer* producer = new StatsEventRingProducer();\n");
+    fprintf(out, "    return *producer;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "// Appends the event to the ring, and rings the doorbell if the consumer waits for "
+            "events.\n");
+    fprintf(out, "// Writers are serialized, so the ring only ever has a single producer.\n");
+    fprintf(out,
+            "inline int write_to_stats_event_ring(const uint8_t* buffer, size_t size, uint32_t "
+            "atomId) {\n");
+    fprintf(out, "    StatsEventRingProducer& producer = get_stats_event_ring_producer();\n");
+    fprintf(out, "    std::lock_guard<std::mutex> lock(producer.mutex);\n");
+    fprintf(out, "    if (producer.mapping == nullptr) {\n");
+    fprintf(out, "        return -ENOTCONN;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    StatsEventRingHeader* header = "
+            "static_cast<StatsEventRingHeader*>(producer.mapping);\n");
+    fprintf(out, "    uint8_t* data = get_stats_event_ring_data(producer.mapping);\n");
+    fprintf(out, "    const size_t recordSize = get_stats_event_ring_record_size(size);\n");
+    fprintf(out, "    const uint64_t head = header->head.load(std::memory_order_acquire);\n");
+    fprintf(out, "    uint64_t tail = header->tail.load(std::memory_order_relaxed);\n");
+    fprintf(out, "    size_t offset = tail %% STATS_EVENT_RING_SIZE;\n");
+    fprintf(out, "    const size_t padding =\n");
+    fprintf(out,
+            "            offset + recordSize > STATS_EVENT_RING_SIZE ? STATS_EVENT_RING_SIZE - "
+            "offset : 0;\n");
+    fprintf(out, "    if (tail + padding + recordSize - head > STATS_EVENT_RING_SIZE) {\n");
+    fprintf(out, "        producer.droppedEvents.fetch_add(1, std::memory_order_relaxed);\n");
+    fprintf(out, "        return -ENOBUFS;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (padding != 0) {\n");
+    fprintf(out,
+            "        const StatsEventRingRecord paddingRecord = {STATS_EVENT_RING_PADDING, 0};\n");
+    fprintf(out, "        memcpy(data + offset, &paddingRecord, sizeof(paddingRecord));\n");
+    fprintf(out, "        tail += padding;\n");
+    fprintf(out, "        offset = 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    const StatsEventRingRecord record = {static_cast<uint32_t>(size), atomId};\n");
+    fprintf(out, "    memcpy(data + offset, &record, sizeof(record));\n");
+    fprintf(out, "    memcpy(data + offset + sizeof(record), buffer, size);\n");
+    fprintf(out, "    header->tail.store(tail + recordSize, std::memory_order_seq_cst);\n");
+    fprintf(out,
+            "    if (header->consumerWaiting.exchange(0, std::memory_order_seq_cst) != 0) {\n");
+    fprintf(out, "        eventfd_write(producer.eventFd, 1);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return size;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Sends the ring and its doorbell to the consumer bound at socketPath.\n");
+    fprintf(out,
+            "inline int send_stats_event_ring(const char* socketPath, int memFd, int eventFd) {\n");
+    fprintf(out, "    struct sockaddr_un addr = {};\n");
+    fprintf(out, "    if (strlen(socketPath) >= sizeof(addr.sun_path)) {\n");
+    fprintf(out, "        return -ENAMETOOLONG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    addr.sun_family = AF_UNIX;\n");
+    fprintf(out, "    strcpy(addr.sun_path, socketPath);\n");
+    fprintf(out, "    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);\n");
+    fprintf(out, "    if (fd < 0) {\n");
+    fprintf(out, "        return -errno;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    char byte = 0;\n");
+    fprintf(out, "    struct iovec iov = {&byte, sizeof(byte)};\n");
+    fprintf(out, "    alignas(struct cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};\n");
+    fprintf(out, "    struct msghdr msg = {};\n");
+    fprintf(out, "    msg.msg_name = &addr;\n");
+    fprintf(out, "    msg.msg_namelen = sizeof(addr);\n");
+    fprintf(out, "    msg.msg_iov = &iov;\n");
+    fprintf(out, "    msg.msg_iovlen = 1;\n");
+    fprintf(out, "    msg.msg_control = control;\n");
+    fprintf(out, "    msg.msg_controllen = sizeof(control);\n");
+    fprintf(out, "    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);\n");
+    fprintf(out, "    cmsg->cmsg_level = SOL_SOCKET;\n");
+    fprintf(out, "    cmsg->cmsg_type = SCM_RIGHTS;\n");
+    fprintf(out, "    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));\n");
+    fprintf(out, "    const int fds[2] = {memFd, eventFd};\n");
+    fprintf(out, "    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));\n");
+    fprintf(out, "    const ssize_t ret = TEMP_FAILURE_RETRY(sendmsg(fd, &msg, 0));\n");
+    fprintf(out, "    const int err = errno;\n");
+    fprintf(out, "    close(fd);\n");
+    fprintf(out, "    return ret < 0 ? -err : 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+static void write_native_stats_event_ring_methods(FILE* out) {
+    fprintf(out, "int useStatsEventRing(const char* socketPath) {\n");
+    fprintf(out,
+            "    const int memFd = memfd_create(\"stats_event_ring\", MFD_CLOEXEC | "
+            "MFD_ALLOW_SEALING);\n");
+    fprintf(out, "    if (memFd < 0) {\n");
+    fprintf(out, "        return -errno;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    // The consumer maps the ring too, so its size is sealed.\n");
+    fprintf(out, "    if (ftruncate(memFd, STATS_EVENT_RING_MAPPING_SIZE) != 0 ||\n");
+    fprintf(out,
+            "        fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) "
+            "{\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(memFd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    void* mapping = mmap(nullptr, STATS_EVENT_RING_MAPPING_SIZE, PROT_READ | "
+            "PROT_WRITE,\n");
+    fprintf(out, "                         MAP_SHARED, memFd, 0);\n");
+    fprintf(out, "    if (mapping == MAP_FAILED) {\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(memFd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    StatsEventRingHeader* header = static_cast<StatsEventRingHeader*>(mapping);\n");
+    fprintf(out, "    header->magic = STATS_EVENT_RING_MAGIC;\n");
+    fprintf(out, "    header->size = STATS_EVENT_RING_SIZE;\n");
+    fprintf(out, "    const int eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);\n");
+    fprintf(out,
+            "    int ret = eventFd < 0 ? -errno : send_stats_event_ring(socketPath, memFd, "
+            "eventFd);\n");
+    fprintf(out, "    close(memFd);\n");
+    fprintf(out, "    if (ret != 0) {\n");
+    fprintf(out, "        if (eventFd >= 0) {\n");
+    fprintf(out, "            close(eventFd);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        munmap(mapping, STATS_EVENT_RING_MAPPING_SIZE);\n");
+    fprintf(out, "        return ret;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventRingProducer& producer = get_stats_event_ring_producer();\n");
+    fprintf(out, "    {\n");
+    fprintf(out, "        std::lock_guard<std::mutex> lock(producer.mutex);\n");
+    fprintf(out, "        if (producer.mapping != nullptr) {\n");
+    fprintf(out, "            munmap(producer.mapping, STATS_EVENT_RING_MAPPING_SIZE);\n");
+    fprintf(out, "            close(producer.eventFd);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        producer.mapping = mapping;\n");
+    fprintf(out, "        producer.eventFd = eventFd;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    setStatsEventSink(&write_to_stats_event_ring);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "uint64_t getStatsEventRingDropCount() {\n");
+    fprintf(out,
+            "    return "
+            "get_stats_event_ring_producer().droppedEvents.load(std::memory_order_relaxed);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "StatsEventRingReader::StatsEventRingReader() : mMapping(nullptr), mEventFd(-1) {}\n");
+    fprintf(out, "\n");
+    fprintf(out, "StatsEventRingReader::~StatsEventRingReader() {\n");
+    fprintf(out, "    if (mMapping != nullptr) {\n");
+    fprintf(out, "        munmap(mMapping, STATS_EVENT_RING_MAPPING_SIZE);\n");
+    fprintf(out, "        close(mEventFd);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "int StatsEventRingReader::receive(int socketFd) {\n");
+    fprintf(out, "    char byte;\n");
+    fprintf(out, "    struct iovec iov = {&byte, sizeof(byte)};\n");
+    fprintf(out, "    alignas(struct cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];\n");
+    fprintf(out, "    struct msghdr msg = {};\n");
+    fprintf(out, "    msg.msg_iov = &iov;\n");
+    fprintf(out, "    msg.msg_iovlen = 1;\n");
+    fprintf(out, "    msg.msg_control = control;\n");
+    fprintf(out, "    msg.msg_controllen = sizeof(control);\n");
+    fprintf(out, "    if (TEMP_FAILURE_RETRY(recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC)) < 0) {\n");
+    fprintf(out, "        return -errno;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);\n");
+    fprintf(out,
+            "    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != "
+            "SCM_RIGHTS ||\n");
+    fprintf(out, "        cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {\n");
+    fprintf(out, "        return -EBADMSG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    int fds[2];\n");
+    fprintf(out, "    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));\n");
+    fprintf(out,
+            "    // Only a ring whose size cannot change is mapped, since a shrunk ring would "
+            "fault on read.\n");
+    fprintf(out, "    void* mapping = MAP_FAILED;\n");
+    fprintf(out, "    const int seals = fcntl(fds[0], F_GET_SEALS);\n");
+    fprintf(out, "    struct stat st;\n");
+    fprintf(out,
+            "    if (seals >= 0 && (seals & F_SEAL_SHRINK) != 0 && fstat(fds[0], &st) == 0 &&\n");
+    fprintf(out, "        static_cast<size_t>(st.st_size) >= STATS_EVENT_RING_MAPPING_SIZE) {\n");
+    fprintf(out,
+            "        mapping = mmap(nullptr, STATS_EVENT_RING_MAPPING_SIZE, PROT_READ | "
+            "PROT_WRITE,\n");
+    fprintf(out, "                       MAP_SHARED, fds[0], 0);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    close(fds[0]);\n");
+    fprintf(out, "    if (mapping == MAP_FAILED ||\n");
+    fprintf(out,
+            "        static_cast<StatsEventRingHeader*>(mapping)->magic != STATS_EVENT_RING_MAGIC "
+            "||\n");
+    fprintf(out,
+            "        static_cast<StatsEventRingHeader*>(mapping)->size != STATS_EVENT_RING_SIZE) "
+            "{\n");
+    fprintf(out, "        if (mapping != MAP_FAILED) {\n");
+    fprintf(out, "            munmap(mapping, STATS_EVENT_RING_MAPPING_SIZE);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        close(fds[1]);\n");
+    fprintf(out, "        return -EBADMSG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (mMapping != nullptr) {\n");
+    fprintf(out, "        munmap(mMapping, STATS_EVENT_RING_MAPPING_SIZE);\n");
+    fprintf(out, "        close(mEventFd);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    mMapping = mapping;\n");
+    fprintf(out, "    mEventFd = fds[1];\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "size_t StatsEventRingReader::read(StatsEventSink sink) {\n");
+    fprintf(out, "    if (mMapping == nullptr) {\n");
+    fprintf(out, "        return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    StatsEventRingHeader* header = static_cast<StatsEventRingHeader*>(mMapping);\n");
+    fprintf(out, "    const uint8_t* data = get_stats_event_ring_data(mMapping);\n");
+    fprintf(out, "    uint64_t head = header->head.load(std::memory_order_relaxed);\n");
+    fprintf(out, "    const uint64_t tail = header->tail.load(std::memory_order_acquire);\n");
+    fprintf(out, "    size_t count = 0;\n");
+    fprintf(out,
+            "    // The producer is not trusted, so the records are checked against the bounds of "
+            "the ring.\n");
+    fprintf(out, "    while (head < tail && tail - head <= STATS_EVENT_RING_SIZE) {\n");
+    fprintf(out, "        const size_t offset = head %% STATS_EVENT_RING_SIZE;\n");
+    fprintf(out, "        StatsEventRingRecord record;\n");
+    fprintf(out, "        memcpy(&record, data + offset, sizeof(record));\n");
+    fprintf(out, "        if (record.size == STATS_EVENT_RING_PADDING) {\n");
+    fprintf(out, "            head += STATS_EVENT_RING_SIZE - offset;\n");
+    fprintf(out, "            continue;\n");
+    fprintf(out, "        }\n");
+    fprintf(out,
+            "        const size_t recordSize = get_stats_event_ring_record_size(record.size);\n");
+    fprintf(out,
+            "        if (record.size > STATS_EVENT_MAX_PAYLOAD || offset + recordSize > "
+            "STATS_EVENT_RING_SIZE) {\n");
+    fprintf(out, "            head = tail;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        sink(data + offset + sizeof(record), record.size, record.atomId);\n");
+    fprintf(out, "        head += recordSize;\n");
+    fprintf(out, "        count++;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    header->head.store(head, std::memory_order_release);\n");
+    fprintf(out, "    return count;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "bool StatsEventRingReader::wait(int timeoutMs) {\n");
+    fprintf(out, "    if (mMapping == nullptr) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    StatsEventRingHeader* header = static_cast<StatsEventRingHeader*>(mMapping);\n");
+    fprintf(out, "    header->consumerWaiting.store(1, std::memory_order_seq_cst);\n");
+    fprintf(out, "    if (header->tail.load(std::memory_order_seq_cst) !=\n");
+    fprintf(out, "        header->head.load(std::memory_order_relaxed)) {\n");
+    fprintf(out, "        header->consumerWaiting.store(0, std::memory_order_relaxed);\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    struct pollfd pollFd = {mEventFd, POLLIN, 0};\n");
+    fprintf(out, "    const int ret = TEMP_FAILURE_RETRY(poll(&pollFd, 1, timeoutMs));\n");
+    fprintf(out, "    header->consumerWaiting.store(0, std::memory_order_relaxed);\n");
+    fprintf(out, "    if (ret <= 0) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    eventfd_t value;\n");
+    fprintf(out, "    eventfd_read(mEventFd, &value);\n");
+    fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+// Writes expand_compact_stats_event, which turns compact events back into the plain events
+// statsd reads, and the statsd sink that expands the compact events it gets.
+static void write_native_compact_stats_event_decoder(FILE* out) {
+    fprintf(out,
+            "inline bool read_stats_event_varint(const uint8_t* event, size_t size, size_t* "
+            "pos,\n");
+    fprintf(out, "                                    uint64_t* value) {\n");
+    fprintf(out, "    *value = 0;\n");
+    fprintf(out, "    for (int shift = 0; shift < 64 && *pos < size; shift += 7) {\n");
+    fprintf(out, "        const uint8_t byte = event[(*pos)++];\n");
+    fprintf(out, "        *value |= static_cast<uint64_t>(byte & 0x7f) << shift;\n");
+    fprintf(out, "        if ((byte & 0x80) == 0) {\n");
+    fprintf(out, "            return true;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return false;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline bool read_stats_event_length(const uint8_t* event, size_t size, size_t pos,\n");
+    fprintf(out, "                                    size_t* length) {\n");
+    fprintf(out, "    int32_t value;\n");
+    fprintf(out, "    if (pos + sizeof(value) > size) {\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    memcpy(&value, event + pos, sizeof(value));\n");
+    fprintf(out, "    *length = sizeof(value) + static_cast<uint32_t>(value);\n");
+    fprintf(out, "    return value >= 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "// Returns the size of the plain value of the given type at event[pos], or 0 if it is "
+            "malformed.\n");
+    fprintf(out,
+            "inline size_t get_stats_event_value_size(const uint8_t* event, size_t size, size_t "
+            "pos,\n");
+    fprintf(out, "                                         uint8_t typeId) {\n");
+    fprintf(out, "    size_t valueSize = 0;\n");
+    fprintf(out, "    switch (typeId) {\n");
+    fprintf(out, "        case STATS_EVENT_BOOL_TYPE:\n");
+    fprintf(out, "            valueSize = 1;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        case STATS_EVENT_INT32_TYPE:\n");
+    fprintf(out, "        case STATS_EVENT_FLOAT_TYPE:\n");
+    fprintf(out, "        case STATS_EVENT_ERROR_TYPE:\n");
+    fprintf(out, "            valueSize = 4;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        case STATS_EVENT_INT64_TYPE:\n");
+    fprintf(out, "            valueSize = 8;\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        case STATS_EVENT_STRING_TYPE:\n");
+    fprintf(out, "        case STATS_EVENT_BYTE_ARRAY_TYPE:\n");
+    fprintf(out, "            if (!read_stats_event_length(event, size, pos, &valueSize)) {\n");
+    fprintf(out, "                return 0;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        case STATS_EVENT_LIST_TYPE: {\n");
+    fprintf(out, "            if (pos + 2 > size) {\n");
+    fprintf(out, "                return 0;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            const uint8_t count = event[pos];\n");
+    fprintf(out, "            const uint8_t elementType = event[pos + 1];\n");
+    fprintf(out, "            valueSize = 2;\n");
+    fprintf(out, "            for (uint8_t i = 0; i < count; i++) {\n");
+    fprintf(out, "                const size_t elementSize =\n");
+    fprintf(out,
+            "                        get_stats_event_value_size(event, size, pos + valueSize, "
+            "elementType);\n");
+    fprintf(out, "                if (elementSize == 0) {\n");
+    fprintf(out, "                    return 0;\n");
+    fprintf(out, "                }\n");
+    fprintf(out, "                valueSize += elementSize;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        case STATS_EVENT_ATTRIBUTION_CHAIN_TYPE: {\n");
+    fprintf(out, "            if (pos + 1 > size) {\n");
+    fprintf(out, "                return 0;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            const uint8_t numNodes = event[pos];\n");
+    fprintf(out, "            valueSize = 1;\n");
+    fprintf(out, "            for (uint8_t i = 0; i < numNodes; i++) {\n");
+    fprintf(out, "                size_t tagSize;\n");
+    fprintf(out,
+            "                if (!read_stats_event_length(event, size, pos + valueSize + 4, "
+            "&tagSize)) {\n");
+    fprintf(out, "                    return 0;\n");
+    fprintf(out, "                }\n");
+    fprintf(out, "                valueSize += 4 + tagSize;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return pos + valueSize <= size ? valueSize : 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "// Rewrites the varints of a compact event as the fixed width values statsd reads. "
+            "Returns the\n");
+    fprintf(out,
+            "// size of the plain event, or a negative errno if the event is malformed or does not "
+            "fit.\n");
+    fprintf(out,
+            "inline int expand_compact_stats_event(const uint8_t* event, size_t size, uint8_t* "
+            "out,\n");
+    fprintf(out, "                                      size_t outCapacity) {\n");
+    fprintf(out,
+            "    if (size < 2 || (event[0] & 0x0f) != STATS_EVENT_OBJECT_TYPE || outCapacity < 2) "
+            "{\n");
+    fprintf(out, "        return -EBADMSG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventBuffer plain(out, outCapacity);\n");
+    fprintf(out,
+            "    plain.buf[STATS_EVENT_POS_NUM_ELEMENTS] = event[STATS_EVENT_POS_NUM_ELEMENTS];\n");
+    fprintf(out, "    size_t pos = 2;\n");
+    fprintf(out, "    for (uint8_t i = 0; i < event[STATS_EVENT_POS_NUM_ELEMENTS]; i++) {\n");
+    fprintf(out, "        if (pos >= size) {\n");
+    fprintf(out, "            return -EBADMSG;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        const uint8_t typeInfo = event[pos++];\n");
+    fprintf(out, "        const uint8_t typeId = typeInfo & 0x0f;\n");
+    fprintf(out, "        const uint8_t annotations = typeInfo & 0xf0;\n");
+    fprintf(out,
+            "        if (typeId == STATS_EVENT_VARINT32_TYPE || typeId == "
+            "STATS_EVENT_VARINT64_TYPE) {\n");
+    fprintf(out, "            uint64_t zigzag;\n");
+    fprintf(out, "            if (!read_stats_event_varint(event, size, &pos, &zigzag)) {\n");
+    fprintf(out, "                return -EBADMSG;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            const int64_t value =\n");
+    fprintf(out,
+            "                    static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag "
+            "& 1);\n");
+    fprintf(out, "            if (typeId == STATS_EVENT_VARINT32_TYPE) {\n");
+    fprintf(out,
+            "                const uint8_t plainTypeInfo = annotations | "
+            "STATS_EVENT_INT32_TYPE;\n");
+    fprintf(out, "                StatsEventBuffer_appendValue(&plain, plainTypeInfo);\n");
+    fprintf(out,
+            "                StatsEventBuffer_appendValue(&plain, static_cast<int32_t>(value));\n");
+    fprintf(out, "            } else {\n");
+    fprintf(out,
+            "                const uint8_t plainTypeInfo = annotations | "
+            "STATS_EVENT_INT64_TYPE;\n");
+    fprintf(out, "                StatsEventBuffer_appendValue(&plain, plainTypeInfo);\n");
+    fprintf(out, "                StatsEventBuffer_appendValue(&plain, value);\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "        } else {\n");
+    fprintf(out,
+            "            const size_t valueSize = get_stats_event_value_size(event, size, pos, "
+            "typeId);\n");
+    fprintf(out, "            if (valueSize == 0) {\n");
+    fprintf(out, "                return -EBADMSG;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            StatsEventBuffer_append(&plain, event + pos - 1, 1 + valueSize);\n");
+    fprintf(out, "            pos += valueSize;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        // Each annotation is an id, a type id and a bool or int32 value.\n");
+    fprintf(out, "        for (uint8_t j = 0; j < annotations >> 4; j++) {\n");
+    fprintf(out, "            if (pos + 2 > size) {\n");
+    fprintf(out, "                return -EBADMSG;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            const size_t annotationSize =\n");
+    fprintf(out,
+            "                    2 + (event[pos + 1] == STATS_EVENT_BOOL_TYPE ? 1 : "
+            "sizeof(int32_t));\n");
+    fprintf(out, "            if (pos + annotationSize > size) {\n");
+    fprintf(out, "                return -EBADMSG;\n");
+    fprintf(out, "            }\n");
+    fprintf(out, "            StatsEventBuffer_append(&plain, event + pos, annotationSize);\n");
+    fprintf(out, "            pos += annotationSize;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (pos != size) {\n");
+    fprintf(out, "        return -EBADMSG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if ((plain.errors & STATS_EVENT_ERROR_OVERFLOW) != 0) {\n");
+    fprintf(out, "        return -ENOBUFS;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return plain.size;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline int write_to_statsd(const uint8_t* buffer, size_t size, uint32_t atomId) {\n");
+    fprintf(out, "    if (buffer[0] == STATS_EVENT_COMPACT_OBJECT_TYPE) {\n");
+    fprintf(out, "        // statsd only reads plain events.\n");
+    fprintf(out, "        uint8_t plain[STATS_EVENT_MAX_PAYLOAD];\n");
+    fprintf(out,
+            "        const int plainSize = expand_compact_stats_event(buffer, size, plain, "
+            "sizeof(plain));\n");
+    fprintf(out, "        if (plainSize < 0) {\n");
+    fprintf(out, "            return plainSize;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "        return write_buffer_to_statsd(plain, plainSize, atomId);\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    return write_buffer_to_statsd(const_cast<uint8_t*>(buffer), size, atomId);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+void write_native_stats_event_buffer_helpers(FILE* out, bool batchWriter, bool async,
+                                             bool spillFile, bool ringTransport,
+                                             bool compactEncoding) {
+    fprintf(out, "namespace {\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Type ids of the StatsEvent wire format, as encoded by libstatssocket.\n");
+    fprintf(out, "const uint8_t STATS_EVENT_INT32_TYPE = 0x00;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_INT64_TYPE = 0x01;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_STRING_TYPE = 0x02;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_LIST_TYPE = 0x03;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_FLOAT_TYPE = 0x04;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_BOOL_TYPE = 0x05;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_BYTE_ARRAY_TYPE = 0x06;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_OBJECT_TYPE = 0x07;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_ATTRIBUTION_CHAIN_TYPE = 0x09;\n");
+    if (compactEncoding) {
+        fprintf(out, "const uint8_t STATS_EVENT_VARINT32_TYPE = 0x0A;\n");
+        fprintf(out, "const uint8_t STATS_EVENT_VARINT64_TYPE = 0x0B;\n");
+        fprintf(out, "// Marks the events that have varint fields, which statsd cannot read.\n");
+        fprintf(out,
+                "const uint8_t STATS_EVENT_COMPACT_OBJECT_TYPE = 0x80 | STATS_EVENT_OBJECT_TYPE;"
+                "\n");
+    }
+    fprintf(out, "const uint8_t STATS_EVENT_ERROR_TYPE = 0x0F;\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Errors reported to statsd in place of the fields of a malformed event.\n");
+    fprintf(out, "const uint32_t STATS_EVENT_ERROR_OVERFLOW = 0x4;\n");
+    fprintf(out, "const uint32_t STATS_EVENT_ERROR_ATTRIBUTION_CHAIN_TOO_LONG = 0x8;\n");
+    fprintf(out, "const uint32_t STATS_EVENT_ERROR_TOO_MANY_ANNOTATIONS = 0x100;\n");
+    fprintf(out, "const uint32_t STATS_EVENT_ERROR_TOO_MANY_FIELDS = 0x200;\n");
+    fprintf(out, "const uint32_t STATS_EVENT_ERROR_LIST_TOO_LONG = 0x4000;\n");
+    fprintf(out, "\n");
+    fprintf(out, "const size_t STATS_EVENT_POS_NUM_ELEMENTS = 1;\n");
+    fprintf(out, "const size_t STATS_EVENT_POS_ATOM_ID = 11;\n");
+    fprintf(out, "const uint32_t STATS_EVENT_MAX_COUNT = 127;\n");
+    fprintf(out, "const uint8_t STATS_EVENT_MAX_ANNOTATION_COUNT = 15;\n");
+    fprintf(out, "const size_t STATS_EVENT_MAX_PAYLOAD = %zu;\n", STATS_EVENT_BUFFER_MAX_PAYLOAD);
+    if (async) {
+        fprintf(out, "const size_t STATS_EVENT_QUEUE_LENGTH = %zu;\n", STATS_EVENT_QUEUE_LENGTH);
+        fprintf(out, "const size_t STATS_EVENT_QUEUE_SLOT_SIZE = %zu;\n",
+                STATS_EVENT_QUEUE_SLOT_SIZE);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "// Encodes a single event into a caller provided buffer.\n");
+    fprintf(out, "struct StatsEventBuffer {\n");
+    fprintf(out, "    uint8_t* buf;\n");
+    fprintf(out, "    size_t capacity;\n");
+    fprintf(out, "    size_t size;\n");
+    fprintf(out, "    size_t lastFieldPos;\n");
+    fprintf(out, "    uint32_t numElements;\n");
+    fprintf(out, "    uint32_t atomId;\n");
+    fprintf(out, "    uint32_t errors;\n");
+    if (compactEncoding) {
+        fprintf(out, "    bool compact;\n");
+    }
+    fprintf(out, "\n");
+    fprintf(out, "    StatsEventBuffer(uint8_t* buffer, size_t bufferCapacity)\n");
+    fprintf(out, "        : buf(buffer),\n");
+    fprintf(out, "          capacity(bufferCapacity),\n");
+    fprintf(out, "          size(2),\n");
+    fprintf(out, "          lastFieldPos(0),\n");
+    fprintf(out, "          numElements(0),\n");
+    fprintf(out, "          atomId(0),\n");
+    if (compactEncoding) {
+        fprintf(out, "          errors(0),\n");
+        fprintf(out, "          compact(false) {\n");
+    } else {
+        fprintf(out, "          errors(0) {\n");
+    }
+    fprintf(out, "        buf[0] = STATS_EVENT_OBJECT_TYPE;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Scratch buffer for the events that have fields of variable size.\n");
+    fprintf(out, "inline uint8_t* get_stats_event_thread_buffer() {\n");
+    fprintf(out, "    thread_local uint8_t buffer[STATS_EVENT_MAX_PAYLOAD];\n");
+    fprintf(out, "    return buffer;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline int64_t get_elapsed_realtime_ns() {\n");
+    fprintf(out, "    struct timespec t;\n");
+    fprintf(out, "    clock_gettime(CLOCK_BOOTTIME, &t);\n");
+    fprintf(out, "    return static_cast<int64_t>(t.tv_sec) * 1000000000LL + t.tv_nsec;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline void StatsEventBuffer_append(StatsEventBuffer* event, const void* value,\n");
+    fprintf(out, "                                    size_t size) {\n");
+    fprintf(out, "    if (event->size + size > event->capacity) {\n");
+    fprintf(out, "        event->errors |= STATS_EVENT_ERROR_OVERFLOW;\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    memcpy(event->buf + event->size, value, size);\n");
+    fprintf(out, "    event->size += size;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "template <typename T>\n");
+    fprintf(out, "inline void StatsEventBuffer_appendValue(StatsEventBuffer* event, T value) {\n");
+    fprintf(out, "    StatsEventBuffer_append(event, &value, sizeof(value));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline std::string_view to_string_view(const char* value) {\n");
+    fprintf(out, "    return std::string_view(value != nullptr ? value : \"\");\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Converts the attribution tags for the std::string_view write methods.\n");
+    fprintf(out, "// Longer chains are rejected before their tags are read, so views holds\n");
+    fprintf(out, "// at most STATS_EVENT_MAX_COUNT of them.\n");
+    fprintf(out, "inline void to_string_views(const char* const* values, size_t count,\n");
+    fprintf(out, "                            std::string_view* views) {\n");
+    fprintf(out, "    for (size_t i = 0; i < count && i < STATS_EVENT_MAX_COUNT; i++) {\n");
+    fprintf(out, "        views[i] = to_string_view(values[i]);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Strings are written as their length and their bytes, without the null.\n");
+    fprintf(out, "inline void StatsEventBuffer_appendString(StatsEventBuffer* event,\n");
+    fprintf(out, "                                          std::string_view value) {\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<int32_t>(value.size()));\n");
+    fprintf(out, "    StatsEventBuffer_append(event, value.data(), value.size());\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_appendString(StatsEventBuffer* event,\n");
+    fprintf(out, "                                          const char* value) {\n");
+    fprintf(out, "    StatsEventBuffer_appendString(event, to_string_view(value));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline void StatsEventBuffer_startField(StatsEventBuffer* event, uint8_t typeId) {\n");
+    fprintf(out, "    event->lastFieldPos = event->size;\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, typeId);\n");
+    fprintf(out, "    event->numElements++;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline bool StatsEventBuffer_startList(StatsEventBuffer* event,\n");
+    fprintf(out,
+            "                                       size_t numElements, uint8_t elementType) {\n");
+    fprintf(out, "    if (numElements > STATS_EVENT_MAX_COUNT) {\n");
+    fprintf(out, "        event->errors |= STATS_EVENT_ERROR_LIST_TOO_LONG;\n");
+    fprintf(out, "        return false;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_LIST_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<uint8_t>(numElements));\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, elementType);\n");
+    fprintf(out, "    return true;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline void StatsEventBuffer_setAtomId(StatsEventBuffer* event, uint32_t atomId) {\n");
+    fprintf(out, "    event->atomId = atomId;\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT64_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, get_elapsed_realtime_ns());\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT32_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, atomId);\n");
+    if (compactEncoding) {
+        fprintf(out, "    event->compact = is_compact_atom(atomId);\n");
+    }
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (compactEncoding) {
+        fprintf(out,
+                "// Compact events write small integers as zigzag varints. A varint is only "
+                "written if it is\n");
+        fprintf(out,
+                "// shorter than the fixed width value, so compact events are never larger than "
+                "plain ones.\n");
+        fprintf(out,
+                "inline void StatsEventBuffer_writeVarint(StatsEventBuffer* event, uint8_t typeId, "
+                "uint64_t value) {\n");
+        fprintf(out, "    StatsEventBuffer_startField(event, typeId);\n");
+        fprintf(out, "    event->buf[0] = STATS_EVENT_COMPACT_OBJECT_TYPE;\n");
+        fprintf(out, "    while (value >= 0x80) {\n");
+        fprintf(out,
+                "        StatsEventBuffer_appendValue(event, static_cast<uint8_t>(value | "
+                "0x80));\n");
+        fprintf(out, "        value >>= 7;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<uint8_t>(value));\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "inline void StatsEventBuffer_writeInt32(StatsEventBuffer* event, int32_t value) "
+                "{\n");
+        fprintf(out, "    const uint32_t zigzag =\n");
+        fprintf(out,
+                "            (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> "
+                "31);\n");
+        fprintf(out, "    if (event->compact && zigzag < (1u << 21)) {\n");
+        fprintf(out,
+                "        StatsEventBuffer_writeVarint(event, STATS_EVENT_VARINT32_TYPE, "
+                "zigzag);\n");
+        fprintf(out, "        return;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT32_TYPE);\n");
+        fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "inline void StatsEventBuffer_writeInt64(StatsEventBuffer* event, int64_t value) "
+                "{\n");
+        fprintf(out, "    const uint64_t zigzag =\n");
+        fprintf(out,
+                "            (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> "
+                "63);\n");
+        fprintf(out, "    if (event->compact && zigzag < (1ull << 49)) {\n");
+        fprintf(out,
+                "        StatsEventBuffer_writeVarint(event, STATS_EVENT_VARINT64_TYPE, "
+                "zigzag);\n");
+        fprintf(out, "        return;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT64_TYPE);\n");
+        fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    } else {
+        fprintf(out,
+                "inline void StatsEventBuffer_writeInt32(StatsEventBuffer* event, int32_t value) "
+                "{\n");
+        fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT32_TYPE);\n");
+        fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "inline void StatsEventBuffer_writeInt64(StatsEventBuffer* event, int64_t value) "
+                "{\n");
+        fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_INT64_TYPE);\n");
+        fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+    fprintf(out,
+            "inline void StatsEventBuffer_writeFloat(StatsEventBuffer* event, float value) {\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_FLOAT_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeBool(StatsEventBuffer* event, bool value) {\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_BOOL_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<uint8_t>(value));\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeString(StatsEventBuffer* event,\n");
+    fprintf(out, "                                         const char* value) {\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_STRING_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendString(event, value);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeString(StatsEventBuffer* event,\n");
+    fprintf(out, "                                         std::string_view value) {\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_STRING_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendString(event, value);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeByteArray(StatsEventBuffer* event,\n");
+    fprintf(out,
+            "                                            const uint8_t* buf, size_t numBytes) {\n");
+    fprintf(out, "    if (buf == nullptr) {\n");
+    fprintf(out, "        numBytes = 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_BYTE_ARRAY_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<int32_t>(numBytes));\n");
+    fprintf(out, "    StatsEventBuffer_append(event, buf, numBytes);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// The tags are either char const* or std::string_view.\n");
+    fprintf(out, "template <typename Tag>\n");
+    fprintf(out, "inline void StatsEventBuffer_writeAttributionChain(StatsEventBuffer* event,\n");
+    fprintf(out, "                                                   const uint32_t* uids,\n");
+    fprintf(out, "                                                   const Tag* tags,\n");
+    fprintf(out, "                                                   uint8_t numNodes) {\n");
+    fprintf(out, "    if (numNodes > STATS_EVENT_MAX_COUNT) {\n");
+    fprintf(out, "        event->errors |= STATS_EVENT_ERROR_ATTRIBUTION_CHAIN_TOO_LONG;\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    StatsEventBuffer_startField(event, STATS_EVENT_ATTRIBUTION_CHAIN_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, numNodes);\n");
+    fprintf(out, "    for (uint8_t i = 0; i < numNodes; i++) {\n");
+    fprintf(out, "        StatsEventBuffer_appendValue(event, uids[i]);\n");
+    fprintf(out, "        StatsEventBuffer_appendString(event, tags[i]);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "template <typename T>\n");
+    fprintf(out,
+            "inline void StatsEventBuffer_writeArray(StatsEventBuffer* event, const T* "
+            "elements,\n");
+    fprintf(out,
+            "                                        size_t numElements, uint8_t elementType) {\n");
+    fprintf(out, "    if (!StatsEventBuffer_startList(event, numElements, elementType)) {\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    for (size_t i = 0; i < numElements; i++) {\n");
+    fprintf(out, "        StatsEventBuffer_appendValue(event, elements[i]);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeInt32Array(StatsEventBuffer* event,\n");
+    fprintf(out, "                                             const int32_t* elements,\n");
+    fprintf(out, "                                             size_t numElements) {\n");
+    fprintf(out, "    StatsEventBuffer_writeArray(event, elements, numElements,\n");
+    fprintf(out, "                                STATS_EVENT_INT32_TYPE);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeInt64Array(StatsEventBuffer* event,\n");
+    fprintf(out, "                                             const int64_t* elements,\n");
+    fprintf(out, "                                             size_t numElements) {\n");
+    fprintf(out, "    StatsEventBuffer_writeArray(event, elements, numElements,\n");
+    fprintf(out, "                                STATS_EVENT_INT64_TYPE);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeFloatArray(StatsEventBuffer* event,\n");
+    fprintf(out, "                                             const float* elements,\n");
+    fprintf(out, "                                             size_t numElements) {\n");
+    fprintf(out, "    StatsEventBuffer_writeArray(event, elements, numElements,\n");
+    fprintf(out, "                                STATS_EVENT_FLOAT_TYPE);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeBoolArray(StatsEventBuffer* event,\n");
+    fprintf(out, "                                            const bool* elements,\n");
+    fprintf(out, "                                            size_t numElements) {\n");
+    fprintf(out,
+            "    if (!StatsEventBuffer_startList(event, numElements, STATS_EVENT_BOOL_TYPE)) {\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    for (size_t i = 0; i < numElements; i++) {\n");
+    fprintf(out,
+            "        StatsEventBuffer_appendValue(event, static_cast<uint8_t>(elements[i]));\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_writeStringArray(StatsEventBuffer* event,\n");
+    fprintf(out, "                                              const char* const* elements,\n");
+    fprintf(out, "                                              size_t numElements) {\n");
+    fprintf(out,
+            "    if (!StatsEventBuffer_startList(event, numElements, STATS_EVENT_STRING_TYPE)) "
+            "{\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    for (size_t i = 0; i < numElements; i++) {\n");
+    fprintf(out, "        StatsEventBuffer_appendString(event, elements[i]);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline void StatsEventBuffer_incrementAnnotationCount(StatsEventBuffer* event) {\n");
+    fprintf(out, "    if (event->errors != 0) {\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const uint8_t typeByte = event->buf[event->lastFieldPos];\n");
+    fprintf(out, "    const uint8_t annotationCount = (typeByte >> 4) + 1;\n");
+    fprintf(out, "    if (annotationCount > STATS_EVENT_MAX_ANNOTATION_COUNT) {\n");
+    fprintf(out, "        event->errors |= STATS_EVENT_ERROR_TOO_MANY_ANNOTATIONS;\n");
+    fprintf(out, "        return;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    event->buf[event->lastFieldPos] = (annotationCount << 4) | (typeByte & 0x0F);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_addBoolAnnotation(StatsEventBuffer* event,\n");
+    fprintf(out,
+            "                                               uint8_t annotationId, bool value) {\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, annotationId);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, STATS_EVENT_BOOL_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, static_cast<uint8_t>(value));\n");
+    fprintf(out, "    StatsEventBuffer_incrementAnnotationCount(event);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "inline void StatsEventBuffer_addInt32Annotation(StatsEventBuffer* event,\n");
+    fprintf(out,
+            "                                                uint8_t annotationId, int32_t value) "
+            "{\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, annotationId);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, STATS_EVENT_INT32_TYPE);\n");
+    fprintf(out, "    StatsEventBuffer_appendValue(event, value);\n");
+    fprintf(out, "    StatsEventBuffer_incrementAnnotationCount(event);\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (compactEncoding) {
+        write_native_compact_stats_event_decoder(out);
+    } else {
+        fprintf(out,
+                "inline int write_to_statsd(const uint8_t* buffer, size_t size, uint32_t atomId) "
+                "{\n");
+        fprintf(out,
+                "    return write_buffer_to_statsd(const_cast<uint8_t*>(buffer), size, atomId);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+    fprintf(out, "std::atomic<StatsEventSink> sStatsEventSink(&write_to_statsd);\n");
+    fprintf(out, "std::atomic<int> sStandInSocket(-1);\n");
+    fprintf(out, "\n");
+    fprintf(out,
+            "inline int write_to_stand_in_socket(const uint8_t* buffer, size_t size, uint32_t) "
+            "{\n");
+    fprintf(out, "    const ssize_t ret = TEMP_FAILURE_RETRY(\n");
+    fprintf(out,
+            "            send(sStandInSocket.load(std::memory_order_relaxed), buffer, size,\n");
+    fprintf(out, "                 MSG_DONTWAIT));\n");
+    fprintf(out, "    return ret < 0 ? -errno : ret;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (ringTransport) {
+        write_native_stats_event_ring(out);
+    }
+    if (spillFile) {
+        write_native_stats_event_spill_file(out);
+    } else {
+        fprintf(out,
+                "inline int deliver_stats_event(const uint8_t* buffer, size_t size, uint32_t "
+                "atomId) {\n");
+        fprintf(out,
+                "    const StatsEventSink sink = "
+                "sStatsEventSink.load(std::memory_order_acquire);\n");
+        fprintf(out, "    return sink(buffer, size, atomId);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+    fprintf(out, "// Finishes the encoding of the event. Like AStatsEvent_write, an event with\n");
+    fprintf(out, "// errors is replaced with one that only reports the errors.\n");
+    fprintf(out, "inline void StatsEventBuffer_finish(StatsEventBuffer* event) {\n");
+    fprintf(out, "    if (event->numElements > STATS_EVENT_MAX_COUNT) {\n");
+    fprintf(out, "        event->errors |= STATS_EVENT_ERROR_TOO_MANY_FIELDS;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    if (event->errors != 0) {\n");
+    fprintf(out, "        const uint32_t errors = event->errors;\n");
+    fprintf(out, "        event->numElements = 2;\n");
+    fprintf(out, "        event->buf[STATS_EVENT_POS_ATOM_ID] = STATS_EVENT_INT32_TYPE;\n");
+    fprintf(out,
+            "        event->size = STATS_EVENT_POS_ATOM_ID + sizeof(uint8_t) + sizeof(int32_t);\n");
+    fprintf(out, "        StatsEventBuffer_startField(event, STATS_EVENT_ERROR_TYPE);\n");
+    fprintf(out, "        StatsEventBuffer_appendValue(event, errors);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    event->buf[STATS_EVENT_POS_NUM_ELEMENTS] = event->numElements;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (async) {
+        write_native_stats_event_queue(out);
+    }
+    fprintf(out, "// Finishes the event and hands it to the sink.\n");
+    fprintf(out, "inline int StatsEventBuffer_write(StatsEventBuffer* event) {\n");
+    fprintf(out, "    StatsEventBuffer_finish(event);\n");
+    if (async) {
+        fprintf(out, "    return StatsEventBuffer_enqueue(event);\n");
+    } else {
+        fprintf(out, "    return deliver_stats_event(event->buf, event->size, event->atomId);\n");
+    }
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (batchWriter) {
+        write_native_stats_event_batch_sinks(out);
+    }
+    fprintf(out, "}  // namespace\n");
+    fprintf(out, "\n");
+    fprintf(out, "void setStatsEventSink(StatsEventSink sink) {\n");
+    fprintf(out, "    sStatsEventSink.store(sink != nullptr ? sink : &write_to_statsd,\n");
+    fprintf(out, "                          std::memory_order_release);\n");
+    if (batchWriter) {
+        fprintf(out,
+                "    sStatsEventBatchSink.store(&write_batch_to_sink, "
+                "std::memory_order_release);\n");
+    }
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "int useStandInStatsEventSocket(const char* socketPath) {\n");
+    fprintf(out, "    struct sockaddr_un addr = {};\n");
+    fprintf(out, "    if (strlen(socketPath) >= sizeof(addr.sun_path)) {\n");
+    fprintf(out, "        return -ENAMETOOLONG;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    addr.sun_family = AF_UNIX;\n");
+    fprintf(out, "    strcpy(addr.sun_path, socketPath);\n");
+    fprintf(out, "    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);\n");
+    fprintf(out, "    if (fd < 0) {\n");
+    fprintf(out, "        return -errno;\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) "
+            "{\n");
+    fprintf(out, "        const int err = errno;\n");
+    fprintf(out, "        close(fd);\n");
+    fprintf(out, "        return -err;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    const int previousFd = sStandInSocket.exchange(fd);\n");
+    fprintf(out, "    if (previousFd >= 0) {\n");
+    fprintf(out, "        close(previousFd);\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    setStatsEventSink(&write_to_stand_in_socket);\n");
+    if (batchWriter) {
+        fprintf(out,
+                "    sStatsEventBatchSink.store(&write_batch_to_stand_in_socket, "
+                "std::memory_order_release);\n");
+    }
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    if (spillFile) {
+        write_native_stats_event_spill_file_methods(out);
+    }
+    if (ringTransport) {
+        write_native_stats_event_ring_methods(out);
+    }
+    if (compactEncoding) {
+        fprintf(out,
+                "int expandCompactStatsEvent(const uint8_t* event, size_t size, uint8_t* out,\n");
+        fprintf(out, "                            size_t outCapacity) {\n");
+        fprintf(out, "    return expand_compact_stats_event(event, size, out, outCapacity);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+    if (async) {
+        fprintf(out, "uint64_t getStatsEventQueueDropCount() {\n");
+        fprintf(out,
+                "    return get_stats_event_queue().droppedEvents.load(std::memory_order_relaxed);"
+                "\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+        fprintf(out, "void flushStatsEventQueue() {\n");
+        fprintf(out, "    StatsEventQueue& queue = get_stats_event_queue();\n");
+        fprintf(out, "    const size_t tail = queue.tail.load(std::memory_order_acquire);\n");
+        fprintf(out, "    queue.flushWaiters.fetch_add(1, std::memory_order_seq_cst);\n");
+        fprintf(out, "    std::atomic_thread_fence(std::memory_order_seq_cst);\n");
+        fprintf(out, "    std::unique_lock<std::mutex> lock(queue.flushMutex);\n");
+        fprintf(out, "    queue.flushCondition.wait(lock, [&queue, tail] {\n");
+        fprintf(out, "        return queue.head.load(std::memory_order_acquire) >= tail;\n");
+        fprintf(out, "    });\n");
+        fprintf(out, "    queue.flushWaiters.fetch_sub(1, std::memory_order_relaxed);\n");
+        fprintf(out, "}\n");
+        fprintf(out, "\n");
+    }
+}
+
+void write_native_stats_event_batch_methods(FILE* out) {
+    fprintf(out, "StatsEventBatch::StatsEventBatch() : mBufferSize(0), mEventCount(0) {}\n");
+    fprintf(out, "\n");
+    fprintf(out, "StatsEventBatch::~StatsEventBatch() {\n");
+    fprintf(out, "    flush();\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "int StatsEventBatch::flush() {\n");
+    fprintf(out, "    if (mEventCount == 0) {\n");
+    fprintf(out, "        return 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    struct iovec events[MAX_EVENTS];\n");
+    fprintf(out, "    size_t offset = 0;\n");
+    fprintf(out, "    for (size_t i = 0; i < mEventCount; i++) {\n");
+    fprintf(out, "        events[i].iov_base = mBuffer + offset;\n");
+    fprintf(out, "        events[i].iov_len = mEventSizes[i];\n");
+    fprintf(out, "        offset += mEventSizes[i];\n");
+    fprintf(out, "    }\n");
+    fprintf(out,
+            "    const StatsEventBatchSink sink = "
+            "sStatsEventBatchSink.load(std::memory_order_acquire);\n");
+    fprintf(out, "    const int ret = sink(events, mAtomIds, mEventCount);\n");
+    fprintf(out, "    mBufferSize = 0;\n");
+    fprintf(out, "    mEventCount = 0;\n");
+    fprintf(out, "    return ret;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "int StatsEventBatch::append(size_t size, uint32_t atomId) {\n");
+    fprintf(out, "    mEventSizes[mEventCount] = size;\n");
+    fprintf(out, "    mAtomIds[mEventCount] = atomId;\n");
+    fprintf(out, "    mBufferSize += size;\n");
+    fprintf(out, "    mEventCount++;\n");
+    fprintf(out,
+            "    if (mEventCount == MAX_EVENTS || BUFFER_SIZE - mBufferSize < "
+            "STATS_EVENT_MAX_PAYLOAD) {\n");
+    fprintf(out, "        const int ret = flush();\n");
+    fprintf(out, "        return ret < 0 ? ret : 0;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+void write_native_stats_event_batch_header_start(FILE* out) {
+    fprintf(out, "// Collects pushed events and hands them to the event sink together on\n");
+    fprintf(out, "// flush(), so that bursts of events cost one call into the sink. The batch\n");
+    fprintf(out, "// is flushed when it holds MAX_EVENTS events, when less than the largest\n");
+    fprintf(out, "// event fits behind them and when it is destroyed. Not thread safe.\n");
+    fprintf(out, "class StatsEventBatch {\n");
+    fprintf(out, "public:\n");
+    fprintf(out, "    static constexpr size_t MAX_EVENTS = %zu;\n", STATS_EVENT_BATCH_MAX_EVENTS);
+    fprintf(out, "    static constexpr size_t BUFFER_SIZE = %zu;\n", STATS_EVENT_BATCH_BUFFER_SIZE);
+    fprintf(out, "\n");
+    fprintf(out, "    StatsEventBatch();\n");
+    fprintf(out, "    ~StatsEventBatch();\n");
+    fprintf(out, "    StatsEventBatch(const StatsEventBatch&) = delete;\n");
+    fprintf(out, "    StatsEventBatch& operator=(const StatsEventBatch&) = delete;\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Sends the pending events. Returns the number of events sent, or a\n");
+    fprintf(out, "    // negative errno on failure. The pending events are dropped either way.\n");
+    fprintf(out, "    int flush();\n");
+    fprintf(out, "\n");
+    fprintf(out, "    size_t pendingEvents() const {\n");
+    fprintf(out, "        return mEventCount;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "\n");
+    fprintf(out, "    // Adds an event to the batch. Returns 0, or a negative errno if the\n");
+    fprintf(out, "    // batch was flushed to make room and the flush failed.\n");
+}
+
+void write_native_stats_event_batch_header_end(FILE* out) {
+    fprintf(out, "\n");
+    fprintf(out, "private:\n");
+    fprintf(out, "    int append(size_t size, uint32_t atomId);\n");
+    fprintf(out, "\n");
+    fprintf(out, "    uint8_t mBuffer[BUFFER_SIZE];\n");
+    fprintf(out, "    size_t mBufferSize;\n");
+    fprintf(out, "    size_t mEventCount;\n");
+    fprintf(out, "    size_t mEventSizes[MAX_EVENTS];\n");
+    fprintf(out, "    uint32_t mAtomIds[MAX_EVENTS];\n");
+    fprintf(out, "};\n");
+    fprintf(out, "\n");
+}
+
+void write_native_stats_event_buffer_header(FILE* out, bool async, bool spillFile,
+                                            bool ringTransport, bool compactEncoding) {
+    fprintf(out, "// Receives each encoded event. Returns the number of bytes written, or a\n");
+    fprintf(out, "// negative errno on failure.\n");
+    fprintf(out,
+            "typedef int (*StatsEventSink)(const uint8_t* buffer, size_t size, uint32_t "
+            "atomId);\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Sends the encoded events to sink instead of the statsd socket. Passing\n");
+    fprintf(out, "// nullptr restores the statsd socket.\n");
+    fprintf(out, "void setStatsEventSink(StatsEventSink sink);\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Sends each encoded event as one datagram to the unix socket bound at\n");
+    fprintf(out, "// socketPath, so that the events can be checked off-device. Returns 0 on\n");
+    fprintf(out, "// success, or a negative errno on failure.\n");
+    fprintf(out, "int useStandInStatsEventSocket(const char* socketPath);\n");
+    fprintf(out, "\n");
+    if (spillFile) {
+        fprintf(out, "// Appends the events that the sink fails to deliver to the spill file at\n");
+        fprintf(out, "// path instead of dropping them. They are replayed once the sink takes\n");
+        fprintf(out, "// events again. Events left in the file by an earlier process are kept.\n");
+        fprintf(out, "// The file is locked while it is used, so a second process gets\n");
+        fprintf(out, "// -EWOULDBLOCK. Returns 0 on success, or a negative errno on failure.\n");
+        fprintf(out, "int useStatsEventSpillFile(const char* path);\n");
+        fprintf(out, "\n");
+        fprintf(out, "// Hands the spilled events to the sink in order. Returns the number of\n");
+        fprintf(out, "// events replayed, or the error of the sink, in which case the events\n");
+        fprintf(out, "// that were not delivered stay in the spill file.\n");
+        fprintf(out, "int replayStatsEventSpillFile();\n");
+        fprintf(out, "\n");
+        fprintf(out, "// Number of events waiting in the spill file.\n");
+        fprintf(out, "size_t getStatsEventSpillFileEventCount();\n");
+        fprintf(out, "\n");
+        fprintf(out, "// Number of events dropped because the spill file was full.\n");
+        fprintf(out, "uint64_t getStatsEventSpillDropCount();\n");
+        fprintf(out, "\n");
+    }
+    if (ringTransport) {
+        fprintf(out,
+                "// Sends the encoded events through a ring in shared memory instead of one\n");
+        fprintf(out,
+                "// datagram each. The ring and the eventfd that signals new events are sent to\n");
+        fprintf(out,
+                "// the unix datagram socket bound at socketPath, where a StatsEventRingReader\n");
+        fprintf(out, "// receives them. Returns 0 on success, or a negative errno on failure.\n");
+        fprintf(out, "int useStatsEventRing(const char* socketPath);\n");
+        fprintf(out, "\n");
+        fprintf(out, "// Number of events dropped because the ring was full.\n");
+        fprintf(out, "uint64_t getStatsEventRingDropCount();\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "// Reads the events a process sends with useStatsEventRing(). Not thread safe.\n");
+        fprintf(out, "class StatsEventRingReader {\n");
+        fprintf(out, "public:\n");
+        fprintf(out, "    StatsEventRingReader();\n");
+        fprintf(out, "    ~StatsEventRingReader();\n");
+        fprintf(out, "    StatsEventRingReader(const StatsEventRingReader&) = delete;\n");
+        fprintf(out,
+                "    StatsEventRingReader& operator=(const StatsEventRingReader&) = delete;\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "    // Receives a ring from the unix datagram socket socketFd. Returns 0 on\n");
+        fprintf(out, "    // success, or a negative errno on failure.\n");
+        fprintf(out, "    int receive(int socketFd);\n");
+        fprintf(out, "\n");
+        fprintf(out, "    // Hands the events in the ring to sink in order and frees them.\n");
+        fprintf(out, "    // Returns the number of events read.\n");
+        fprintf(out, "    size_t read(StatsEventSink sink);\n");
+        fprintf(out, "\n");
+        fprintf(out,
+                "    // Waits for up to timeoutMs milliseconds for new events. Returns whether\n");
+        fprintf(out, "    // there are any.\n");
+        fprintf(out, "    bool wait(int timeoutMs);\n");
+        fprintf(out, "\n");
+        fprintf(out, "private:\n");
+        fprintf(out, "    void* mMapping;\n");
+        fprintf(out, "    int mEventFd;\n");
+        fprintf(out, "};\n");
+        fprintf(out, "\n");
+    }
+    if (compactEncoding) {
+        fprintf(out, "// Rewrites an event with compact integer fields, as handed to a sink,\n");
+        fprintf(out, "// as the plain event statsd reads. Plain events are copied unchanged.\n");
+        fprintf(out, "// Returns the size of the plain event, or a negative errno if the event\n");
+        fprintf(out, "// is malformed or does not fit in outCapacity bytes.\n");
+        fprintf(out,
+                "int expandCompactStatsEvent(const uint8_t* event, size_t size, uint8_t* out,\n");
+        fprintf(out, "                            size_t outCapacity);\n");
+        fprintf(out, "\n");
+    }
+    if (async) {
+        fprintf(out, "// Number of events dropped because the event queue was full.\n");
+        fprintf(out, "uint64_t getStatsEventQueueDropCount();\n");
+        fprintf(out, "\n");
+        fprintf(out, "// Blocks until the events queued so far have been handed to the sink.\n");
+        fprintf(out, "void flushStatsEventQueue();\n");
+        fprintf(out, "\n");
+    }
+}
+
+}  // namespace stats_log_api_gen
+}  // namespace android
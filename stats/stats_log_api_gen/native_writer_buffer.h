@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STATS_LOG_API_GEN_NATIVE_WRITER_BUFFER_H
+#define ANDROID_STATS_LOG_API_GEN_NATIVE_WRITER_BUFFER_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Collation.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+// Largest event the StatsEventBuffer encoder writes, in bytes.
+const size_t STATS_EVENT_BUFFER_MAX_PAYLOAD = 4064;
+
+// Capacity of a StatsEventBatch.
+const size_t STATS_EVENT_BATCH_MAX_EVENTS = 64;
+const size_t STATS_EVENT_BATCH_BUFFER_SIZE = 16384;
+
+// Capacity of the queue used by the asynchronous writer. Events larger than a slot take several
+// consecutive slots.
+const size_t STATS_EVENT_QUEUE_LENGTH = 512;
+const size_t STATS_EVENT_QUEUE_SLOT_SIZE = 256;
+
+// Size of the file that keeps the events the sink fails to deliver.
+const size_t STATS_EVENT_SPILL_FILE_SIZE = 1024 * 1024;
+
+// Size of the ring that hands the events to a consumer process through shared memory.
+const size_t STATS_EVENT_RING_SIZE = 256 * 1024;
+
+// Writes the includes needed by the StatsEventBuffer encoder.
+void write_native_stats_event_buffer_includes(FILE* out, bool batchWriter, bool async,
+                                              bool spillFile, bool ringTransport);
+
+// Writes the StatsEventBuffer encoder, which encodes events into a caller provided buffer instead
+// of an AStatsEvent, and the event sink it hands the encoded events to. If async is set, the
+// events are queued and handed to the sink on a background thread. If spillFile is set, the
+// events the sink fails to deliver are kept in a memory mapped file and replayed later. If
+// ringTransport is set, the events can be sent through a ring in shared memory instead. If
+// compactEncoding is set, the events of the atoms for which is_compact_atom() returns true write
+// small integers as varints, and are expanded before they reach statsd.
+void write_native_stats_event_buffer_helpers(FILE* out, bool batchWriter, bool async,
+                                             bool spillFile, bool ringTransport,
+                                             bool compactEncoding);
+
+// Writes the StatsEventBatch methods that do not depend on the atom signatures.
+void write_native_stats_event_batch_methods(FILE* out);
+
+// Writes the StatsEventBatch class declaration, up to and after its stats_write methods.
+void write_native_stats_event_batch_header_start(FILE* out);
+void write_native_stats_event_batch_header_end(FILE* out);
+
+// Writes the declarations of the event sink methods.
+void write_native_stats_event_buffer_header(FILE* out, bool async, bool spillFile,
+                                            bool ringTransport, bool compactEncoding);
+
+}  // namespace stats_log_api_gen
+}  // namespace android
+
+#endif  // ANDROID_STATS_LOG_API_GEN_NATIVE_WRITER_BUFFER_H
@@ -335,11 +335,11 @@ int write_stats_log_header_vendor(FILE* out, const Atoms& atoms, const AtomDecl&
 
                 fprintf(out, "enum %s {\n", field->enumTypeName.c_str());
                 size_t i = 0;
-                for (map<int, string>::const_iterator value = field->enumValues.begin();
-                     value != field->enumValues.end(); value++) {
+                for (map<int, string>::const_iterator value = field->enumValues->begin();
+                     value != field->enumValues->end(); value++) {
                     fprintf(out, "    %s = %d", make_constant_name(value->second).c_str(),
                             value->first);
-                    char const* const comma = (i == field->enumValues.size() - 1) ? "" : ",";
+                    char const* const comma = (i == field->enumValues->size() - 1) ? "" : ",";
                     fprintf(out, "%s\n", comma);
                     i++;
                 }
@@ -55,25 +55,6 @@ const char* rust_type_name(java_type_t type, bool lifetime) {
     }
 }
 
-static string make_camel_case_name(const string& str) {
-    string result;
-    const int N = str.size();
-    bool justSawUnderscore = false;
-    for (int i = 0; i < N; i++) {
-        char c = str[i];
-        if (c == '_') {
-            justSawUnderscore = true;
-            // Don't add the underscore to our result
-        } else if (i == 0 || justSawUnderscore) {
-            result += toupper(c);
-            justSawUnderscore = false;
-        } else {
-            result += tolower(c);
-        }
-    }
-    return result;
-}
-
 static string make_snake_case_name(const string& str) {
     string result;
     const int N = str.size();
@@ -197,19 +178,36 @@ static void write_rust_atom_constants(FILE* out, const Atoms& atoms,
     fprintf(out, "\n");
 }
 
-static void write_rust_atom_constant_values(FILE* out, const shared_ptr<AtomDecl>& atomDecl) {
+static void write_rust_enum(FILE* out, const string& name, const map<int, string>& enumValues) {
+    fprintf(out, "    #[repr(i32)]\n");
+    fprintf(out, "    #[derive(Clone, Copy, Eq, PartialEq)]\n");
+    fprintf(out, "    pub enum %s {\n", name.c_str());
+    for (map<int, string>::const_iterator value = enumValues.begin(); value != enumValues.end();
+         value++) {
+        fprintf(out, "        %s = %d,\n", make_camel_case_name(value->second).c_str(),
+                value->first);
+    }
+    fprintf(out, "    }\n");
+}
+
+// Maps the values of the enum types used by more than one field to their Rust names. The fields
+// of an enum type share its values, so the values identify the type.
+using RustSharedEnums = map<const map<int, string>*, string>;
+
+// The enums of sharedEnums are defined once in the shared_enums module, and the atom module only
+// gets an alias named after the field.
+static void write_rust_atom_constant_values(FILE* out, const shared_ptr<AtomDecl>& atomDecl,
+                                            const RustSharedEnums& sharedEnums) {
     bool hasConstants = false;
     for (const AtomField& field : atomDecl->fields) {
         if (field.javaType == JAVA_TYPE_ENUM) {
-            fprintf(out, "    #[repr(i32)]\n");
-            fprintf(out, "    #[derive(Clone, Copy, Eq, PartialEq)]\n");
-            fprintf(out, "    pub enum %s {\n", make_camel_case_name(field.name).c_str());
-            for (map<int, string>::const_iterator value = field.enumValues.begin();
-                 value != field.enumValues.end(); value++) {
-                fprintf(out, "        %s = %d,\n", make_camel_case_name(value->second).c_str(),
-                        value->first);
+            const auto sharedEnum = sharedEnums.find(field.enumValues.get());
+            if (sharedEnum != sharedEnums.end()) {
+                fprintf(out, "    pub use super::shared_enums::%s as %s;\n",
+                        sharedEnum->second.c_str(), make_camel_case_name(field.name).c_str());
+            } else {
+                write_rust_enum(out, make_camel_case_name(field.name), *field.enumValues);
             }
-            fprintf(out, "    }\n");
             hasConstants = true;
         }
     }
@@ -294,9 +292,207 @@ static void write_annotations(FILE* out, int argIndex, const AtomDecl& atomDecl,
     }
 }
 
+// Returns true if the atom has a field type that the Rust writer does not support yet.
+static bool has_unsupported_rust_field(const AtomDecl& atomDecl) {
+    // TODO(b/216543320): support repeated fields in Rust
+    return std::find_if(atomDecl.fields.begin(), atomDecl.fields.end(),
+                        [](const AtomField& atomField) {
+                            return is_repeated_field(atomField.javaType);
+                        }) != atomDecl.fields.end();
+}
+
+// Returns the Rust name of an enum type, such as AndroidAppProcessStateEnum for
+// android.app.ProcessStateEnum.
+static string get_rust_enum_type_name(const string& fullTypeName) {
+    string result;
+    bool justSawDot = true;
+    for (const char c : fullTypeName) {
+        if (c == '.') {
+            justSawDot = true;
+        } else if (justSawDot) {
+            result += toupper(c);
+            justSawDot = false;
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+// Returns the enum types used by more than one field of the supported atoms.
+static RustSharedEnums get_rust_shared_enums(const AtomDeclSet& atomDeclSet) {
+    map<const map<int, string>*, int> fieldCounts;
+    RustSharedEnums sharedEnums;
+    for (const shared_ptr<AtomDecl>& atomDecl : atomDeclSet) {
+        if (has_unsupported_rust_field(*atomDecl)) {
+            continue;
+        }
+        for (const AtomField& field : atomDecl->fields) {
+            if (field.javaType == JAVA_TYPE_ENUM && ++fieldCounts[field.enumValues.get()] == 2) {
+                sharedEnums[field.enumValues.get()] =
+                        get_rust_enum_type_name(field.enumFullTypeName);
+            }
+        }
+    }
+    return sharedEnums;
+}
+
+static void write_rust_shared_enums(FILE* out, const RustSharedEnums& sharedEnums) {
+    if (sharedEnums.empty()) {
+        return;
+    }
+    // Sorted by name, so that the output does not depend on where the values are allocated.
+    map<string, const map<int, string>*> sortedEnums;
+    for (const auto& [enumValues, name] : sharedEnums) {
+        sortedEnums[name] = enumValues;
+    }
+    fprintf(out, "pub mod shared_enums {\n");
+    for (const auto& [name, enumValues] : sortedEnums) {
+        write_rust_enum(out, name, *enumValues);
+    }
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+static void write_rust_name_hash_table(FILE* out, const string& prefix,
+                                       const NameHashTable& table) {
+    fprintf(out, "static %s_SEEDS: [i32; %zu] = [", prefix.c_str(), table.seeds.size());
+    for (size_t i = 0; i < table.seeds.size(); i++) {
+        fprintf(out, "%s%d,", i % 16 == 0 ? "\n    " : " ", table.seeds[i]);
+    }
+    fprintf(out, "\n];\n");
+    fprintf(out, "\n");
+    fprintf(out, "static %s_ENTRIES: [(&str, i32); %zu] = [\n", prefix.c_str(),
+            table.names.size());
+    for (size_t i = 0; i < table.names.size(); i++) {
+        fprintf(out, "    (\"%s\", %d),\n", table.names[i].c_str(), table.values[i]);
+    }
+    fprintf(out, "];\n");
+    fprintf(out, "\n");
+}
+
+// Writes get_atom_code() and get_enum_value(), which look the names up in minimal perfect hash
+// tables built by build_name_hash_table().
+static void write_rust_name_lookup(FILE* out, const Atoms& atoms) {
+    fprintf(out, "fn name_hash(name: &str, seed: u32) -> u32 {\n");
+    fprintf(out, "    let mut hash = 0x%08xu32 ^ seed;\n", NAME_HASH_OFFSET_BASIS);
+    fprintf(out, "    for byte in name.bytes() {\n");
+    fprintf(out, "        hash = (hash ^ u32::from(byte)).wrapping_mul(0x%08x);\n",
+            NAME_HASH_PRIME);
+    fprintf(out, "    }\n");
+    fprintf(out, "    hash ^= hash >> 16;\n");
+    fprintf(out, "    hash = hash.wrapping_mul(0x%08x);\n", NAME_HASH_MIX);
+    fprintf(out, "    hash ^= hash >> 15;\n");
+    fprintf(out, "    hash\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "// Returns the value of the name in a minimal perfect hash table.\n");
+    fprintf(out,
+            "fn find_name(seeds: &[i32], entries: &[(&str, i32)], name: &str) -> Option<i32> "
+            "{\n");
+    fprintf(out, "    if entries.is_empty() {\n");
+    fprintf(out, "        return None;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    let seed = seeds[name_hash(name, 0) as usize %% entries.len()];\n");
+    fprintf(out, "    let slot = if seed < 0 {\n");
+    fprintf(out, "        (-seed - 1) as usize\n");
+    fprintf(out, "    } else {\n");
+    fprintf(out, "        name_hash(name, seed as u32) as usize %% entries.len()\n");
+    fprintf(out, "    };\n");
+    fprintf(out, "    let (entry_name, value) = entries[slot];\n");
+    fprintf(out, "    if entry_name == name {\n");
+    fprintf(out, "        Some(value)\n");
+    fprintf(out, "    } else {\n");
+    fprintf(out, "        None\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    write_rust_name_hash_table(out, "ATOM_NAME", build_name_hash_table(get_atom_name_codes(atoms)));
+    write_rust_name_hash_table(out, "ENUM_NAME",
+                               build_name_hash_table(get_enum_name_values(atoms)));
+    fprintf(out, "/// Returns the code of the atom with this constant name, such as\n");
+    fprintf(out, "/// \"BLE_SCAN_STATE_CHANGED\".\n");
+    fprintf(out, "pub fn get_atom_code(name: &str) -> Option<i32> {\n");
+    fprintf(out, "    find_name(&ATOM_NAME_SEEDS, &ATOM_NAME_ENTRIES, name)\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "/// Returns the enum value with this constant name, such as\n");
+    fprintf(out, "/// \"BLE_SCAN_STATE_CHANGED__STATE__ON\".\n");
+    fprintf(out, "pub fn get_enum_value(name: &str) -> Option<i32> {\n");
+    fprintf(out, "    find_name(&ENUM_NAME_SEEDS, &ENUM_NAME_ENTRIES, name)\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
+static void write_rust_atom_enable_bitmap(FILE* out, const Atoms& atoms,
+                                          const map<int, int>& atomIndices,
+                                          const char* headerCrate) {
+    const size_t wordCount = std::max<size_t>(1, (atomIndices.size() + 63) / 64);
+
+    fprintf(out, "// One bit per pushed atom. All atoms start out enabled.\n");
+    fprintf(out, "#[allow(clippy::declare_interior_mutable_const)]\n");
+    fprintf(out,
+            "const ATOM_ENABLE_WORD: std::sync::atomic::AtomicU64 = "
+            "std::sync::atomic::AtomicU64::new(u64::MAX);\n");
+    fprintf(out,
+            "static ATOM_ENABLE_BITMAP: [std::sync::atomic::AtomicU64; %zu] = "
+            "[ATOM_ENABLE_WORD; %zu];\n",
+            wordCount, wordCount);
+    fprintf(out, "\n");
+    fprintf(out, "#[allow(unreachable_patterns)]\n");
+    fprintf(out, "fn atom_index(atom: %s::Atoms) -> Option<usize> {\n", headerCrate);
+    fprintf(out, "    match atom {\n");
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        const auto atomIndexIt = atomIndices.find(atomDecl->code);
+        if (atomDecl->atomType != ATOM_TYPE_PUSHED || atomIndexIt == atomIndices.end() ||
+            has_unsupported_rust_field(*atomDecl)) {
+            continue;
+        }
+        fprintf(out, "        %s::Atoms::%s => Some(%d),\n", headerCrate,
+                make_camel_case_name(atomDecl->name).c_str(), atomIndexIt->second);
+    }
+    fprintf(out, "        _ => None,\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "fn is_atom_index_enabled(index: usize) -> bool {\n");
+    fprintf(out,
+            "    ATOM_ENABLE_BITMAP[index / 64].load(std::sync::atomic::Ordering::Relaxed) &\n");
+    fprintf(out, "        (1u64 << (index %% 64)) != 0\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "/// Enables or disables the logging of a pushed atom. stats_write of a\n");
+    fprintf(out, "/// disabled atom returns Ok without building the event.\n");
+    fprintf(out, "pub fn set_atom_enabled(atom: %s::Atoms, enabled: bool) {\n", headerCrate);
+    fprintf(out, "    if let Some(index) = atom_index(atom) {\n");
+    fprintf(out, "        let bit = 1u64 << (index %% 64);\n");
+    fprintf(out, "        if enabled {\n");
+    fprintf(out,
+            "            ATOM_ENABLE_BITMAP[index / 64].fetch_or(bit, "
+            "std::sync::atomic::Ordering::Relaxed);\n");
+    fprintf(out, "        } else {\n");
+    fprintf(out,
+            "            ATOM_ENABLE_BITMAP[index / 64].fetch_and(!bit, "
+            "std::sync::atomic::Ordering::Relaxed);\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+    fprintf(out, "/// Returns whether the logging of a pushed atom is enabled.\n");
+    fprintf(out, "pub fn is_atom_enabled(atom: %s::Atoms) -> bool {\n", headerCrate);
+    fprintf(out, "    atom_index(atom).map_or(true, is_atom_index_enabled)\n");
+    fprintf(out, "}\n");
+    fprintf(out, "\n");
+}
+
 static int write_rust_method_body(FILE* out, const AtomDecl& atomDecl,
                                   const AtomDecl& attributionDecl, const int minApiLevel,
-                                  const char* headerCrate) {
+                                  const char* headerCrate, int atomIndex) {
+    if (atomIndex >= 0) {
+        fprintf(out, "        if !crate::is_atom_index_enabled(%d) {\n", atomIndex);
+        fprintf(out, "            return %s::StatsResult::Ok(());\n", headerCrate);
+        fprintf(out, "        }\n");
+    }
     fprintf(out, "        unsafe {\n");
     if (minApiLevel == API_Q) {
         fprintf(stderr, "TODO: Do we need to handle this case?");
@@ -382,7 +578,7 @@ static int write_rust_method_body(FILE* out, const AtomDecl& atomDecl,
 
 static int write_rust_stats_write_method(FILE* out, const shared_ptr<AtomDecl>& atomDecl,
                                          const AtomDecl& attributionDecl, const int minApiLevel,
-                                         const char* headerCrate) {
+                                         const char* headerCrate, int atomIndex) {
     if (atomDecl->atomType == ATOM_TYPE_PUSHED) {
         write_rust_method_signature(out, "stats_write", *atomDecl, attributionDecl, true, false,
                                     headerCrate);
@@ -390,7 +586,8 @@ static int write_rust_stats_write_method(FILE* out, const shared_ptr<AtomDecl>&
         write_rust_method_signature(out, "add_astats_event", *atomDecl, attributionDecl, true,
                                     false, headerCrate);
     }
-    int ret = write_rust_method_body(out, *atomDecl, attributionDecl, minApiLevel, headerCrate);
+    int ret = write_rust_method_body(out, *atomDecl, attributionDecl, minApiLevel, headerCrate,
+                                     atomIndex);
     if (ret != 0) {
         return ret;
     }
@@ -517,13 +714,13 @@ static void write_rust_struct(FILE* out, const shared_ptr<AtomDecl>& atomDecl,
 static int write_rust_stats_write_atoms(FILE* out, const AtomDeclSet& atomDeclSet,
                                         const AtomDecl& attributionDecl,
                                         const AtomDeclSet& nonChainedAtomDeclSet,
-                                        const int minApiLevel, const char* headerCrate) {
+                                        const int minApiLevel, const char* headerCrate,
+                                        const map<int, int>& atomIndices, bool sharedEnums) {
+    const RustSharedEnums rustSharedEnums =
+            sharedEnums ? get_rust_shared_enums(atomDeclSet) : RustSharedEnums();
+    write_rust_shared_enums(out, rustSharedEnums);
     for (const auto& atomDecl : atomDeclSet) {
-        // TODO(b/216543320): support repeated fields in Rust
-        if (std::find_if(atomDecl->fields.begin(), atomDecl->fields.end(),
-                         [](const AtomField& atomField) {
-                             return is_repeated_field(atomField.javaType);
-                         }) != atomDecl->fields.end()) {
+        if (has_unsupported_rust_field(*atomDecl)) {
             continue;
         }
         fprintf(out, "pub mod %s {\n", atomDecl->name.c_str());
@@ -531,10 +728,14 @@ static int write_rust_stats_write_atoms(FILE* out, const AtomDeclSet& atomDeclSe
         fprintf(out, "    #[allow(unused)]\n");
         fprintf(out, "    use std::convert::TryInto;\n");
         fprintf(out, "\n");
-        write_rust_atom_constant_values(out, atomDecl);
+        write_rust_atom_constant_values(out, atomDecl, rustSharedEnums);
         write_rust_struct(out, atomDecl, attributionDecl, headerCrate);
+        const auto atomIndexIt = atomDecl->atomType == ATOM_TYPE_PUSHED
+                                         ? atomIndices.find(atomDecl->code)
+                                         : atomIndices.end();
+        const int atomIndex = atomIndexIt != atomIndices.end() ? atomIndexIt->second : -1;
         int ret = write_rust_stats_write_method(out, atomDecl, attributionDecl, minApiLevel,
-                                                headerCrate);
+                                                headerCrate, atomIndex);
         if (ret != 0) {
             return ret;
         }
@@ -577,7 +778,8 @@ void write_stats_log_rust_header(FILE* out, const Atoms& atoms, const AtomDecl&
 }
 
 int write_stats_log_rust(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
-                         const int minApiLevel, const char* headerCrate) {
+                         const int minApiLevel, const char* headerCrate, bool atomEnableBitmap,
+                         bool nameLookup, bool sharedEnums) {
     // Print prelude
     fprintf(out, "// This file is autogenerated.\n");
     fprintf(out, "\n");
@@ -592,8 +794,21 @@ int write_stats_log_rust(FILE* out, const Atoms& atoms, const AtomDecl& attribut
 
     write_rust_annotation_constants(out);
 
-    int errorCount = write_rust_stats_write_atoms(
-            out, atoms.decls, attributionDecl, atoms.non_chained_decls, minApiLevel, headerCrate);
+    // Without the bitmap no atom has an index, so no write method checks it.
+    map<int, int> atomIndices;
+    if (atomEnableBitmap) {
+        atomIndices = get_pushed_atom_indices(atoms);
+        write_rust_atom_enable_bitmap(out, atoms, atomIndices, headerCrate);
+    }
+
+    if (nameLookup) {
+        write_rust_name_lookup(out, atoms);
+    }
+
+    int errorCount =
+            write_rust_stats_write_atoms(out, atoms.decls, attributionDecl,
+                                         atoms.non_chained_decls, minApiLevel, headerCrate,
+                                         atomIndices, sharedEnums);
 
     return errorCount;
 }
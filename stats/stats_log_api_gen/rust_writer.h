@@ -24,7 +24,8 @@ namespace android {
 namespace stats_log_api_gen {
 
 int write_stats_log_rust(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
-                         const int minApiLevel, const char* rustHeaderCrate);
+                         const int minApiLevel, const char* rustHeaderCrate,
+                         bool atomEnableBitmap, bool nameLookup, bool sharedEnums);
 
 void write_stats_log_rust_header(FILE* out, const Atoms& atoms, const AtomDecl& attributionDecl,
                                  const char* rustHeaderCrate);
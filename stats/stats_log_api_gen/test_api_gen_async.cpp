@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <test_async_atoms.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace api_gen_async_tests {
+
+using namespace android::AsyncAtoms;
+
+using std::vector;
+
+namespace {
+
+// The events that reached the sink, and the threads that handed them to it.
+std::mutex sSinkMutex;
+std::condition_variable sSinkCondition;
+vector<int32_t> sSinkValues;
+vector<std::string> sSinkEvents;
+vector<std::thread::id> sSinkThreads;
+bool sSinkBlocked = false;
+
+// Records the last field of the event, which the tests write as an int32.
+int capture_event(const uint8_t* buffer, size_t size, uint32_t) {
+    int32_t value;
+    memcpy(&value, buffer + size - sizeof(value), sizeof(value));
+    std::unique_lock<std::mutex> lock(sSinkMutex);
+    sSinkCondition.wait(lock, [] { return !sSinkBlocked; });
+    sSinkValues.push_back(value);
+    sSinkEvents.emplace_back(reinterpret_cast<const char*>(buffer), size);
+    sSinkThreads.push_back(std::this_thread::get_id());
+    return size;
+}
+
+// Hands the queued events to the sink, then clears the events that reached it.
+void reset_sink() {
+    setStatsEventSink(&capture_event);
+    flushStatsEventQueue();
+    std::lock_guard<std::mutex> lock(sSinkMutex);
+    sSinkValues.clear();
+    sSinkEvents.clear();
+    sSinkThreads.clear();
+}
+
+void set_sink_blocked(bool blocked) {
+    std::lock_guard<std::mutex> lock(sSinkMutex);
+    sSinkBlocked = blocked;
+    sSinkCondition.notify_all();
+}
+
+vector<int32_t> get_sink_values() {
+    std::lock_guard<std::mutex> lock(sSinkMutex);
+    return sSinkValues;
+}
+
+}  // namespace
+
+/**
+ * Tests that the events written from several threads all reach the sink on the drainer thread,
+ * in the order each thread wrote them.
+ */
+TEST(ApiGenAsyncTest, QueueDeliversEventsInOrderTest) {
+    reset_sink();
+    const uint64_t dropCount = getStatsEventQueueDropCount();
+
+    // Fewer events than the queue holds, so that none is dropped.
+    const int32_t threadCount = 4;
+    const int32_t eventsPerThread = 100;
+    vector<std::thread> threads;
+    for (int32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back([i] {
+            for (int32_t j = 0; j < eventsPerThread; j++) {
+                EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, i * eventsPerThread + j), 0);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    flushStatsEventQueue();
+
+    const vector<int32_t> values = get_sink_values();
+    ASSERT_EQ(values.size(), static_cast<size_t>(threadCount * eventsPerThread));
+    vector<int32_t> nextValues;
+    for (int32_t i = 0; i < threadCount; i++) {
+        nextValues.push_back(i * eventsPerThread);
+    }
+    for (const int32_t value : values) {
+        const int32_t thread = value / eventsPerThread;
+        ASSERT_GE(thread, 0);
+        ASSERT_LT(thread, threadCount);
+        EXPECT_EQ(value, nextValues[thread]++);
+    }
+    EXPECT_EQ(getStatsEventQueueDropCount(), dropCount);
+
+    std::lock_guard<std::mutex> lock(sSinkMutex);
+    for (const std::thread::id& sinkThread : sSinkThreads) {
+        EXPECT_NE(sinkThread, std::this_thread::get_id());
+    }
+}
+
+/**
+ * Tests that a write fails and is counted once the queue is full, and that the events queued
+ * before it still reach the sink.
+ */
+TEST(ApiGenAsyncTest, QueueOverflowTest) {
+    reset_sink();
+    const uint64_t dropCount = getStatsEventQueueDropCount();
+
+    set_sink_blocked(true);
+    int32_t queuedCount = 0;
+    int result = 0;
+    while (queuedCount < 100000) {
+        result = stats_write(SCREEN_BRIGHTNESS_CHANGED, queuedCount);
+        if (result < 0) {
+            break;
+        }
+        queuedCount++;
+    }
+    EXPECT_EQ(result, -ENOBUFS);
+    EXPECT_GT(queuedCount, 0);
+    EXPECT_EQ(getStatsEventQueueDropCount(), dropCount + 1);
+
+    set_sink_blocked(false);
+    flushStatsEventQueue();
+    const vector<int32_t> values = get_sink_values();
+    ASSERT_EQ(values.size(), static_cast<size_t>(queuedCount));
+    for (int32_t i = 0; i < queuedCount; i++) {
+        EXPECT_EQ(values[i], i);
+    }
+}
+
+/**
+ * Tests that events larger than a queue slot are queued whole, in order with the small events,
+ * including the ones that wrap around the end of the queue.
+ */
+TEST(ApiGenAsyncTest, LargeEventTest) {
+    reset_sink();
+    const uint64_t dropCount = getStatsEventQueueDropCount();
+
+    const std::string processName(1000, 'p');
+    const int32_t eventCount = 2000;
+    for (int32_t i = 0; i < eventCount; i++) {
+        if (i % 3 == 0) {
+            EXPECT_GT(stats_write(PROCESS_LIFE_CYCLE_STATE_CHANGED, 1000, processName.c_str(), i),
+                      0);
+        } else {
+            EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, i), 0);
+        }
+        // Keep the queue from filling up, at a period that is not a divisor of its length.
+        if (i % 37 == 0) {
+            flushStatsEventQueue();
+        }
+    }
+    flushStatsEventQueue();
+    EXPECT_EQ(getStatsEventQueueDropCount(), dropCount);
+
+    std::lock_guard<std::mutex> lock(sSinkMutex);
+    ASSERT_EQ(sSinkValues.size(), static_cast<size_t>(eventCount));
+    for (int32_t i = 0; i < eventCount; i++) {
+        EXPECT_EQ(sSinkValues[i], i);
+        EXPECT_EQ(sSinkEvents[i].find(processName) != std::string::npos, i % 3 == 0);
+        EXPECT_NE(sSinkThreads[i], std::this_thread::get_id());
+    }
+}
+
+/**
+ * Tests that an event larger than the free part of the queue fails and is counted, while a
+ * smaller event still fits.
+ */
+TEST(ApiGenAsyncTest, LargeEventOverflowTest) {
+    reset_sink();
+
+    // Counts the events that fill the empty queue.
+    set_sink_blocked(true);
+    int32_t queueLength = 0;
+    while (stats_write(SCREEN_BRIGHTNESS_CHANGED, queueLength) > 0) {
+        queueLength++;
+    }
+    set_sink_blocked(false);
+    reset_sink();
+    const uint64_t dropCount = getStatsEventQueueDropCount();
+
+    // Leaves two slots free, fewer than the large event takes.
+    set_sink_blocked(true);
+    for (int32_t i = 0; i < queueLength - 2; i++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, i), 0);
+    }
+    const std::string processName(1000, 'p');
+    EXPECT_EQ(stats_write(PROCESS_LIFE_CYCLE_STATE_CHANGED, 1000, processName.c_str(), -1),
+              -ENOBUFS);
+    EXPECT_EQ(getStatsEventQueueDropCount(), dropCount + 1);
+    EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, queueLength - 2), 0);
+
+    set_sink_blocked(false);
+    flushStatsEventQueue();
+    const vector<int32_t> values = get_sink_values();
+    ASSERT_EQ(values.size(), static_cast<size_t>(queueLength - 1));
+    for (int32_t i = 0; i < queueLength - 1; i++) {
+        EXPECT_EQ(values[i], i);
+    }
+}
+
+}  // namespace api_gen_async_tests
+}  // namespace android
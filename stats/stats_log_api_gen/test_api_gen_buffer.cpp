@@ -0,0 +1,765 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stats_annotations.h>
+#include <stats_event.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <test_buffer_atoms.h>
+#include <test_buffer_atoms_decoder.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace api_gen_buffer_tests {
+
+using namespace android::BufferAtoms;
+
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Sizes of the header of the spill file and of the header of each of its records.
+const size_t kSpillHeaderSize = 16;
+const size_t kSpillRecordHeaderSize = 8;
+
+// Upper bound of the size of an event, larger than the payload limit of statsd.
+const size_t kMaxEventSize = 4096;
+
+// The payload limit of statsd, which is the size of the largest event the encoder writes.
+const size_t kMaxPayloadSize = 4064;
+
+vector<vector<uint8_t>> sSinkEvents;
+
+int capture_event(const uint8_t* buffer, size_t size, uint32_t) {
+    sSinkEvents.emplace_back(buffer, buffer + size);
+    return size;
+}
+
+int fail_event(const uint8_t*, size_t, uint32_t) {
+    return -EAGAIN;
+}
+
+// Clears the elapsed timestamp, so that events written at different times can be compared.
+vector<uint8_t> without_timestamp(vector<uint8_t> event) {
+    const size_t timestampPos = 3;
+    if (event.size() >= timestampPos + sizeof(int64_t)) {
+        std::fill_n(event.begin() + timestampPos, sizeof(int64_t), 0);
+    }
+    return event;
+}
+
+// Returns the event that build writes through AStatsEvent, without its timestamp.
+template <typename Builder>
+vector<uint8_t> reference_event(Builder&& build) {
+    AStatsEvent* event = AStatsEvent_obtain();
+    build(event);
+    AStatsEvent_build(event);
+    size_t size;
+    const uint8_t* buffer = AStatsEvent_getBuffer(event, &size);
+    vector<uint8_t> bytes(buffer, buffer + size);
+    AStatsEvent_release(event);
+    return without_timestamp(bytes);
+}
+
+// The fields of TestAtomReported that the tests vary. The other fields take fixed values.
+struct TestAtomFields {
+    const char* tag = "tag";
+    const char* stringField = "string";
+    vector<int32_t> repeatedInts = {300, -4};
+    vector<char const*> repeatedStrings = {"a", "bc"};
+};
+
+const int32_t kTestAtomUids[] = {1000};
+const uint8_t kTestAtomBytes[] = {1, 2, 3};
+const bool kTestAtomBools[] = {true, false};
+const vector<int64_t> kTestAtomLongs = {int64_t{1} << 40, -1};
+const vector<float> kTestAtomFloats = {0.25f};
+const vector<int32_t> kTestAtomEnums = {TEST_ATOM_REPORTED__REPEATED_ENUM_FIELD__OFF};
+
+// Writes a TestAtomReported shaped atom through the generated encoder and returns the events
+// that reached the sink.
+vector<vector<uint8_t>> write_test_atom(int32_t code, const TestAtomFields& fields) {
+    const vector<char const*> tags = {fields.tag};
+    const BytesField bytesField(reinterpret_cast<const char*>(kTestAtomBytes),
+                                sizeof(kTestAtomBytes));
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    stats_write(code, kTestAtomUids, 1, tags, -7, int64_t{1} << 33, 1.5f, fields.stringField, true,
+                TEST_ATOM_REPORTED__STATE__ON, bytesField, fields.repeatedInts, kTestAtomLongs,
+                kTestAtomFloats, fields.repeatedStrings, kTestAtomBools, 2, kTestAtomEnums);
+    return sSinkEvents;
+}
+
+// Returns the event that AStatsEvent builds for the atom that write_test_atom() writes.
+vector<uint8_t> reference_test_atom(int32_t code, const TestAtomFields& fields) {
+    return reference_event([code, &fields](AStatsEvent* event) {
+        AStatsEvent_setAtomId(event, code);
+        AStatsEvent_writeAttributionChain(event, reinterpret_cast<const uint32_t*>(kTestAtomUids),
+                                          &fields.tag, 1);
+        AStatsEvent_writeInt32(event, -7);
+        AStatsEvent_writeInt64(event, int64_t{1} << 33);
+        AStatsEvent_writeFloat(event, 1.5f);
+        AStatsEvent_writeString(event, fields.stringField);
+        AStatsEvent_writeBool(event, true);
+        AStatsEvent_writeInt32(event, TEST_ATOM_REPORTED__STATE__ON);
+        AStatsEvent_writeByteArray(event, kTestAtomBytes, sizeof(kTestAtomBytes));
+        AStatsEvent_writeInt32Array(event, fields.repeatedInts.data(), fields.repeatedInts.size());
+        AStatsEvent_writeInt64Array(event, kTestAtomLongs.data(), kTestAtomLongs.size());
+        AStatsEvent_writeFloatArray(event, kTestAtomFloats.data(), kTestAtomFloats.size());
+        AStatsEvent_writeStringArray(event, fields.repeatedStrings.data(),
+                                     fields.repeatedStrings.size());
+        AStatsEvent_writeBoolArray(event, kTestAtomBools, 2);
+        AStatsEvent_writeInt32Array(event, kTestAtomEnums.data(), kTestAtomEnums.size());
+    });
+}
+
+// The field values that exercise the edge cases of the encoding.
+vector<TestAtomFields> get_test_atom_cases() {
+    vector<TestAtomFields> cases(5);
+    // Null strings are written as empty strings.
+    cases[1].tag = nullptr;
+    cases[1].stringField = nullptr;
+    cases[1].repeatedStrings = {"a", nullptr};
+    // Lists of more than 127 elements turn the event into an error event.
+    cases[2].repeatedInts.assign(128, 1);
+    cases[3].repeatedStrings.assign(200, "s");
+    // Events larger than the payload limit turn into an overflow error event.
+    static const std::string longString(5000, 'x');
+    cases[4].stringField = longString.c_str();
+    return cases;
+}
+
+// Expects that events holds one event of Atom, which decodes to the fields write_test_atom()
+// writes by default, and that the decoder rejects the event when it is truncated.
+template <typename Atom>
+void expect_decoded_test_atom(const vector<vector<uint8_t>>& events) {
+    ASSERT_EQ(events.size(), static_cast<size_t>(1));
+    const vector<uint8_t>& event = events[0];
+    Atom atom;
+    ASSERT_TRUE(decodeStatsEvent(event.data(), event.size(), &atom));
+    EXPECT_EQ(atom.int_field, -7);
+    EXPECT_EQ(atom.long_field, int64_t{1} << 33);
+    EXPECT_EQ(atom.string_field, "string");
+    EXPECT_EQ(atom.state, TEST_ATOM_REPORTED__STATE__ON);
+    ASSERT_EQ(atom.bytes_field.size, sizeof(kTestAtomBytes));
+    EXPECT_EQ(atom.bytes_field[2], kTestAtomBytes[2]);
+    ASSERT_EQ(atom.repeated_int_field.size, static_cast<size_t>(2));
+    EXPECT_EQ(atom.repeated_int_field[0], 300);
+    EXPECT_EQ(atom.repeated_int_field[1], -4);
+    vector<std::string_view> strings;
+    atom.repeated_string_field.forEach(
+            [&strings](std::string_view value) { strings.push_back(value); });
+    EXPECT_EQ(strings, vector<std::string_view>({"a", "bc"}));
+    vector<std::pair<int32_t, std::string_view>> nodes;
+    atom.attribution_node.forEach(
+            [&nodes](int32_t uid, std::string_view tag) { nodes.emplace_back(uid, tag); });
+    EXPECT_EQ(nodes, (vector<std::pair<int32_t, std::string_view>>({{kTestAtomUids[0], "tag"}})));
+
+    ScreenBrightnessChanged otherAtom;
+    EXPECT_FALSE(decodeStatsEvent(event.data(), event.size(), &otherAtom));
+    EXPECT_TRUE(visitStatsEvent(event.data(), event.size(), [](const auto&) {}));
+    for (size_t truncated = 0; truncated < event.size(); truncated++) {
+        const vector<uint8_t> prefix(event.begin(), event.begin() + truncated);
+        EXPECT_FALSE(decodeStatsEvent(prefix.data(), prefix.size(), &atom))
+                << "truncated to " << truncated << " bytes";
+        EXPECT_FALSE(visitStatsEvent(prefix.data(), prefix.size(), [](const auto&) {}));
+    }
+}
+
+}  // namespace
+
+/**
+ * Tests that the per-atom write methods emit the annotations of the atom, including the state
+ * reset annotation that depends on the value, like the AStatsEvent calls they replace.
+ */
+TEST(ApiGenBufferTest, PerAtomAnnotationsTest) {
+    const int32_t uids[] = {1000};
+    const std::string_view tags[] = {"tag"};
+    const char* const referenceTags[] = {"tag"};
+
+    setStatsEventSink(&capture_event);
+    for (const int32_t state :
+         {BLE_SCAN_STATE_CHANGED__STATE__OFF, BLE_SCAN_STATE_CHANGED__STATE__ON,
+          BLE_SCAN_STATE_CHANGED__STATE__RESET}) {
+        sSinkEvents.clear();
+        EXPECT_GT(ble_scan_state_changed::stats_write(uids, 1, tags, state, true, false, true), 0);
+        ASSERT_EQ(sSinkEvents.size(), static_cast<size_t>(1));
+
+        const vector<uint8_t> expected = reference_event([&](AStatsEvent* event) {
+            AStatsEvent_setAtomId(event, BLE_SCAN_STATE_CHANGED);
+            AStatsEvent_writeAttributionChain(event, reinterpret_cast<const uint32_t*>(uids),
+                                              referenceTags, 1);
+            AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD_FIRST_UID,
+                                          true);
+            AStatsEvent_writeInt32(event, state);
+            AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_EXCLUSIVE_STATE, true);
+            AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_STATE_NESTED, true);
+            if (state == BLE_SCAN_STATE_CHANGED__STATE__RESET) {
+                AStatsEvent_addInt32Annotation(event, ASTATSLOG_ANNOTATION_ID_TRIGGER_STATE_RESET,
+                                               BLE_SCAN_STATE_CHANGED__STATE__OFF);
+            }
+            for (const bool value : {true, false, true}) {
+                AStatsEvent_writeBool(event, value);
+                AStatsEvent_addBoolAnnotation(event, ASTATSLOG_ANNOTATION_ID_PRIMARY_FIELD, true);
+            }
+        });
+        EXPECT_EQ(without_timestamp(sSinkEvents[0]), expected);
+    }
+}
+
+/**
+ * Tests that stats_write<ATOM>() writes the same event as the per-atom method, and that the traits
+ * of the atom describe it.
+ */
+TEST(ApiGenBufferTest, TemplateApiTest) {
+    const int32_t uids[] = {1000};
+    const vector<char const*> tags = {"tag"};
+    static_assert(AtomTraits<BLE_SCAN_STATE_CHANGED>::fieldCount == 5);
+    static_assert(AtomTraits<BLE_SCAN_STATE_CHANGED>::annotationCount > 0);
+    static_assert(!AtomTraits<BLE_SCAN_STATE_CHANGED>::isPulled);
+    static_assert(AtomTraits<TEST_ATOM_REPORTED>::annotationCount == 0);
+
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_GT(stats_write<BLE_SCAN_STATE_CHANGED>(uids, 1, tags,
+                                                  BLE_SCAN_STATE_CHANGED__STATE__ON, true, false,
+                                                  true),
+              0);
+    EXPECT_GT(ble_scan_state_changed::stats_write(uids, 1, tags, BLE_SCAN_STATE_CHANGED__STATE__ON,
+                                                  true, false, true),
+              0);
+    ASSERT_EQ(sSinkEvents.size(), static_cast<size_t>(2));
+    EXPECT_EQ(without_timestamp(sSinkEvents[0]), without_timestamp(sSinkEvents[1]));
+}
+
+/**
+ * Tests that the buffer encoder writes the same bytes as AStatsEvent, including for null strings,
+ * lists that are too long and events that overflow the payload.
+ */
+TEST(ApiGenBufferTest, AStatsEventCompatibilityTest) {
+    for (const TestAtomFields& fields : get_test_atom_cases()) {
+        const vector<vector<uint8_t>> events = write_test_atom(TEST_ATOM_REPORTED, fields);
+        ASSERT_EQ(events.size(), static_cast<size_t>(1));
+        EXPECT_EQ(without_timestamp(events[0]), reference_test_atom(TEST_ATOM_REPORTED, fields));
+    }
+}
+
+/**
+ * Tests that a StatsEventBatch holds its events back until it is flushed or full, and then hands
+ * the sink the events that stats_write() writes.
+ */
+TEST(ApiGenBufferTest, BatchWriterTest) {
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    for (int32_t level = 0; level < 3; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    const vector<vector<uint8_t>> expected = sSinkEvents;
+
+    sSinkEvents.clear();
+    {
+        StatsEventBatch batch;
+        for (int32_t level = 0; level < 3; level++) {
+            EXPECT_EQ(batch.stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+        }
+        EXPECT_EQ(batch.pendingEvents(), static_cast<size_t>(3));
+        EXPECT_TRUE(sSinkEvents.empty());
+        EXPECT_EQ(batch.flush(), 3);
+        EXPECT_EQ(batch.pendingEvents(), static_cast<size_t>(0));
+        ASSERT_EQ(sSinkEvents.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(without_timestamp(sSinkEvents[i]), without_timestamp(expected[i]));
+        }
+
+        // A full batch is flushed right away, and the rest when the batch is destroyed.
+        sSinkEvents.clear();
+        for (size_t i = 0; i <= StatsEventBatch::MAX_EVENTS; i++) {
+            EXPECT_EQ(batch.stats_write(SCREEN_BRIGHTNESS_CHANGED, 1), 0);
+        }
+        EXPECT_EQ(sSinkEvents.size(), StatsEventBatch::MAX_EVENTS);
+        EXPECT_EQ(batch.pendingEvents(), static_cast<size_t>(1));
+    }
+    EXPECT_EQ(sSinkEvents.size(), StatsEventBatch::MAX_EVENTS + 1);
+}
+
+/**
+ * Tests that a StatsEventBatch whose buffer is full or nearly full flushes before the next event,
+ * and delivers every event as the unbatched write methods write it.
+ */
+TEST(ApiGenBufferTest, BatchWriterFullBufferTest) {
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_GT(stats_write(PROCESS_LIFE_CYCLE_STATE_CHANGED, 1000, "", 1), 0);
+    ASSERT_EQ(sSinkEvents.size(), static_cast<size_t>(1));
+    const size_t emptyEventSize = sSinkEvents[0].size();
+
+    // The events before the last two leave 0, 1 and 100 bytes of the buffer free.
+    for (const size_t freeSize : {0, 1, 100}) {
+        vector<size_t> eventSizes = {kMaxPayloadSize, kMaxPayloadSize, kMaxPayloadSize};
+        eventSizes.push_back(StatsEventBatch::BUFFER_SIZE - 3 * kMaxPayloadSize - 128 -
+                             freeSize);
+        eventSizes.push_back(128);
+        eventSizes.push_back(100);
+        vector<std::string> processNames;
+        for (const size_t eventSize : eventSizes) {
+            ASSERT_LE(eventSize, kMaxPayloadSize);
+            processNames.emplace_back(eventSize - emptyEventSize, 'p');
+        }
+
+        sSinkEvents.clear();
+        for (size_t i = 0; i < processNames.size(); i++) {
+            EXPECT_GT(stats_write(PROCESS_LIFE_CYCLE_STATE_CHANGED, 1000,
+                                  processNames[i].c_str(), static_cast<int32_t>(i)),
+                      0);
+            ASSERT_EQ(sSinkEvents.back().size(), eventSizes[i]) << freeSize;
+        }
+        const vector<vector<uint8_t>> expected = sSinkEvents;
+
+        sSinkEvents.clear();
+        {
+            StatsEventBatch batch;
+            for (size_t i = 0; i < processNames.size(); i++) {
+                EXPECT_EQ(batch.stats_write(PROCESS_LIFE_CYCLE_STATE_CHANGED, 1000,
+                                            processNames[i].c_str(), static_cast<int32_t>(i)),
+                          0);
+            }
+            // Less than the largest event fit behind the first four events.
+            EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(4)) << freeSize;
+            EXPECT_EQ(batch.pendingEvents(), static_cast<size_t>(2)) << freeSize;
+        }
+        ASSERT_EQ(sSinkEvents.size(), expected.size()) << freeSize;
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(without_timestamp(sSinkEvents[i]), without_timestamp(expected[i]))
+                    << freeSize << " " << i;
+        }
+    }
+}
+
+/**
+ * Tests that the write methods of a disabled atom write nothing, and that the other atoms are not
+ * affected.
+ */
+TEST(ApiGenBufferTest, AtomEnableBitmapTest) {
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_TRUE(isAtomEnabled(SCREEN_BRIGHTNESS_CHANGED));
+    setAtomEnabled(SCREEN_BRIGHTNESS_CHANGED, false);
+    EXPECT_FALSE(isAtomEnabled(SCREEN_BRIGHTNESS_CHANGED));
+    EXPECT_TRUE(isAtomEnabled(BLE_SCAN_RESULT_RECEIVED));
+
+    EXPECT_EQ(stats_write(SCREEN_BRIGHTNESS_CHANGED, 1), 0);
+    EXPECT_EQ(screen_brightness_changed::stats_write(1), 0);
+    {
+        StatsEventBatch batch;
+        EXPECT_EQ(batch.stats_write(SCREEN_BRIGHTNESS_CHANGED, 1), 0);
+        EXPECT_EQ(batch.pendingEvents(), static_cast<size_t>(0));
+    }
+    EXPECT_TRUE(sSinkEvents.empty());
+    const int32_t uids[] = {1000};
+    const vector<char const*> tags = {"tag"};
+    EXPECT_GT(stats_write(BLE_SCAN_RESULT_RECEIVED, uids, 1, tags, 5), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(1));
+
+    setAtomEnabled(SCREEN_BRIGHTNESS_CHANGED, true);
+    EXPECT_TRUE(isAtomEnabled(SCREEN_BRIGHTNESS_CHANGED));
+    EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, 1), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(2));
+
+    // Codes of no atom of the module are always enabled.
+    setAtomEnabled(-1, false);
+    EXPECT_TRUE(isAtomEnabled(-1));
+}
+
+/**
+ * Tests that writes of a state atom that repeat the last state of their primary key are dropped,
+ * unless a write failed, the caches were reset or the atom has other fields.
+ */
+TEST(ApiGenBufferTest, StateDedupTest) {
+    const int32_t top = UID_PROCESS_STATE_CHANGED__STATE__PROCESS_STATE_TOP;
+    const int32_t service = UID_PROCESS_STATE_CHANGED__STATE__PROCESS_STATE_SERVICE;
+    setStatsEventSink(&capture_event);
+    // Start from a known state, which earlier runs of the test may have written already.
+    screen_state_changed::stats_write(SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_OFF);
+    uid_process_state_changed::stats_write(1000, service);
+    uid_process_state_changed::stats_write(2000, service);
+
+    sSinkEvents.clear();
+    EXPECT_GT(stats_write(SCREEN_STATE_CHANGED, SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_ON), 0);
+    EXPECT_EQ(stats_write(SCREEN_STATE_CHANGED, SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_ON), 0);
+    EXPECT_EQ(screen_state_changed::stats_write(SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_ON), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(1));
+
+    // Each uid keeps its own state.
+    EXPECT_GT(uid_process_state_changed::stats_write(1000, top), 0);
+    EXPECT_EQ(uid_process_state_changed::stats_write(1000, top), 0);
+    EXPECT_EQ(uid_process_state_changed::stats_write(2000, service), 0);
+    EXPECT_GT(uid_process_state_changed::stats_write(2000, top), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(3));
+
+    // A state that did not reach the sink is written again, and so are the states of the other
+    // keys, which statsd may have lost too.
+    setStatsEventSink(&fail_event);
+    EXPECT_LT(uid_process_state_changed::stats_write(1000, service), 0);
+    setStatsEventSink(&capture_event);
+    EXPECT_GT(uid_process_state_changed::stats_write(1000, service), 0);
+    EXPECT_GT(uid_process_state_changed::stats_write(2000, top), 0);
+    EXPECT_EQ(uid_process_state_changed::stats_write(2000, top), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(5));
+
+    // resetStateCaches() forgets the states of all atoms.
+    resetStateCaches();
+    EXPECT_GT(uid_process_state_changed::stats_write(2000, top), 0);
+    EXPECT_GT(screen_state_changed::stats_write(SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_ON), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(7));
+
+    // The state of an atom with a field besides its primary fields and its state is never
+    // dropped, since that field may change.
+    const int32_t entered = OVERLAY_STATE_CHANGED__STATE__ENTERED;
+    EXPECT_GT(overlay_state_changed::stats_write(1000, "package", false, entered), 0);
+    EXPECT_GT(overlay_state_changed::stats_write(1000, "package", true, entered), 0);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(9));
+}
+
+/**
+ * Tests that writes of the same state from several threads reach the sink once per key.
+ */
+TEST(ApiGenBufferTest, StateDedupThreadsTest) {
+    const int32_t top = UID_PROCESS_STATE_CHANGED__STATE__PROCESS_STATE_TOP;
+    const int32_t service = UID_PROCESS_STATE_CHANGED__STATE__PROCESS_STATE_SERVICE;
+    // The writes are counted by their results, since capture_event is not thread safe.
+    setStatsEventSink([](const uint8_t*, size_t size, uint32_t) { return static_cast<int>(size); });
+    const int32_t uids[] = {3000, 3001};
+    for (const int32_t uid : uids) {
+        uid_process_state_changed::stats_write(uid, service);
+    }
+
+    std::atomic<int> writtenCount(0);
+    vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&uids, &writtenCount] {
+            for (int j = 0; j < 1000; j++) {
+                for (const int32_t uid : uids) {
+                    if (uid_process_state_changed::stats_write(uid, top) > 0) {
+                        writtenCount++;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(writtenCount, 2);
+}
+
+/**
+ * Tests that the events written after useStatsEventRing() reach the StatsEventRingReader that
+ * received the ring, in order and unchanged.
+ */
+TEST(ApiGenBufferTest, RingTransportTest) {
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    for (int32_t level = 0; level < 3; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    const vector<vector<uint8_t>> expected = sSinkEvents;
+
+    const fs::path path = fs::temp_directory_path() / "test_buffer_atoms_ring";
+    fs::remove(path);
+    const int socketFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_GE(socketFd, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    ASSERT_EQ(bind(socketFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+
+    StatsEventRingReader reader;
+    ASSERT_EQ(useStatsEventRing(path.c_str()), 0);
+    ASSERT_EQ(reader.receive(socketFd), 0);
+    for (int32_t level = 0; level < 3; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    EXPECT_TRUE(reader.wait(1000));
+
+    sSinkEvents.clear();
+    EXPECT_EQ(reader.read(&capture_event), static_cast<size_t>(3));
+    ASSERT_EQ(sSinkEvents.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(without_timestamp(sSinkEvents[i]), without_timestamp(expected[i]));
+    }
+    EXPECT_EQ(reader.read(&capture_event), static_cast<size_t>(0));
+    EXPECT_EQ(getStatsEventRingDropCount(), static_cast<uint64_t>(0));
+
+    setStatsEventSink(&capture_event);
+    close(socketFd);
+    fs::remove(path);
+}
+
+/**
+ * Tests that the compact events of TestExtensionAtomReported expand to the bytes AStatsEvent
+ * writes, and that the expansion rejects truncated events and output buffers that are too small.
+ */
+TEST(ApiGenBufferTest, CompactEventExpansionTest) {
+    uint8_t plain[kMaxEventSize];
+    for (const TestAtomFields& fields : get_test_atom_cases()) {
+        const vector<vector<uint8_t>> events =
+                write_test_atom(TEST_EXTENSION_ATOM_REPORTED, fields);
+        ASSERT_EQ(events.size(), static_cast<size_t>(1));
+        const int size = expandCompactStatsEvent(events[0].data(), events[0].size(), plain,
+                                                 sizeof(plain));
+        ASSERT_GT(size, 0);
+        EXPECT_EQ(without_timestamp(vector<uint8_t>(plain, plain + size)),
+                  reference_test_atom(TEST_EXTENSION_ATOM_REPORTED, fields));
+    }
+
+    const vector<uint8_t> event = write_test_atom(TEST_EXTENSION_ATOM_REPORTED, {})[0];
+    const int size = expandCompactStatsEvent(event.data(), event.size(), plain, sizeof(plain));
+    ASSERT_GT(size, static_cast<int>(event.size()));
+    for (size_t truncated = 0; truncated < event.size(); truncated++) {
+        const vector<uint8_t> prefix(event.begin(), event.begin() + truncated);
+        EXPECT_LT(expandCompactStatsEvent(prefix.data(), prefix.size(), plain, sizeof(plain)), 0)
+                << "truncated to " << truncated << " bytes";
+    }
+    for (int capacity = 0; capacity < size; capacity++) {
+        EXPECT_LT(expandCompactStatsEvent(event.data(), event.size(), plain, capacity), 0)
+                << "capacity of " << capacity << " bytes";
+    }
+    vector<uint8_t> extraFields = event;
+    extraFields[1] = 0xff;
+    EXPECT_LT(expandCompactStatsEvent(extraFields.data(), extraFields.size(), plain,
+                                      sizeof(plain)),
+              0);
+}
+
+/**
+ * Tests that the decoder reads back the fields of plain and compact events, and rejects
+ * truncated events and events of another atom.
+ */
+TEST(ApiGenBufferTest, DecoderBoundsTest) {
+    expect_decoded_test_atom<TestAtomReported>(write_test_atom(TEST_ATOM_REPORTED, {}));
+    expect_decoded_test_atom<TestExtensionAtomReported>(
+            write_test_atom(TEST_EXTENSION_ATOM_REPORTED, {}));
+}
+
+/**
+ * Tests that the registry holds every atom at its dense index, in code order, with its fields
+ * and flags.
+ */
+TEST(ApiGenBufferTest, AtomRegistryTest) {
+    static_assert(getAtomInfo(BLE_SCAN_STATE_CHANGED)->fieldCount == 5);
+    static_assert(getAtomInfo(3) == nullptr);
+    static_assert(getAtomIndex(-1) == -1);
+    static_assert(getAtomIndex(INT32_MAX) == -1);
+
+    for (size_t i = 0; i < ATOM_COUNT; i++) {
+        const AtomInfo& info = ATOM_INFOS[i];
+        EXPECT_EQ(getAtomIndex(info.code), static_cast<int>(i));
+        EXPECT_EQ(getAtomInfo(info.code), &info);
+        if (i > 0) {
+            EXPECT_LT(ATOM_INFOS[i - 1].code, info.code);
+        }
+        // The name lookup finds every atom of the registry.
+        std::string name = info.name;
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        EXPECT_EQ(getAtomCode(name), info.code) << name;
+    }
+
+    const AtomInfo* bleScan = getAtomInfo(BLE_SCAN_STATE_CHANGED);
+    EXPECT_STREQ(bleScan->name, "ble_scan_state_changed");
+    EXPECT_EQ(bleScan->fieldTypes[0], ATOM_FIELD_TYPE_ATTRIBUTION_CHAIN);
+    EXPECT_EQ(bleScan->fieldTypes[1], ATOM_FIELD_TYPE_ENUM);
+    EXPECT_EQ(bleScan->flags & (ATOM_FLAG_STATE | ATOM_FLAG_STATE_NESTED | ATOM_FLAG_PULLED),
+              ATOM_FLAG_STATE | ATOM_FLAG_STATE_NESTED);
+    EXPECT_NE(getAtomInfo(SUBSYSTEM_SLEEP_STATE)->flags & ATOM_FLAG_PULLED, 0u);
+    EXPECT_EQ(getAtomInfo(TEST_ATOM_REPORTED)->fieldCount, 14);
+}
+
+/**
+ * Tests that the name lookups find the atoms and enum values by their constant names, and only
+ * those.
+ */
+TEST(ApiGenBufferTest, NameLookupTest) {
+    EXPECT_EQ(getAtomCode("BLE_SCAN_STATE_CHANGED"), BLE_SCAN_STATE_CHANGED);
+    EXPECT_EQ(getAtomCode("TEST_ATOM_REPORTED"), TEST_ATOM_REPORTED);
+    EXPECT_EQ(getAtomCode("TEST_EXTENSION_ATOM_REPORTED"), TEST_EXTENSION_ATOM_REPORTED);
+    EXPECT_EQ(getAtomCode("TEST_ATOM_REPORTE"), -1);
+    EXPECT_EQ(getAtomCode(""), -1);
+
+    int32_t value = -1;
+    EXPECT_TRUE(getEnumValue("BLE_SCAN_STATE_CHANGED__STATE__RESET", &value));
+    EXPECT_EQ(value, BLE_SCAN_STATE_CHANGED__STATE__RESET);
+    EXPECT_TRUE(getEnumValue("TEST_ATOM_REPORTED__REPEATED_ENUM_FIELD__ON", &value));
+    EXPECT_EQ(value, TEST_ATOM_REPORTED__REPEATED_ENUM_FIELD__ON);
+    EXPECT_FALSE(getEnumValue("BLE_SCAN_STATE_CHANGED", &value));
+}
+
+/**
+ * Tests that getEnumValueName() names the values of the enum fields of an atom, for dense and
+ * for sparse enums, and nothing else.
+ */
+TEST(ApiGenBufferTest, EnumValueNamesTest) {
+    EXPECT_STREQ(getEnumValueName(TEST_ATOM_REPORTED, 7, TEST_ATOM_REPORTED__STATE__ON), "ON");
+    EXPECT_STREQ(getEnumValueName(TEST_ATOM_REPORTED, 14,
+                                  TEST_ATOM_REPORTED__REPEATED_ENUM_FIELD__OFF),
+                 "OFF");
+    EXPECT_STREQ(getEnumValueName(SCREEN_STATE_CHANGED, 1,
+                                  SCREEN_STATE_CHANGED__STATE__DISPLAY_STATE_DOZE),
+                 "DISPLAY_STATE_DOZE");
+    EXPECT_STREQ(getEnumValueName(UID_PROCESS_STATE_CHANGED, 2,
+                                  UID_PROCESS_STATE_CHANGED__STATE__PROCESS_STATE_TOP),
+                 "PROCESS_STATE_TOP");
+
+    // The names agree with the enum value constants.
+    for (int32_t value = 1000; value < 1030; value++) {
+        const char* name = getEnumValueName(UID_PROCESS_STATE_CHANGED, 2, value);
+        if (name != nullptr) {
+            int32_t constant = -1;
+            EXPECT_TRUE(getEnumValue(std::string("UID_PROCESS_STATE_CHANGED__STATE__") + name,
+                                     &constant));
+            EXPECT_EQ(constant, value);
+        }
+    }
+
+    EXPECT_EQ(getEnumValueName(TEST_ATOM_REPORTED, 7, 3), nullptr);
+    EXPECT_EQ(getEnumValueName(TEST_ATOM_REPORTED, 7, -1), nullptr);
+    EXPECT_EQ(getEnumValueName(TEST_ATOM_REPORTED, 2, 0), nullptr);
+    EXPECT_EQ(getEnumValueName(3, 1, 0), nullptr);
+}
+
+/**
+ * Tests that a spilled record whose size runs past the spilled records is dropped, together with
+ * the records behind it, instead of being handed to the sink.
+ */
+TEST(ApiGenBufferTest, MalformedSpillFileRecordTest) {
+    const fs::path path = fs::temp_directory_path() / "test_buffer_atoms_spill";
+    fs::remove(path);
+    ASSERT_EQ(useStatsEventSpillFile(path.c_str()), 0);
+    // The file is locked while it is used.
+    EXPECT_EQ(useStatsEventSpillFile(path.c_str()), -EWOULDBLOCK);
+
+    setStatsEventSink(&fail_event);
+    for (int32_t level = 0; level < 3; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    EXPECT_EQ(getStatsEventSpillFileEventCount(), static_cast<size_t>(3));
+
+    // Give the second record a size that runs past the end of the spilled records.
+    const int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    uint32_t record[2];
+    ASSERT_EQ(pread(fd, record, sizeof(record), kSpillHeaderSize),
+              static_cast<ssize_t>(sizeof(record)));
+    const off_t secondRecord = kSpillHeaderSize + kSpillRecordHeaderSize + record[1];
+    const uint32_t badSize = 0xfffffff0;
+    ASSERT_EQ(pwrite(fd, &badSize, sizeof(badSize), secondRecord + sizeof(uint32_t)),
+              static_cast<ssize_t>(sizeof(badSize)));
+    close(fd);
+
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_EQ(replayStatsEventSpillFile(), 1);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(1));
+    EXPECT_EQ(getStatsEventSpillFileEventCount(), static_cast<size_t>(0));
+
+    // The file takes new events once the malformed records are gone.
+    setStatsEventSink(&fail_event);
+    EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, 3), 0);
+    setStatsEventSink(&capture_event);
+    EXPECT_EQ(replayStatsEventSpillFile(), 1);
+    EXPECT_EQ(sSinkEvents.size(), static_cast<size_t>(2));
+}
+
+/**
+ * Tests that the spilled events reach the sink before the event that gets through after them,
+ * and that an event is spilled behind the spilled events the sink does not take.
+ */
+TEST(ApiGenBufferTest, SpillFileReplayOrderTest) {
+    const fs::path path = fs::temp_directory_path() / "test_buffer_atoms_spill_order";
+    fs::remove(path);
+    ASSERT_EQ(useStatsEventSpillFile(path.c_str()), 0);
+
+    setStatsEventSink(&fail_event);
+    for (int32_t level = 0; level < 3; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, 3), 0);
+    EXPECT_EQ(getStatsEventSpillFileEventCount(), static_cast<size_t>(0));
+
+    // The sink takes one of the two spilled events, then fails again.
+    setStatsEventSink(&fail_event);
+    for (int32_t level = 4; level < 6; level++) {
+        EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, level), 0);
+    }
+    static bool sAccepted;
+    sAccepted = false;
+    setStatsEventSink([](const uint8_t* buffer, size_t size, uint32_t atomId) {
+        if (sAccepted) {
+            return fail_event(buffer, size, atomId);
+        }
+        sAccepted = true;
+        return capture_event(buffer, size, atomId);
+    });
+    EXPECT_GT(stats_write(SCREEN_BRIGHTNESS_CHANGED, 6), 0);
+    EXPECT_EQ(getStatsEventSpillFileEventCount(), static_cast<size_t>(2));
+    setStatsEventSink(&capture_event);
+    EXPECT_EQ(replayStatsEventSpillFile(), 2);
+
+    ASSERT_EQ(sSinkEvents.size(), static_cast<size_t>(7));
+    for (int32_t level = 0; level < 7; level++) {
+        int32_t value;
+        memcpy(&value, sSinkEvents[level].data() + sSinkEvents[level].size() - sizeof(value),
+               sizeof(value));
+        EXPECT_EQ(value, level);
+    }
+}
+
+/**
+ * Tests that attribution tags passed as std::string_view are encoded like char const* tags, with
+ * null tags as empty strings.
+ */
+TEST(ApiGenBufferTest, StringViewAttributionTagsTest) {
+    const int32_t uids[] = {1000, 2000};
+    const vector<char const*> tags = {"tag", nullptr};
+    const std::string_view tagViews[] = {"tag", ""};
+
+    sSinkEvents.clear();
+    setStatsEventSink(&capture_event);
+    EXPECT_GT(stats_write(BLE_SCAN_RESULT_RECEIVED, uids, 2, tags, 5), 0);
+    EXPECT_GT(ble_scan_result_received::stats_write(uids, 2, tagViews, 5), 0);
+    ASSERT_EQ(sSinkEvents.size(), static_cast<size_t>(2));
+    EXPECT_EQ(without_timestamp(sSinkEvents[0]), without_timestamp(sSinkEvents[1]));
+}
+
+}  // namespace api_gen_buffer_tests
+}  // namespace android
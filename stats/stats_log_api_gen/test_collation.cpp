@@ -61,7 +61,7 @@ static bool map_contains_vector(const SignatureInfoMap& s, int count, ...) {
     do {                                                                     \
         for (vector<AtomField>::const_iterator field = atom->fields.begin(); \
              field != atom->fields.end(); field++) {                         \
-            EXPECT_TRUE(field->enumValues.empty());                          \
+            EXPECT_EQ(nullptr, field->enumValues);                           \
         }                                                                    \
     } while (0)
 
@@ -71,9 +71,10 @@ static bool map_contains_vector(const SignatureInfoMap& s, int count, ...) {
         for (vector<AtomField>::const_iterator field = atom->fields.begin(); \
              field != atom->fields.end(); field++) {                         \
             if (field->name == field_name) {                                 \
-                EXPECT_EQ(field->enumValues, values);                        \
+                ASSERT_NE(nullptr, field->enumValues);                       \
+                EXPECT_EQ(*field->enumValues, values);                       \
             } else {                                                         \
-                EXPECT_TRUE(field->enumValues.empty());                      \
+                EXPECT_EQ(nullptr, field->enumValues);                       \
             }                                                                \
         }                                                                    \
     } while (0)
@@ -258,6 +259,31 @@ TEST_P(CollationTest, CollateStats) {
     EXPECT_EQ(atoms.decls.end(), atomIt);
 }
 
+/**
+ * Test that the fields of the same enum type share its values.
+ */
+TEST_P(CollationTest, CollateSharedEnums) {
+    Atoms atoms;
+    const int errorCount = collate_atoms(*mEvent, DEFAULT_MODULE_NAME, atoms);
+
+    EXPECT_EQ(0, errorCount);
+
+    shared_ptr<const map<int, string>> enumValues;
+    shared_ptr<const map<int, string>> repeatedEnumValues;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        for (const AtomField& field : atomDecl->fields) {
+            if (field.name == "enum_field") {
+                enumValues = field.enumValues;
+                EXPECT_EQ("android.stats_log_api_gen.AnEnum", field.enumFullTypeName);
+            } else if (field.name == "repeated_enum_field") {
+                repeatedEnumValues = field.enumValues;
+            }
+        }
+    }
+    ASSERT_NE(nullptr, enumValues);
+    EXPECT_EQ(enumValues, repeatedEnumValues);
+}
+
 /**
  * Test that event class that contains stuff other than the atoms is rejected.
  */
@@ -489,6 +515,32 @@ TEST_P(CollationTest, RecognizeModule1Atom) {
     EXPECT_TRUE(annotation->value.boolValue);
 }
 
+TEST_P(CollationTest, CollateModulesAtOnce) {
+    map<string, Atoms> moduleAtoms;
+    const int errorCount = collate_atoms(
+            *mModuleAtoms, {DEFAULT_MODULE_NAME, "module1", "module2", "module3"}, moduleAtoms);
+    EXPECT_EQ(errorCount, 0);
+    EXPECT_EQ(moduleAtoms.size(), 4ul);
+    EXPECT_EQ(moduleAtoms[DEFAULT_MODULE_NAME].decls.size(), 4ul);
+    EXPECT_EQ(moduleAtoms["module3"].decls.size(), 0ul);
+
+    for (const char* moduleName : {"module1", "module2"}) {
+        Atoms atoms;
+        EXPECT_EQ(collate_atoms(*mModuleAtoms, moduleName, atoms), 0);
+        const Atoms& collatedAtoms = moduleAtoms[moduleName];
+        EXPECT_EQ(collatedAtoms.decls.size(), 2ul);
+        ASSERT_EQ(collatedAtoms.decls.size(), atoms.decls.size());
+        for (auto it = collatedAtoms.decls.begin(), jt = atoms.decls.begin();
+             it != collatedAtoms.decls.end(); it++, jt++) {
+            EXPECT_EQ((*it)->code, (*jt)->code);
+            // The modules share the declaration of the atom.
+            EXPECT_EQ(*moduleAtoms[DEFAULT_MODULE_NAME].decls.find(*it), *it);
+        }
+        EXPECT_EQ(collatedAtoms.signatureInfoMap.size(), atoms.signatureInfoMap.size());
+        EXPECT_EQ(collatedAtoms.non_chained_decls.size(), atoms.non_chained_decls.size());
+    }
+}
+
 /**
  * Test a correct collation with pushed and pulled atoms.
  */
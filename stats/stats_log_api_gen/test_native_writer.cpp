@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+
+#include "Collation.h"
+#include "frameworks/proto_logging/stats/attribution_node.pb.h"
+#include "frameworks/proto_logging/stats/stats_log_api_gen/test.pb.h"
+#include "native_writer.h"
+#include "utils.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+using std::multiset;
+
+/**
+ * Returns what write renders into a FILE*, and adds the number of errors it returns to
+ * errorCount.
+ */
+template <typename Write>
+static string render(Write&& write, int* errorCount) {
+    char* buffer = nullptr;
+    size_t size = 0;
+    FILE* out = open_memstream(&buffer, &size);
+    *errorCount += write(out);
+    fclose(out);
+    const string content(buffer, size);
+    free(buffer);
+    return content;
+}
+
+/**
+ * Writes the cpp file of atoms, or its first file when the methods are spread over cppShards
+ * files.
+ */
+static string write_cpp(const Atoms& atoms, const AtomDecl& attributionDecl, bool perAtomMethods,
+                        int cppShards, int* errorCount) {
+    return render(
+            [&](FILE* out) {
+                return write_stats_log_cpp(
+                        out, atoms, attributionDecl, "android,util", "test.h", API_LEVEL_CURRENT,
+                        /*bootstrap=*/false, perAtomMethods, /*bufferEncoder=*/false,
+                        /*batchWriter=*/false, /*async=*/false, /*atomEnableBitmap=*/false,
+                        /*stateDedup=*/false, /*stringViewArgs=*/false,
+                        /*columnarPulledAtoms=*/false, /*pulledAtomSizes=*/false,
+                        /*spillFile=*/false, /*ringTransport=*/false, /*compactEncoding=*/false,
+                        /*compactAtoms=*/"", /*nameLookup=*/false, /*enumNames=*/false, cppShards);
+            },
+            errorCount);
+}
+
+/**
+ * Writes the header of atoms, with the per-atom write methods.
+ */
+static string write_header(const Atoms& atoms, const AtomDecl& attributionDecl, bool templateApi,
+                           int* errorCount) {
+    return render(
+            [&](FILE* out) {
+                return write_stats_log_header(
+                        out, atoms, attributionDecl, "android,util", API_LEVEL_CURRENT,
+                        /*bootstrap=*/false, /*perAtomMethods=*/true, templateApi,
+                        /*bufferEncoder=*/false, /*batchWriter=*/false, /*async=*/false,
+                        /*atomEnableBitmap=*/false, /*stateDedup=*/false,
+                        /*stringViewArgs=*/false, /*columnarPulledAtoms=*/false,
+                        /*pulledAtomSizes=*/false, /*spillFile=*/false, /*ringTransport=*/false,
+                        /*compactEncoding=*/false, /*atomRegistry=*/false, /*nameLookup=*/false,
+                        /*enumNames=*/false, /*atomsHeader=*/"");
+            },
+            errorCount);
+}
+
+static AtomDecl get_attribution_decl() {
+    AtomDecl attributionDecl;
+    vector<java_type_t> attributionSignature;
+    collate_atom(*os::statsd::AttributionNode::descriptor(), attributionDecl,
+                 attributionSignature);
+    return attributionDecl;
+}
+
+/**
+ * Returns the part of content between the line that opens the namespace of atomName and the line
+ * that closes it, or an empty string if there is no such namespace.
+ */
+static string get_atom_namespace(const string& content, const string& atomName) {
+    const size_t begin = content.find("namespace " + atomName + " {\n");
+    if (begin == string::npos) {
+        return "";
+    }
+    const size_t end = content.find("} // namespace " + atomName + "\n", begin);
+    return content.substr(begin, end == string::npos ? string::npos : end - begin);
+}
+
+/**
+ * Returns the part of content between the line that opens the AtomTraits specialization of
+ * atomConstant and the line that closes it, or an empty string if there is no such
+ * specialization.
+ */
+static string get_atom_traits(const string& content, const string& atomConstant) {
+    const size_t begin = content.find("struct AtomTraits<" + atomConstant + "> {\n");
+    if (begin == string::npos) {
+        return "";
+    }
+    return content.substr(begin, content.find("\n};\n", begin) - begin);
+}
+
+/**
+ * Returns the lines of content that open a method definition at namespace scope.
+ */
+static multiset<string> get_method_definitions(const string& content) {
+    multiset<string> definitions;
+    std::istringstream lines(content);
+    string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && isalpha(line[0]) && line.find('(') != string::npos &&
+            line.size() >= 3 && line.compare(line.size() - 3, 3, ") {") == 0) {
+            definitions.insert(line);
+        }
+    }
+    return definitions;
+}
+
+/**
+ * Tests that --perAtomMethods gives each atom a write method in its own namespace, which writes
+ * the annotations of the atom, and that the write methods keyed by signature forward to it.
+ */
+TEST(NativeWriterTest, PerAtomMethodsTest) {
+    Atoms atoms;
+    ASSERT_EQ(collate_atoms(*GoodStateAtoms::descriptor(), DEFAULT_MODULE_NAME, atoms), 0);
+    const AtomDecl attributionDecl = get_attribution_decl();
+
+    int errorCount = 0;
+    const string cpp = write_cpp(atoms, attributionDecl, /*perAtomMethods=*/true,
+                                 /*cppShards=*/1, &errorCount);
+    const string good1 = get_atom_namespace(cpp, "good1");
+    EXPECT_NE(good1.find("int stats_write(int32_t arg1, int32_t arg2) {"), string::npos);
+    EXPECT_NE(good1.find("ANNOTATION_ID_PRIMARY_FIELD, true"), string::npos);
+    EXPECT_NE(good1.find("ANNOTATION_ID_EXCLUSIVE_STATE, true"), string::npos);
+    const string good2 = get_atom_namespace(cpp, "good2");
+    EXPECT_NE(good2.find("ANNOTATION_ID_EXCLUSIVE_STATE, true"), string::npos);
+    EXPECT_EQ(good2.find("ANNOTATION_ID_PRIMARY_FIELD"), string::npos);
+    EXPECT_NE(cpp.find("return good1::stats_write("), string::npos);
+    EXPECT_NE(cpp.find("return good2::stats_write("), string::npos);
+
+    const string plainCpp = write_cpp(atoms, attributionDecl, /*perAtomMethods=*/false,
+                                      /*cppShards=*/1, &errorCount);
+    EXPECT_EQ(get_atom_namespace(plainCpp, "good1"), "");
+    EXPECT_EQ(plainCpp.find("good1::"), string::npos);
+    EXPECT_EQ(errorCount, 0);
+}
+
+/**
+ * Tests that --templateApi adds an AtomTraits specialization per atom, which describes the atom
+ * and forwards its stats_write() to the per-atom method.
+ */
+TEST(NativeWriterTest, TemplateApiTest) {
+    Atoms atoms;
+    ASSERT_EQ(collate_atoms(*GoodStateAtoms::descriptor(), DEFAULT_MODULE_NAME, atoms), 0);
+    const AtomDecl attributionDecl = get_attribution_decl();
+
+    int errorCount = 0;
+    const string header = write_header(atoms, attributionDecl, /*templateApi=*/true, &errorCount);
+    EXPECT_NE(header.find("template <int32_t Code>\nstruct AtomTraits;"), string::npos);
+    for (const string atom : {"good1", "good2"}) {
+        const string traits = get_atom_traits(header, make_constant_name(atom));
+        EXPECT_NE(traits.find("static constexpr bool isPulled = false;"), string::npos) << atom;
+        EXPECT_NE(traits.find("static constexpr size_t fieldCount = 2;"), string::npos) << atom;
+        EXPECT_NE(traits.find("static inline int stats_write(int32_t arg1, int32_t arg2) {"),
+                  string::npos)
+                << atom;
+        EXPECT_NE(traits.find("return " + atom + "::stats_write(arg1, arg2);"), string::npos)
+                << atom;
+    }
+
+    const string plainHeader =
+            write_header(atoms, attributionDecl, /*templateApi=*/false, &errorCount);
+    EXPECT_EQ(plainHeader.find("AtomTraits"), string::npos);
+    EXPECT_EQ(errorCount, 0);
+}
+
+/**
+ * Tests that the shards of --cppShards together define each method of the unsharded cpp file
+ * exactly once, and that every shard gets some of them.
+ */
+TEST(NativeWriterTest, CppShardsTest) {
+    Atoms atoms;
+    ASSERT_EQ(collate_atoms(*Event::descriptor(), DEFAULT_MODULE_NAME, atoms), 0);
+    const AtomDecl attributionDecl = get_attribution_decl();
+
+    int errorCount = 0;
+    const multiset<string> unsharded = get_method_definitions(
+            write_cpp(atoms, attributionDecl, /*perAtomMethods=*/true, 1, &errorCount));
+    EXPECT_FALSE(unsharded.empty());
+
+    const int shardCount = 3;
+    multiset<string> sharded = get_method_definitions(
+            write_cpp(atoms, attributionDecl, /*perAtomMethods=*/true, shardCount, &errorCount));
+    EXPECT_FALSE(sharded.empty()) << "shard 0";
+    for (int shardIndex = 1; shardIndex < shardCount; shardIndex++) {
+        const multiset<string> shard = get_method_definitions(render(
+                [&](FILE* out) {
+                    return write_stats_log_cpp_shard(
+                            out, atoms, attributionDecl, "android,util", "test.h",
+                            API_LEVEL_CURRENT, /*bootstrap=*/false, /*perAtomMethods=*/true,
+                            /*stringViewArgs=*/false, /*columnarPulledAtoms=*/false,
+                            shardIndex, shardCount);
+                },
+                &errorCount));
+        EXPECT_FALSE(shard.empty()) << "shard " << shardIndex;
+        sharded.insert(shard.begin(), shard.end());
+    }
+    EXPECT_EQ(errorCount, 0);
+    EXPECT_EQ(sharded, unsharded);
+}
+
+}  // namespace stats_log_api_gen
+}  // namespace android
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2024, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+#include "Collation.h"
+#include "frameworks/proto_logging/stats/stats_log_api_gen/test.pb.h"
+#include "utils.h"
+
+namespace android {
+namespace stats_log_api_gen {
+
+using std::map;
+using std::set;
+
+namespace fs = std::filesystem;
+
+/**
+ * Renders content through open_output_file() and close_output_file(). Returns the number of
+ * errors.
+ */
+static int write_output_file(const string& filename, const string& content) {
+    FILE* out = open_output_file(filename);
+    if (out == nullptr) {
+        return 1;
+    }
+    fputs(content.c_str(), out);
+    return close_output_file(out);
+}
+
+static string read_file(const fs::path& path) {
+    std::ifstream in(path);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+/**
+ * Returns the slot of name in the table, following the lookup of the generated code.
+ */
+static size_t get_name_slot(const NameHashTable& table, const string& name) {
+    const size_t size = table.seeds.size();
+    const int32_t seed = table.seeds[get_name_hash(name, 0) % size];
+    return seed < 0 ? static_cast<size_t>(-(seed + 1)) : get_name_hash(name, seed) % size;
+}
+
+/**
+ * Expects that each name of the table is found at a slot of its own, with its value.
+ */
+static void expect_name_hash_table(const map<string, int>& nameValues) {
+    const NameHashTable table = build_name_hash_table(nameValues);
+    ASSERT_EQ(table.seeds.size(), nameValues.size());
+    ASSERT_EQ(table.names.size(), nameValues.size());
+    ASSERT_EQ(table.values.size(), nameValues.size());
+
+    set<size_t> slots;
+    for (const auto& [name, value] : nameValues) {
+        const size_t slot = get_name_slot(table, name);
+        ASSERT_LT(slot, nameValues.size()) << name;
+        EXPECT_EQ(table.names[slot], name);
+        EXPECT_EQ(table.values[slot], value) << name;
+        EXPECT_TRUE(slots.insert(slot).second) << name << " collides at slot " << slot;
+    }
+}
+
+/**
+ * Tests that the atom and enum value names of the test atoms hash without collisions.
+ */
+TEST(UtilsTest, NameHashTableOfAtomsTest) {
+    Atoms atoms;
+    ASSERT_EQ(collate_atoms(*Event::descriptor(), DEFAULT_MODULE_NAME, atoms), 0);
+
+    const map<string, int> atomNames = get_atom_name_codes(atoms);
+    EXPECT_FALSE(atomNames.empty());
+    expect_name_hash_table(atomNames);
+
+    const map<string, int> enumNames = get_enum_name_values(atoms);
+    EXPECT_FALSE(enumNames.empty());
+    expect_name_hash_table(enumNames);
+}
+
+/**
+ * Tests that a large set of similar names, and the smallest sets, hash without collisions.
+ */
+TEST(UtilsTest, NameHashTableOfManyNamesTest) {
+    map<string, int> nameValues;
+    for (int i = 0; i < 20000; i++) {
+        nameValues.emplace("ATOM_" + std::to_string(i) + "__FIELD__VALUE", i);
+    }
+    expect_name_hash_table(nameValues);
+
+    expect_name_hash_table({});
+    expect_name_hash_table({{"ONLY_NAME", 7}});
+}
+
+/**
+ * Tests that close_output_file() leaves a file with the same content untouched, and replaces a
+ * file whose content changed through a temporary file of its own, keeping the mode of the file.
+ */
+TEST(UtilsTest, CloseOutputFileTest) {
+    const fs::path dir = fs::temp_directory_path() / "stats_log_api_gen_output_test";
+    fs::remove_all(dir);
+    ASSERT_TRUE(fs::create_directory(dir));
+    const fs::path path = dir / "output.h";
+    ASSERT_EQ(write_output_file(path, "content"), 0);
+    EXPECT_EQ(read_file(path), "content");
+    const mode_t mask = umask(0);
+    umask(mask);
+    struct stat newFileStat;
+    ASSERT_EQ(stat(path.c_str(), &newFileStat), 0);
+    EXPECT_EQ(newFileStat.st_mode & 07777, 0666 & ~mask);
+
+    const fs::file_time_type oldTime = fs::last_write_time(path) - std::chrono::hours(1);
+    fs::last_write_time(path, oldTime);
+    struct stat oldStat;
+    ASSERT_EQ(stat(path.c_str(), &oldStat), 0);
+
+    ASSERT_EQ(write_output_file(path, "content"), 0);
+    struct stat newStat;
+    ASSERT_EQ(stat(path.c_str(), &newStat), 0);
+    EXPECT_EQ(fs::last_write_time(path), oldTime);
+    EXPECT_EQ(newStat.st_ino, oldStat.st_ino);
+
+    // A prefix of the old content is a change too. A file that another run may be writing next
+    // to the output is left alone.
+    ASSERT_EQ(chmod(path.c_str(), 0640), 0);
+    const fs::path otherPath = path.string() + ".tmp";
+    ASSERT_EQ(write_output_file(otherPath, "other"), 0);
+    ASSERT_EQ(write_output_file(path, "conten"), 0);
+    EXPECT_EQ(read_file(path), "conten");
+    EXPECT_NE(fs::last_write_time(path), oldTime);
+    ASSERT_EQ(stat(path.c_str(), &newStat), 0);
+    EXPECT_EQ(newStat.st_mode & 07777, static_cast<mode_t>(0640));
+    EXPECT_EQ(read_file(otherPath), "other");
+    EXPECT_EQ(std::distance(fs::directory_iterator(dir), fs::directory_iterator()), 2);
+    fs::remove_all(dir);
+}
+
+/**
+ * Tests that close_output_file() writes outputs that are not regular files in place.
+ */
+TEST(UtilsTest, CloseOutputFileToDeviceTest) {
+    EXPECT_EQ(write_output_file("/dev/null", "content"), 0);
+    struct stat nullStat;
+    ASSERT_EQ(stat("/dev/null", &nullStat), 0);
+    EXPECT_TRUE(S_ISCHR(nullStat.st_mode));
+    EXPECT_FALSE(fs::exists("/dev/null.tmp"));
+}
+
+}  // namespace stats_log_api_gen
+}  // namespace android
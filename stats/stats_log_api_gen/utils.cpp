@@ -16,6 +16,13 @@
 
 #include "utils.h"
 
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
 namespace android {
 namespace stats_log_api_gen {
 
@@ -23,7 +30,7 @@ namespace stats_log_api_gen {
  * Inlining this method because "android-base/strings.h" is not available on
  * google3.
  */
-static vector<string> Split(const string& s, const string& delimiters) {
+vector<string> Split(const string& s, const string& delimiters) {
     GOOGLE_CHECK_NE(delimiters.size(), 0U);
 
     vector<string> result;
@@ -150,6 +157,25 @@ string make_constant_name(const string& str) {
     return result;
 }
 
+string make_camel_case_name(const string& str) {
+    string result;
+    const int N = str.size();
+    bool justSawUnderscore = false;
+    for (int i = 0; i < N; i++) {
+        char c = str[i];
+        if (c == '_') {
+            justSawUnderscore = true;
+            // Don't add the underscore to our result
+        } else if (i == 0 || justSawUnderscore) {
+            result += toupper(c);
+            justSawUnderscore = false;
+        } else {
+            result += tolower(c);
+        }
+    }
+    return result;
+}
+
 const char* cpp_type_name(java_type_t type, bool isVendorAtomLogging) {
     switch (type) {
         case JAVA_TYPE_BOOLEAN:
@@ -220,6 +246,52 @@ const char* java_type_name(java_type_t type) {
     }
 }
 
+// Repeated fields that the native methods take as a std::vector.
+bool is_vector_field(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_INT_ARRAY:
+        case JAVA_TYPE_FLOAT_ARRAY:
+        case JAVA_TYPE_LONG_ARRAY:
+        case JAVA_TYPE_STRING_ARRAY:
+        case JAVA_TYPE_ENUM_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool has_vector_arguments(const vector<java_type_t>& signature) {
+    return std::find_if(signature.begin(), signature.end(), [](java_type_t type) {
+               return type == JAVA_TYPE_ATTRIBUTION_CHAIN || is_vector_field(type);
+           }) != signature.end();
+}
+
+bool has_pointer_overload(const vector<java_type_t>& signature, bool stringViews) {
+    if (stringViews &&
+        std::find(signature.begin(), signature.end(), JAVA_TYPE_STRING) != signature.end()) {
+        return true;
+    }
+    return has_vector_arguments(signature);
+}
+
+const char* cpp_array_element_type_name(java_type_t type) {
+    switch (type) {
+        case JAVA_TYPE_BOOLEAN_ARRAY:
+            return "bool";
+        case JAVA_TYPE_INT_ARRAY:  // Fallthrough.
+        case JAVA_TYPE_ENUM_ARRAY:
+            return "int32_t";
+        case JAVA_TYPE_LONG_ARRAY:
+            return "int64_t";
+        case JAVA_TYPE_FLOAT_ARRAY:
+            return "float";
+        case JAVA_TYPE_STRING_ARRAY:
+            return "char const*";
+        default:
+            return "UNKNOWN";
+    }
+}
+
 // Does not include AttributionChain type.
 bool is_repeated_field(java_type_t type) {
     switch (type) {
@@ -328,6 +400,9 @@ void write_native_atom_constants(FILE* out, const Atoms& atoms, const AtomDecl&
     fprintf(out, "\n");
 }
 
+// The constants are written per field even when fields share an enum type. Their names are public
+// API, and a shared definition would only add to them, since each name would still need a
+// constant of its own that aliases it.
 void write_native_atom_enums(FILE* out, const Atoms& atoms) {
     // Print constants for the enum values.
     fprintf(out, "//\n");
@@ -340,8 +415,8 @@ void write_native_atom_enums(FILE* out, const Atoms& atoms) {
             if (field->javaType == JAVA_TYPE_ENUM || field->javaType == JAVA_TYPE_ENUM_ARRAY) {
                 fprintf(out, "// Values for %s.%s\n", (*atomIt)->message.c_str(),
                         field->name.c_str());
-                for (map<int, string>::const_iterator value = field->enumValues.begin();
-                     value != field->enumValues.end(); value++) {
+                for (map<int, string>::const_iterator value = field->enumValues->begin();
+                     value != field->enumValues->end(); value++) {
                     fprintf(out, "const int32_t %s__%s__%s = %d;\n",
                             make_constant_name((*atomIt)->message).c_str(),
                             make_constant_name(field->name).c_str(),
@@ -353,28 +428,41 @@ void write_native_atom_enums(FILE* out, const Atoms& atoms) {
     }
 }
 
-void write_native_method_signature(FILE* out, const string& signaturePrefix,
-                                          const vector<java_type_t>& signature,
-                                          const AtomDecl& attributionDecl, const string& closer,
-                                          bool isVendorAtomLogging) {
-    fprintf(out, "%sint32_t code", signaturePrefix.c_str());
+void write_native_method_arguments(FILE* out, const vector<java_type_t>& signature,
+                                   const AtomDecl& attributionDecl, bool isVendorAtomLogging,
+                                   bool pointerArgs, bool stringViews) {
     int argIndex = 1;
     for (vector<java_type_t>::const_iterator arg = signature.begin(); arg != signature.end();
          arg++) {
+        const char* separator = argIndex == 1 ? "" : ", ";
         if (*arg == JAVA_TYPE_ATTRIBUTION_CHAIN) {
             for (const auto& chainField : attributionDecl.fields) {
-                if (chainField.javaType == JAVA_TYPE_STRING) {
-                    fprintf(out, ", const std::vector<%s>& %s",
+                if (chainField.javaType == JAVA_TYPE_STRING && pointerArgs && stringViews) {
+                    fprintf(out, "%sstd::string_view const* %s", separator,
+                            chainField.name.c_str());
+                } else if (chainField.javaType == JAVA_TYPE_STRING && pointerArgs) {
+                    fprintf(out, "%s%s const* %s", separator,
+                            cpp_type_name(chainField.javaType, isVendorAtomLogging),
+                            chainField.name.c_str());
+                } else if (chainField.javaType == JAVA_TYPE_STRING) {
+                    fprintf(out, "%sconst std::vector<%s>& %s", separator,
                             cpp_type_name(chainField.javaType, isVendorAtomLogging),
                             chainField.name.c_str());
                 } else {
-                    fprintf(out, ", const %s* %s, size_t %s_length",
+                    fprintf(out, "%sconst %s* %s, size_t %s_length", separator,
                             cpp_type_name(chainField.javaType, isVendorAtomLogging),
                             chainField.name.c_str(), chainField.name.c_str());
                 }
+                separator = ", ";
             }
+        } else if (pointerArgs && is_vector_field(*arg)) {
+            fprintf(out, "%s%s const* arg%d, size_t arg%d_length", separator,
+                    cpp_array_element_type_name(*arg), argIndex, argIndex);
+        } else if (pointerArgs && stringViews && *arg == JAVA_TYPE_STRING) {
+            fprintf(out, "%sstd::string_view arg%d", separator, argIndex);
         } else {
-            fprintf(out, ", %s arg%d", cpp_type_name(*arg, isVendorAtomLogging), argIndex);
+            fprintf(out, "%s%s arg%d", separator, cpp_type_name(*arg, isVendorAtomLogging),
+                    argIndex);
 
             if (*arg == JAVA_TYPE_BOOLEAN_ARRAY && !isVendorAtomLogging) {
                 fprintf(out, ", size_t arg%d_length", argIndex);
@@ -382,21 +470,49 @@ void write_native_method_signature(FILE* out, const string& signaturePrefix,
         }
         argIndex++;
     }
+}
+
+void write_native_method_signature(FILE* out, const string& signaturePrefix,
+                                          const vector<java_type_t>& signature,
+                                          const AtomDecl& attributionDecl, const string& closer,
+                                          bool isVendorAtomLogging, bool pointerArgs) {
+    fprintf(out, "%sint32_t code", signaturePrefix.c_str());
+    if (!signature.empty()) {
+        fprintf(out, ", ");
+        write_native_method_arguments(out, signature, attributionDecl, isVendorAtomLogging,
+                                      pointerArgs);
+    }
     fprintf(out, ")%s\n", closer.c_str());
 }
 
 void write_native_method_header(FILE* out, const string& methodName,
                                        const SignatureInfoMap& signatureInfoMap,
                                        const AtomDecl& attributionDecl,
-                                       bool isVendorAtomLogging) {
+                                       bool isVendorAtomLogging, bool pointerOverloads) {
     for (const auto& [signature, _] : signatureInfoMap) {
         write_native_method_signature(out, methodName, signature, attributionDecl, ";",
                                       isVendorAtomLogging);
+        if (pointerOverloads && has_vector_arguments(signature)) {
+            write_native_method_signature(out, methodName, signature, attributionDecl, ";",
+                                          isVendorAtomLogging, /*pointerArgs=*/true);
+        }
     }
 }
 
 void write_native_header_preamble(FILE* out, const string& cppNamespace, bool includePull,
-                                     bool isVendorAtomLogging) {
+                                     bool isVendorAtomLogging, bool includeStringView) {
+    write_native_header_includes(out, includePull, isVendorAtomLogging, includeStringView);
+
+    write_namespace(out, cppNamespace);
+    fprintf(out, "\n");
+    fprintf(out, "/*\n");
+    fprintf(out, " * API For logging statistics events.\n");
+    fprintf(out, " */\n");
+    fprintf(out, "\n");
+}
+
+void write_native_header_includes(FILE* out, bool includePull, bool isVendorAtomLogging,
+                                  bool includeStringView) {
     // Print prelude
     fprintf(out, "// This file is autogenerated\n");
     fprintf(out, "\n");
@@ -406,6 +522,9 @@ void write_native_header_preamble(FILE* out, const string& cppNamespace, bool in
     fprintf(out, "#include <vector>\n");
     fprintf(out, "#include <map>\n");
     fprintf(out, "#include <set>\n");
+    if (includeStringView) {
+        fprintf(out, "#include <string_view>\n");
+    }
     if (includePull) {
         fprintf(out, "#include <stats_pull_atom_callback.h>\n");
     }
@@ -415,13 +534,6 @@ void write_native_header_preamble(FILE* out, const string& cppNamespace, bool in
     }
 
     fprintf(out, "\n");
-
-    write_namespace(out, cppNamespace);
-    fprintf(out, "\n");
-    fprintf(out, "/*\n");
-    fprintf(out, " * API For logging statistics events.\n");
-    fprintf(out, " */\n");
-    fprintf(out, "\n");
 }
 
 void write_native_header_epilogue(FILE* out, const string& cppNamespace) {
@@ -453,6 +565,8 @@ void write_java_atom_codes(FILE* out, const Atoms& atoms) {
     fprintf(out, "\n");
 }
 
+// As for the native constants, the values of an enum type shared by several fields are written
+// once per field.
 void write_java_enum_values(FILE* out, const Atoms& atoms) {
     fprintf(out, "    // Constants for enum values.\n\n");
     for (AtomDeclSet::const_iterator atomIt = atoms.decls.begin(); atomIt != atoms.decls.end();
@@ -462,8 +576,8 @@ void write_java_enum_values(FILE* out, const Atoms& atoms) {
             if (field->javaType == JAVA_TYPE_ENUM || field->javaType == JAVA_TYPE_ENUM_ARRAY) {
                 fprintf(out, "    // Values for %s.%s\n", (*atomIt)->message.c_str(),
                         field->name.c_str());
-                for (map<int, string>::const_iterator value = field->enumValues.begin();
-                     value != field->enumValues.end(); value++) {
+                for (map<int, string>::const_iterator value = field->enumValues->begin();
+                     value != field->enumValues->end(); value++) {
                     fprintf(out, "    public static final int %s__%s__%s = %d;\n",
                             make_constant_name((*atomIt)->message).c_str(),
                             make_constant_name(field->name).c_str(),
@@ -656,6 +770,135 @@ int get_min_api_level(const AtomDeclSet& atomDeclSet) {
     return API_LEVEL_CURRENT;
 }
 
+map<int, int> get_pushed_atom_indices(const Atoms& atoms) {
+    map<int, int> atomIndices;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        if (atomDecl->atomType == ATOM_TYPE_PUSHED) {
+            atomIndices.emplace(atomDecl->code, atomIndices.size());
+        }
+    }
+    return atomIndices;
+}
+
+map<string, int> get_atom_name_codes(const Atoms& atoms) {
+    map<string, int> nameCodes;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        nameCodes.emplace(make_constant_name(atomDecl->name), atomDecl->code);
+    }
+    return nameCodes;
+}
+
+map<string, int> get_enum_name_values(const Atoms& atoms) {
+    map<string, int> nameValues;
+    for (const shared_ptr<AtomDecl>& atomDecl : atoms.decls) {
+        for (const AtomField& field : atomDecl->fields) {
+            if (field.javaType != JAVA_TYPE_ENUM && field.javaType != JAVA_TYPE_ENUM_ARRAY) {
+                continue;
+            }
+            for (const auto& [value, valueName] : *field.enumValues) {
+                nameValues.emplace(make_constant_name(atomDecl->message) + "__" +
+                                           make_constant_name(field.name) + "__" +
+                                           make_constant_name(valueName),
+                                   value);
+            }
+        }
+    }
+    return nameValues;
+}
+
+uint32_t get_name_hash(const string& name, uint32_t seed) {
+    uint32_t hash = NAME_HASH_OFFSET_BASIS ^ seed;
+    for (const char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * NAME_HASH_PRIME;
+    }
+    hash ^= hash >> 16;
+    hash *= NAME_HASH_MIX;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+NameHashTable build_name_hash_table(const map<string, int>& nameValues) {
+    const size_t size = nameValues.size();
+    NameHashTable table;
+    table.seeds.assign(size, 0);
+    table.names.resize(size);
+    table.values.assign(size, 0);
+    if (size == 0) {
+        return table;
+    }
+
+    vector<vector<map<string, int>::const_iterator>> buckets(size);
+    for (auto it = nameValues.begin(); it != nameValues.end(); it++) {
+        buckets[get_name_hash(it->first, 0) % size].push_back(it);
+    }
+    vector<size_t> bucketOrder(size);
+    for (size_t i = 0; i < size; i++) {
+        bucketOrder[i] = i;
+    }
+    // Place the largest buckets first, while most slots are still free.
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&buckets](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    vector<bool> used(size, false);
+    size_t next = 0;
+    for (const size_t bucket : bucketOrder) {
+        const auto& entries = buckets[bucket];
+        if (entries.empty()) {
+            break;
+        }
+        if (entries.size() == 1) {
+            // Buckets of one name take the next free slot directly.
+            while (used[next]) {
+                next++;
+            }
+            used[next] = true;
+            table.seeds[bucket] = -static_cast<int32_t>(next) - 1;
+            table.names[next] = entries[0]->first;
+            table.values[next] = entries[0]->second;
+            continue;
+        }
+        // Find a seed that sends every name of the bucket to a different free slot.
+        for (uint32_t seed = 1;; seed++) {
+            vector<size_t> slots;
+            for (const auto& entry : entries) {
+                const size_t slot = get_name_hash(entry->first, seed) % size;
+                if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (slots.size() != entries.size()) {
+                continue;
+            }
+            for (size_t i = 0; i < slots.size(); i++) {
+                used[slots[i]] = true;
+                table.names[slots[i]] = entries[i]->first;
+                table.values[slots[i]] = entries[i]->second;
+            }
+            table.seeds[bucket] = seed;
+            break;
+        }
+    }
+    return table;
+}
+
+vector<java_type_t> get_atom_signature(const AtomDecl& atomDecl) {
+    vector<java_type_t> signature;
+    signature.reserve(atomDecl.fields.size());
+    for (const AtomField& field : atomDecl.fields) {
+        // All enums are treated as ints when it comes to function signatures.
+        if (field.javaType == JAVA_TYPE_ENUM) {
+            signature.push_back(JAVA_TYPE_INT);
+        } else if (field.javaType == JAVA_TYPE_ENUM_ARRAY) {
+            signature.push_back(JAVA_TYPE_INT_ARRAY);
+        } else {
+            signature.push_back(field.javaType);
+        }
+    }
+    return signature;
+}
+
 AtomDeclSet get_annotations(int argIndex,
                             const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet) {
     FieldNumberToAtomDeclSet::const_iterator fieldNumberToAtomDeclSetIt =
@@ -666,5 +909,119 @@ AtomDeclSet get_annotations(int argIndex,
     return fieldNumberToAtomDeclSetIt->second;
 }
 
+namespace {
+
+struct OutputBuffer {
+    string filename;
+    char* data = nullptr;
+    size_t size = 0;
+};
+
+// The buffers of the streams returned by open_output_file(), which open_memstream() updates.
+map<FILE*, std::unique_ptr<OutputBuffer>> outputBuffers;
+
+bool file_has_content(const string& filename, const char* data, size_t size) {
+    FILE* in = fopen(filename.c_str(), "r");
+    if (in == nullptr) {
+        return false;
+    }
+    bool same = true;
+    char buffer[64 * 1024];
+    size_t offset = 0;
+    size_t count;
+    while (same && (count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        same = count <= size - offset && memcmp(buffer, data + offset, count) == 0;
+        offset += count;
+    }
+    same = same && !ferror(in) && offset == size;
+    fclose(in);
+    return same;
+}
+
+bool write_file(const string& filename, const char* data, size_t size) {
+    FILE* out = fopen(filename.c_str(), "w");
+    if (out == nullptr) {
+        return false;
+    }
+    const bool written = fwrite(data, 1, size, out) == size;
+    return fclose(out) == 0 && written;
+}
+
+// Returns the mode that fopen() gives the files it creates.
+mode_t get_new_file_mode() {
+    const mode_t mask = umask(0);
+    umask(mask);
+    return 0666 & ~mask;
+}
+
+// Writes data to a new file with mode and a unique name next to filename. Sets tempFilename to
+// the name of the file, if it was created.
+bool write_temp_file(const string& filename, mode_t mode, const char* data, size_t size,
+                     string* tempFilename) {
+    string pattern = filename + ".XXXXXX";
+    const int fd = mkstemp(pattern.data());
+    if (fd < 0) {
+        return false;
+    }
+    *tempFilename = pattern;
+    FILE* out = fdopen(fd, "w");
+    if (out == nullptr) {
+        close(fd);
+        return false;
+    }
+    const bool written = fchmod(fd, mode) == 0 && fwrite(data, 1, size, out) == size;
+    return fclose(out) == 0 && written;
+}
+
+}  // namespace
+
+FILE* open_output_file(const string& filename) {
+    std::unique_ptr<OutputBuffer> buffer = std::make_unique<OutputBuffer>();
+    buffer->filename = filename;
+    FILE* out = open_memstream(&buffer->data, &buffer->size);
+    if (out != nullptr) {
+        outputBuffers[out] = std::move(buffer);
+    }
+    return out;
+}
+
+int close_output_file(FILE* out) {
+    const auto it = outputBuffers.find(out);
+    const std::unique_ptr<OutputBuffer> buffer = std::move(it->second);
+    outputBuffers.erase(it);
+    if (fclose(out) != 0) {
+        free(buffer->data);
+        fprintf(stderr, "Unable to render file: %s\n", buffer->filename.c_str());
+        return 1;
+    }
+
+    int errorCount = 0;
+    struct stat fileStat;
+    const bool exists = stat(buffer->filename.c_str(), &fileStat) == 0;
+    if (exists && !S_ISREG(fileStat.st_mode)) {
+        // Devices and pipes, such as /dev/stdout, can neither be read back nor be replaced.
+        if (!write_file(buffer->filename, buffer->data, buffer->size)) {
+            fprintf(stderr, "Unable to open file for write: %s\n", buffer->filename.c_str());
+            errorCount++;
+        }
+    } else if (!file_has_content(buffer->filename, buffer->data, buffer->size)) {
+        // Write next to the file, so that the rename replaces it atomically. The name is unique,
+        // so that concurrent runs that write the same file do not write the same temporary file.
+        const mode_t mode = exists ? fileStat.st_mode & 07777 : get_new_file_mode();
+        string tempFilename;
+        if (!write_temp_file(buffer->filename, mode, buffer->data, buffer->size,
+                             &tempFilename) ||
+            rename(tempFilename.c_str(), buffer->filename.c_str()) != 0) {
+            if (!tempFilename.empty()) {
+                remove(tempFilename.c_str());
+            }
+            fprintf(stderr, "Unable to open file for write: %s\n", buffer->filename.c_str());
+            errorCount++;
+        }
+    }
+    free(buffer->data);
+    return errorCount;
+}
+
 }  // namespace stats_log_api_gen
 }  // namespace android
@@ -66,6 +66,8 @@ string get_restriction_category_str(int annotationValue);
 
 string make_constant_name(const string& str);
 
+string make_camel_case_name(const string& str);
+
 const char* cpp_type_name(java_type_t type, bool isVendorAtomLogging = false);
 
 const char* java_type_name(java_type_t type);
@@ -74,8 +76,23 @@ bool is_repeated_field(java_type_t type);
 
 bool is_primitive_field(java_type_t type);
 
+bool is_vector_field(java_type_t type);
+
+// Returns true if the native methods of the signature take an attribution chain or a repeated
+// field as a std::vector.
+bool has_vector_arguments(const vector<java_type_t>& signature);
+
+// Returns true if the native methods of the signature get an overload that takes their pointer
+// arguments. If stringViews is set, that overload also takes the strings as std::string_view.
+bool has_pointer_overload(const vector<java_type_t>& signature, bool stringViews);
+
+const char* cpp_array_element_type_name(java_type_t type);
+
 AtomDeclSet get_annotations(int argIndex, const FieldNumberToAtomDeclSet& fieldNumberToAtomDeclSet);
 
+// Returns the method signature of a single atom, as collate_atom would compute it.
+vector<java_type_t> get_atom_signature(const AtomDecl& atomDecl);
+
 // Common Native helpers
 void write_namespace(FILE* out, const string& cppNamespaces);
 
@@ -87,17 +104,34 @@ void write_native_atom_constants(FILE* out, const Atoms& atoms, const AtomDecl&
 
 void write_native_atom_enums(FILE* out, const Atoms& atoms);
 
+vector<string> Split(const string& s, const string& delimiters);
+
+// If pointerArgs is set, the attribution tags are taken as a pointer to uid_length tags, and the
+// repeated fields as a pointer and a length, instead of as a std::vector. If stringViews is also
+// set, the strings and the attribution tags are taken as std::string_view.
+void write_native_method_arguments(FILE* out, const vector<java_type_t>& signature,
+                                   const AtomDecl& attributionDecl,
+                                   bool isVendorAtomLogging = false, bool pointerArgs = false,
+                                   bool stringViews = false);
+
 void write_native_method_signature(FILE* out, const string& signaturePrefix,
                                    const vector<java_type_t>& signature,
                                    const AtomDecl& attributionDecl, const string& closer,
-                                   bool isVendorAtomLogging = false);
+                                   bool isVendorAtomLogging = false, bool pointerArgs = false);
 
+// If pointerOverloads is set, signatures with std::vector arguments are also declared with those
+// arguments taken as pointers.
 void write_native_method_header(FILE* out, const string& methodName,
                                 const SignatureInfoMap& signatureInfoMap,
-                                const AtomDecl& attributionDecl, bool isVendorAtomLogging = false);
+                                const AtomDecl& attributionDecl, bool isVendorAtomLogging = false,
+                                bool pointerOverloads = false);
 
 void write_native_header_preamble(FILE* out, const string& cppNamespace, bool includePull,
-                                  bool isVendorAtomLogging = false);
+                                  bool isVendorAtomLogging = false, bool includeStringView = false);
+
+// Writes the start of write_native_header_preamble(), up to the end of its includes.
+void write_native_header_includes(FILE* out, bool includePull, bool isVendorAtomLogging = false,
+                                  bool includeStringView = false);
 
 void write_native_header_epilogue(FILE* out, const string& cppNamespace);
 
@@ -130,6 +164,45 @@ bool requires_api_needed(const AtomDeclSet& atomDeclSet);
 
 int get_min_api_level(const AtomDeclSet& atomDeclSet);
 
+// Maps the code of each pushed atom to a dense index, assigned in atom code order.
+map<int, int> get_pushed_atom_indices(const Atoms& atoms);
+
+// Maps the constant name of each atom, such as BLE_SCAN_STATE_CHANGED, to its code.
+map<string, int> get_atom_name_codes(const Atoms& atoms);
+
+// Maps the constant name of each enum value, such as BLE_SCAN_STATE_CHANGED__STATE__ON, to the
+// value.
+map<string, int> get_enum_name_values(const Atoms& atoms);
+
+// Seeded FNV-1a hash of a name, with a final mix. The generated lookups compute the same hash.
+const uint32_t NAME_HASH_OFFSET_BASIS = 0x811c9dc5;
+const uint32_t NAME_HASH_PRIME = 0x01000193;
+const uint32_t NAME_HASH_MIX = 0x7feb352d;
+
+uint32_t get_name_hash(const string& name, uint32_t seed);
+
+// A minimal perfect hash of a set of names, with one slot per name. A name is at slot
+// -seed - 1 if the seed of its bucket, seeds[get_name_hash(name, 0) % size], is negative, and
+// at slot get_name_hash(name, seed) % size otherwise. Lookups compare the name at that slot, so
+// that names not in the set are not found.
+struct NameHashTable {
+    vector<int32_t> seeds;
+    vector<string> names;
+    vector<int32_t> values;
+};
+
+NameHashTable build_name_hash_table(const map<string, int>& nameValues);
+
+// Returns a stream that renders the output file filename in memory, or nullptr on failure.
+// close_output_file() only replaces the file, through a rename, if the content changed, so that
+// the outputs that did not change keep their timestamp and do not trigger rebuilds. Outputs that
+// are not regular files, such as /dev/stdout, are written in place.
+FILE* open_output_file(const string& filename);
+
+// Closes a stream returned by open_output_file() and writes its file if it changed. Returns the
+// number of errors.
+int close_output_file(FILE* out);
+
 }  // namespace stats_log_api_gen
 }  // namespace android
 